@@ -68,6 +68,8 @@ void AMRUpdate(BlockVector &S, BlockVector &S_tmp,
 void GetZeroBCDofs(ParMesh *pmesh, ParFiniteElementSpace *pspace,
                    int bdr_attr_max, Array<int> &ess_tdofs);
 
+double LoadImbalance(ParMesh *pmesh, double &reachable);
+
 void FindElementsWithVertex(const Mesh* mesh, const Vertex &vert,
                             const double size, Array<int> &elements);
 
@@ -108,6 +110,8 @@ int main(int argc, char *argv[])
    double ref_threshold = 2e-4;
    double deref_threshold = 0.75;
    const int nc_limit = 1;
+   int lb_steps = 0;
+   double lb_tol = 1.05;
    const double blast_energy = 0.25;
    const double blast_position[] = {0.0, 0.0, 0.0};
    const double blast_amr_size = 1e-10;
@@ -148,6 +152,13 @@ int main(int argc, char *argv[])
                   "AMR refinement threshold.");
    args.AddOption(&deref_threshold, "-dt", "--deref-threshold",
                   "AMR derefinement threshold (0 = no derefinement).");
+   args.AddOption(&lb_steps, "-lbs", "--load-balance-steps",
+                  "Check the AMR load balance every n-th timestep, in addition\n\t"
+                  "to every mesh change (0 = only on mesh changes).");
+   args.AddOption(&lb_tol, "-lbt", "--load-balance-tol",
+                  "Rebalance the AMR mesh when the max/avg ratio of the task\n\t"
+                  "zone counts exceeds this factor times the ratio reachable\n\t"
+                  "by rebalancing.");
 
    args.AddOption(&visualization, "-vis", "--visualization", "-no-vis",
                   "--no-visualization",
@@ -216,15 +227,6 @@ int main(int argc, char *argv[])
          cout << "Laghos does not support PA in 1D. Switching to FA." << endl;
       }
    }
-   if (p_assembly && amr)
-   {
-      p_assembly = false;
-      if (mpi.Root())
-      {
-         cout << "Laghos currently does not support PA for AMR. "
-              "Switching to FA." << endl;
-      }
-   }
 
    // Parallel partitioning of the mesh.
    ParMesh *pmesh = NULL;
@@ -698,17 +700,37 @@ int main(int argc, char *argv[])
             }
          }
 
+         // Rebalance after the mesh changes, and periodically with -lbs, when
+         // the imbalance is above the one reachable by rebalancing.
          if (mesh_changed)
          {
-            // update state and operator
             AMRUpdate(S, S_old, true_offset, x_gf, v_gf, e_gf);
-            oper.AMRUpdate(S, true);
-
-            pmesh->Rebalance();
+         }
+         bool rebalance = false;
+         if (mesh_changed || (lb_steps > 0 && ti % lb_steps == 0))
+         {
+            double reachable;
+            const double imbalance = LoadImbalance(pmesh, reachable);
+            rebalance = imbalance > lb_tol * reachable;
+            if (rebalance && myid == 0)
+            {
+               cout << "Rebalanced, imbalance = " << imbalance
+                    << " (reachable " << reachable << ")" << endl;
+            }
+         }
 
+         if (mesh_changed || rebalance)
+         {
             // update state and operator
-            AMRUpdate(S, S_old, true_offset, x_gf, v_gf, e_gf);
-            oper.AMRUpdate(S, false);
+            if (mesh_changed) { oper.AMRUpdate(S, rebalance); }
+            if (rebalance)
+            {
+               pmesh->Rebalance();
+
+               // update state and operator
+               AMRUpdate(S, S_old, true_offset, x_gf, v_gf, e_gf);
+               oper.AMRUpdate(S, false);
+            }
 
             GetZeroBCDofs(pmesh, &H1FESpace, bdr_attr_max, ess_tdofs);
 
@@ -795,6 +817,24 @@ void AMRUpdate(BlockVector &S, BlockVector &S_tmp,
    S_tmp.Update(true_offset);
 }
 
+// Returns the load imbalance, i.e., the max/avg ratio of the task zone counts,
+// and in 'reachable' the imbalance after ParMesh::Rebalance, which splits the
+// space-filling curve of the nonconforming mesh in chunks of equal zone
+// counts. The zones are not weighted, as they all use the same order and
+// quadrature rule, and do the same work in each time step.
+double LoadImbalance(ParMesh *pmesh, double &reachable)
+{
+   MPI_Comm comm = pmesh->GetComm();
+   int nranks;
+   MPI_Comm_size(comm, &nranks);
+
+   int my_ne = pmesh->GetNE(), max_ne;
+   MPI_Allreduce(&my_ne, &max_ne, 1, MPI_INT, MPI_MAX, comm);
+   const double avg_ne = double(pmesh->GetGlobalNE()) / nranks;
+   reachable = ceil(avg_ne) / avg_ne;
+   return max_ne / avg_ne;
+}
+
 void FindElementsWithVertex(const Mesh* mesh, const Vertex &vert,
                             const double size, Array<int> &elements)
 {
@@ -43,7 +43,9 @@ struct QuadratureData
    // Quadrature data used for full/partial assembly of the force operator. At
    // each quadrature point, it combines the stress, inverse Jacobian,
    // determinant of the Jacobian and the integration weight. It must be
-   // recomputed in every time step.
+   // recomputed in every time step. The layout is NQ x dim*dim x NE, where the
+   // component index is gd + dim*vd for the (vd, gd) entry, as in the parallel
+   // version, see ../laghos_pa_kernels.hpp.
    DenseTensor stressJinvT;
 
    // Quadrature data used for full/partial assembly of the mass matrices. At
@@ -63,44 +65,17 @@ struct QuadratureData
 
    QuadratureData(int dim, int nzones, int quads_per_zone)
       : Jac0inv(dim, dim, nzones * quads_per_zone),
-        stressJinvT(nzones * quads_per_zone, dim, dim),
+        stressJinvT(quads_per_zone, dim * dim, nzones),
         rho0DetJ0w(nzones * quads_per_zone) { }
 
    void Resize(int dim, int nzones, int quads_per_zone)
    {
       Jac0inv.SetSize(dim, dim, nzones * quads_per_zone);
-      stressJinvT.SetSize(nzones * quads_per_zone, dim, dim);
+      stressJinvT.SetSize(quads_per_zone, dim * dim, nzones);
       rho0DetJ0w.SetSize(nzones * quads_per_zone);
    }
 };
 
-// Stores values of the one-dimensional shape functions and gradients at all 1D
-// quadrature points. All sizes are (dofs1D_cnt x quads1D_cnt).
-struct Tensors1D
-{
-   // H1 shape functions and gradients, L2 shape functions.
-   DenseMatrix HQshape1D, HQgrad1D, LQshape1D;
-
-   Tensors1D(int H1order, int L2order, int nqp1D);
-};
-extern const Tensors1D *tensors1D;
-
-class FastEvaluator
-{
-   const int dim;
-   ParFiniteElementSpace &H1FESpace;
-
-public:
-   FastEvaluator(ParFiniteElementSpace &h1fes)
-      : dim(h1fes.GetMesh()->Dimension()), H1FESpace(h1fes) { }
-
-   void GetL2Values(const Vector &vecL2, Vector &vecQP) const;
-   // The input vec is an H1 function with dim components, over a zone.
-   // The output is J_ij = d(vec_i) / d(x_j) with ij = 1 .. dim.
-   void GetVectorGrad(const DenseMatrix &vec, DenseTensor &J) const;
-};
-extern const FastEvaluator *evaluator;
-
 // This class is used only for visualization. It assembles (rho, phi) in each
 // zone, which is used by LagrangianHydroOperator::ComputeDensity to do an L2
 // projection of the density.
@@ -134,93 +109,68 @@ public:
 };
 
 // Performs partial assembly, which corresponds to (and replaces) the use of the
-// LagrangianHydroOperator::Force global matrix.
+// LagrangianHydroOperator::Force global matrix. The actions use the shared
+// kernels of ../laghos_pa_kernels.hpp on the lexicographic E-vectors.
 class ForcePAOperator : public Operator
 {
 private:
-   const int dim, nzones;
+   const int dim;
+   int nzones;
 
-   QuadratureData *quad_data;
+   const QuadratureData &quad_data;
    ParFiniteElementSpace &H1FESpace, &L2FESpace;
-
-   // Force matrix action on quadrilateral elements in 2D.
-   void MultQuad(const Vector &vecL2, Vector &vecH1) const;
-   // Force matrix action on hexahedral elements in 3D.
-   void MultHex(const Vector &vecL2, Vector &vecH1) const;
-
-   // Transpose force matrix action on quadrilateral elements in 2D.
-   void MultTransposeQuad(const Vector &vecH1, Vector &vecL2) const;
-   // Transpose force matrix action on hexahedral elements in 3D.
-   void MultTransposeHex(const Vector &vecH1, Vector &vecL2) const;
+   const Operator *H1R, *L2R;
+   const IntegrationRule &ir1D;
+   const int D1D, Q1D, L1D;
+   const DofToQuad *L2D2Q, *H1D2Q;
+   // Q is the quadrature point buffer of the generic (any order) kernels.
+   mutable Vector X, Y, Q;
 
 public:
-   ForcePAOperator(QuadratureData *quad_data_,
-                   ParFiniteElementSpace &h1fes, ParFiniteElementSpace &l2fes)
-      : dim(h1fes.GetMesh()->Dimension()), nzones(h1fes.GetMesh()->GetNE()),
-        quad_data(quad_data_), H1FESpace(h1fes), L2FESpace(l2fes) { }
+   ForcePAOperator(const QuadratureData &quad_data_,
+                   ParFiniteElementSpace &h1fes, ParFiniteElementSpace &l2fes,
+                   const IntegrationRule &ir);
 
    virtual void Mult(const Vector &vecL2, Vector &vecH1) const;
    virtual void MultTranspose(const Vector &vecH1, Vector &vecL2) const;
 
-   ~ForcePAOperator() { }
+   // Updates the restrictions and sizes after a mesh change.
+   void AMRUpdate();
 };
 
-// Performs partial assembly for the velocity mass matrix.
+// Performs partial assembly for the velocity mass matrix. The quadrature point
+// weights are the time-zero rho0DetJ0w of quad_data, so that the operator
+// follows the incremental updates of the zone data; the restriction and the
+// sizes are updated by AMRUpdate.
 class MassPAOperator : public Operator
 {
 private:
-   const int dim, nzones;
+   const int dim;
+   int nzones;
 
-   QuadratureData *quad_data;
+   const QuadratureData &quad_data;
    ParFiniteElementSpace &FESpace;
-
-   // Mass matrix action on quadrilateral elements in 2D.
-   void MultQuad(const Vector &x, Vector &y) const;
-   // Mass matrix action on hexahedral elements in 3D.
-   void MultHex(const Vector &x, Vector &y) const;
+   const Operator *H1R;
+   const DofToQuad *H1D2Q;
+   const int D1D, Q1D;
+   mutable Vector X, Y, QX;
 
 public:
-   MassPAOperator(QuadratureData *quad_data_, ParFiniteElementSpace &fes)
-      : Operator(fes.GetVSize()),
-        dim(fes.GetMesh()->Dimension()), nzones(fes.GetMesh()->GetNE()),
-        quad_data(quad_data_), FESpace(fes)
-   { }
+   MassPAOperator(const QuadratureData &quad_data_,
+                  ParFiniteElementSpace &fes, const IntegrationRule &ir);
 
    // Mass matrix action.
    virtual void Mult(const Vector &x, Vector &y) const;
 
+   // Updates the sizes after a mesh change.
+   void AMRUpdate();
+
    virtual const Operator *GetProlongation() const
    { return FESpace.GetProlongationMatrix(); }
    virtual const Operator *GetRestriction() const
    { return FESpace.GetRestrictionMatrix(); }
 };
 
-// Performs partial assembly for the energy mass matrix on a single zone.
-// Used to perform local CG solves, thus avoiding unnecessary communication.
-class LocalMassPAOperator : public Operator
-{
-private:
-   const int dim;
-   int zone_id;
-
-   QuadratureData *quad_data;
-
-   // Mass matrix action on a quadrilateral element in 2D.
-   void MultQuad(const Vector &x, Vector &y) const;
-   // Mass matrix action on a hexahedral element in 3D.
-   void MultHex(const Vector &x, Vector &y) const;
-
-public:
-   LocalMassPAOperator(QuadratureData *quad_data_, ParFiniteElementSpace &fes)
-      : Operator(fes.GetFE(0)->GetDof()),
-        dim(fes.GetMesh()->Dimension()), zone_id(0),
-        quad_data(quad_data_)
-   { }
-   void SetZoneId(int zid) { zone_id = zid; }
-
-   virtual void Mult(const Vector &x, Vector &y) const;
-};
-
 } // namespace hydrodynamics
 
 } // namespace mfem
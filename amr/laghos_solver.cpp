@@ -116,49 +116,22 @@ LagrangianHydroOperator::LagrangianHydroOperator(int size,
      Mv(&h1_fes), Me_inv(l2dofs_cnt, l2dofs_cnt, nzones),
      integ_rule(IntRules.Get(h1_fes.GetMesh()->GetElementBaseGeometry(0),
                              3*h1_fes.GetOrder(0) + l2_fes.GetOrder(0) - 1)),
+     zone_fec(0, dim),
+     zone_fes(h1_fes.GetParMesh(), &zone_fec,
+              integ_rule.GetNPoints() * (1 + dim*dim) + l2dofs_cnt*l2dofs_cnt
+              + (pa ? 0 : h1dofs_cnt*h1dofs_cnt), Ordering::byVDIM),
+     zone_data(&zone_fes),
      quad_data(dim, nzones, integ_rule.GetNPoints()),
      quad_data_is_current(false),
-     Force(&l2_fes, &h1_fes), ForcePA(&quad_data, h1_fes, l2_fes),
-     VMassPA(&quad_data, H1FESpace), locEMassPA(&quad_data, l2_fes),
-     locCG(), timer()
+     Force(&l2_fes, &h1_fes), ForcePA(quad_data, h1_fes, l2_fes, integ_rule),
+     VMassPA(quad_data, H1FESpace, integ_rule), timer()
 {
-   // Standard local assembly and inversion for energy mass matrices.
-   DenseMatrix Me(l2dofs_cnt);
-   DenseMatrixInverse inv(&Me);
-   MassIntegrator mi(rho0_coeff, &integ_rule);
-   for (int i = 0; i < nzones; i++)
-   {
-      mi.AssembleElementMatrix(*l2_fes.GetFE(i),
-                               *l2_fes.GetElementTransformation(i), Me);
-      inv.Factor();
-      inv.GetInverseMatrix(Me_inv(i));
-   }
-
-   // Standard assembly for the velocity mass matrix.
-   VectorMassIntegrator *vmi = new VectorMassIntegrator(rho0_coeff, &integ_rule);
-   Mv.AddDomainIntegrator(vmi);
-   Mv.Assemble();
-
-   // Values of rho0DetJ0 and Jac0inv at all quadrature points.
-   const int nqp = integ_rule.GetNPoints();
-   Vector rho_vals(nqp);
-   for (int i = 0; i < nzones; i++)
-   {
-      rho0.GetValues(i, integ_rule, rho_vals);
-      ElementTransformation *T = h1_fes.GetElementTransformation(i);
-      for (int q = 0; q < nqp; q++)
-      {
-         const IntegrationPoint &ip = integ_rule.IntPoint(q);
-         T->SetIntPoint(&ip);
-
-         DenseMatrixInverse Jinv(T->Jacobian());
-         Jinv.GetInverseMatrix(quad_data.Jac0inv(i*nqp + q));
-
-         const double rho0DetJ0 = T->Weight() * rho_vals(q);
-         quad_data.rho0DetJ0w(i*nqp + q) = rho0DetJ0 *
-                                           integ_rule.IntPoint(q).weight;
-      }
-   }
+   // Values of rho0DetJ0 and Jac0inv at all quadrature points, the local
+   // inverses of the energy mass matrices, and the zone matrices of the
+   // velocity mass matrix. The latter is not used with partial assembly.
+   for (int i = 0; i < nzones; i++) { ComputeZoneData(i); }
+   UnpackZoneData();
+   if (!p_assembly) { AssembleVelocityMass(); }
 
    // Save initial (undeformed) mesh configuration for use in AMRUpdate later.
    x0_gf = *(h1_fes.GetMesh()->GetNodes());
@@ -192,21 +165,6 @@ LagrangianHydroOperator::LagrangianHydroOperator(int size,
    // Make a dummy assembly to figure out the sparsity.
    Force.Assemble(0);
    Force.Finalize(0);
-
-   if (p_assembly)
-   {
-      tensors1D = new Tensors1D(H1FESpace.GetFE(0)->GetOrder(),
-                                L2FESpace.GetFE(0)->GetOrder(),
-                                int(floor(0.7 + pow(nqp, 1.0 / dim))));
-      evaluator = new FastEvaluator(H1FESpace);
-   }
-
-   locCG.SetOperator(locEMassPA);
-   locCG.iterative_mode = false;
-   locCG.SetRelTol(1e-8);
-   locCG.SetAbsTol(1e-8 * numeric_limits<double>::epsilon());
-   locCG.SetMaxIter(200);
-   locCG.SetPrintLevel(0);
 }
 
 void LagrangianHydroOperator::Mult(const Vector &S, Vector &dS_dt) const
@@ -308,41 +266,21 @@ void LagrangianHydroOperator::Mult(const Vector &S, Vector &dS_dt) const
    }
    Array<int> l2dofs;
    Vector e_rhs(VsizeL2), loc_rhs(l2dofs_cnt), loc_de(l2dofs_cnt);
-   if (p_assembly)
+   timer.sw_force.Start();
+   if (p_assembly) { ForcePA.MultTranspose(v, e_rhs); }
+   else { Force.MultTranspose(v, e_rhs); }
+   timer.sw_force.Stop();
+   if (e_source) { e_rhs += *e_source; }
+   // Both assembly levels use the local inverses of the zone data.
+   for (int z = 0; z < nzones; z++)
    {
-      timer.sw_force.Start();
-      ForcePA.MultTranspose(v, e_rhs);
-      timer.sw_force.Stop();
-
-      if (e_source) { e_rhs += *e_source; }
-      for (int z = 0; z < nzones; z++)
-      {
-         L2FESpace.GetElementDofs(z, l2dofs);
-         e_rhs.GetSubVector(l2dofs, loc_rhs);
-         locEMassPA.SetZoneId(z);
-         timer.sw_cgL2.Start();
-         locCG.Mult(loc_rhs, loc_de);
-         timer.sw_cgL2.Stop();
-         timer.L2dof_iter += locCG.GetNumIterations() * l2dofs_cnt;
-         de.SetSubVector(l2dofs, loc_de);
-      }
-   }
-   else
-   {
-      timer.sw_force.Start();
-      Force.MultTranspose(v, e_rhs);
-      timer.sw_force.Stop();
-      if (e_source) { e_rhs += *e_source; }
-      for (int z = 0; z < nzones; z++)
-      {
-         L2FESpace.GetElementDofs(z, l2dofs);
-         e_rhs.GetSubVector(l2dofs, loc_rhs);
-         timer.sw_cgL2.Start();
-         Me_inv(z).Mult(loc_rhs, loc_de);
-         timer.sw_cgL2.Stop();
-         timer.L2dof_iter += l2dofs_cnt;
-         de.SetSubVector(l2dofs, loc_de);
-      }
+      L2FESpace.GetElementDofs(z, l2dofs);
+      e_rhs.GetSubVector(l2dofs, loc_rhs);
+      timer.sw_cgL2.Start();
+      Me_inv(z).Mult(loc_rhs, loc_de);
+      timer.sw_cgL2.Stop();
+      timer.L2dof_iter += l2dofs_cnt;
+      de.SetSubVector(l2dofs, loc_de);
    }
    delete e_source;
 
@@ -441,10 +379,7 @@ void LagrangianHydroOperator::PrintTimingData(bool IamRoot, int steps)
    }
 }
 
-LagrangianHydroOperator::~LagrangianHydroOperator()
-{
-   delete tensors1D;
-}
+LagrangianHydroOperator::~LagrangianHydroOperator() { }
 
 void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
 {
@@ -458,11 +393,35 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
    x.MakeRef(&H1FESpace, *sptr, 0);
    v.MakeRef(&H1FESpace, *sptr, H1FESpace.GetVSize());
    e.MakeRef(&L2FESpace, *sptr, 2*H1FESpace.GetVSize());
-   Vector e_vals, e_loc(l2dofs_cnt), vector_vals(h1dofs_cnt * dim);
-   DenseMatrix Jpi(dim), sgrad_v(dim), Jinv(dim), stress(dim), stressJiT(dim),
-               vecvalMat(vector_vals.GetData(), h1dofs_cnt, dim);
+   Vector e_vals;
+   DenseMatrix Jpi(dim), sgrad_v(dim), Jinv(dim), stress(dim), stressJiT(dim);
    DenseTensor grad_v_ref(dim, dim, nqp);
-   Array<int> L2dofs, H1dofs;
+
+   // With partial assembly, the energy values and the reference gradients of
+   // the position and the velocity are interpolated at all points at once.
+   // The restriction and the interpolators are rebuilt by the space updates.
+   const int jsize = dim * dim * nqp;
+   Vector e_quads, x_grads, v_grads;
+   if (p_assembly)
+   {
+      const Operator *H1R =
+         H1FESpace.GetElementRestriction(ElementDofOrdering::LEXICOGRAPHIC);
+      const QuadratureInterpolator *qi_h1 =
+         H1FESpace.GetQuadratureInterpolator(integ_rule);
+      const QuadratureInterpolator *qi_l2 =
+         L2FESpace.GetQuadratureInterpolator(integ_rule);
+      qi_h1->SetOutputLayout(QVectorLayout::byVDIM);
+      qi_l2->SetOutputLayout(QVectorLayout::byVDIM);
+      Vector vec_e(H1R->Height());
+      x_grads.SetSize(jsize * nzones);
+      v_grads.SetSize(jsize * nzones);
+      e_quads.SetSize(nqp * nzones);
+      H1R->Mult(x, vec_e);
+      qi_h1->Derivatives(vec_e, x_grads);
+      H1R->Mult(v, vec_e);
+      qi_h1->Derivatives(vec_e, v_grads);
+      qi_l2->Values(e, e_quads);
+   }
 
    zone_max_visc.SetSize(nzones);
    zone_max_visc = 0.0;
@@ -504,15 +463,11 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
 
          if (p_assembly)
          {
-            // Energy values at quadrature point.
-            L2FESpace.GetElementDofs(z_id, L2dofs);
-            e.GetSubVector(L2dofs, e_loc);
-            evaluator->GetL2Values(e_loc, e_vals);
-
-            // All reference->physical Jacobians at the quadrature points.
-            H1FESpace.GetElementVDofs(z_id, H1dofs);
-            x.GetSubVector(H1dofs, vector_vals);
-            evaluator->GetVectorGrad(vecvalMat, Jpr_b[z]);
+            // Energy values and reference->physical Jacobians at the
+            // quadrature points.
+            e_vals.MakeRef(e_quads, z_id * nqp, nqp);
+            const double *J = x_grads.GetData() + z_id * jsize;
+            std::copy(J, J + jsize, Jpr_b[z].Data());
          }
          else
          {
@@ -546,10 +501,9 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
 
          if (p_assembly)
          {
-            // All reference->physical Jacobians at the quadrature points.
-            H1FESpace.GetElementVDofs(z_id, H1dofs);
-            v.GetSubVector(H1dofs, vector_vals);
-            evaluator->GetVectorGrad(vecvalMat, grad_v_ref);
+            // Reference gradients of the velocity at the quadrature points.
+            const double *dv = v_grads.GetData() + z_id * jsize;
+            std::copy(dv, dv + jsize, grad_v_ref.Data());
          }
          for (int q = 0; q < nqp; q++)
          {
@@ -636,7 +590,7 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
             {
                for (int gd = 0; gd < dim; gd++)
                {
-                  quad_data.stressJinvT(vd)(z_id*nqp + q, gd) =
+                  quad_data.stressJinvT(q, gd + dim*vd, z_id) =
                      stressJiT(vd, gd);
                }
             }
@@ -661,73 +615,169 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
    timer.quad_tstep += nzones;
 }
 
+void LagrangianHydroOperator::ComputeZoneData(int z)
+{
+   const int nqp = integ_rule.GetNPoints();
+   Array<int> vdofs;
+   zone_fes.GetElementVDofs(z, vdofs);
+   Vector data(vdofs.Size());
+   double *rho0DetJ0w = data.GetData(), *Jac0inv = rho0DetJ0w + nqp,
+          *Me_inv_z = Jac0inv + nqp*dim*dim;
+
+   Vector rho_vals(nqp);
+   rho0.GetValues(z, integ_rule, rho_vals);
+   ElementTransformation *T = H1FESpace.GetElementTransformation(z);
+   for (int q = 0; q < nqp; q++)
+   {
+      const IntegrationPoint &ip = integ_rule.IntPoint(q);
+      T->SetIntPoint(&ip);
+
+      DenseMatrixInverse Jinv(T->Jacobian());
+      DenseMatrix Jac0inv_q(Jac0inv + q*dim*dim, dim, dim);
+      Jinv.GetInverseMatrix(Jac0inv_q);
+
+      const double rho0DetJ0 = T->Weight() * rho_vals(q);
+      rho0DetJ0w[q] = rho0DetJ0 * ip.weight;
+   }
+
+   // Standard local assembly and inversion for the energy mass matrix.
+   DenseMatrix Me(l2dofs_cnt), Me_inv_zm(Me_inv_z, l2dofs_cnt, l2dofs_cnt);
+   DenseMatrixInverse inv(&Me);
+   MassIntegrator mi(rho0_coeff, &integ_rule);
+   mi.AssembleElementMatrix(*L2FESpace.GetFE(z),
+                            *L2FESpace.GetElementTransformation(z), Me);
+   inv.Factor();
+   inv.GetInverseMatrix(Me_inv_zm);
+
+   // Scalar mass matrix of the zone, repeated for every component in Mv.
+   if (!p_assembly)
+   {
+      DenseMatrix Mv_z(Me_inv_z + l2dofs_cnt*l2dofs_cnt,
+                       h1dofs_cnt, h1dofs_cnt);
+      MassIntegrator mvi(rho0_coeff, &integ_rule);
+      mvi.AssembleElementMatrix(*H1FESpace.GetFE(z), *T, Mv_z);
+   }
+
+   zone_data.SetSubVector(vdofs, data);
+}
+
+void LagrangianHydroOperator::UnpackZoneData()
+{
+   const int nqp = integ_rule.GetNPoints(), dim2 = dim*dim,
+             me_size = l2dofs_cnt*l2dofs_cnt;
+   quad_data.Resize(dim, nzones, nqp);
+   Me_inv.SetSize(l2dofs_cnt, l2dofs_cnt, nzones);
+   Array<int> vdofs;
+   Vector data;
+   for (int z = 0; z < nzones; z++)
+   {
+      zone_fes.GetElementVDofs(z, vdofs);
+      zone_data.GetSubVector(vdofs, data);
+      const double *d = data.GetData();
+      for (int q = 0; q < nqp; q++)
+      {
+         quad_data.rho0DetJ0w(z*nqp + q) = d[q];
+         double *J = quad_data.Jac0inv(z*nqp + q).Data();
+         for (int k = 0; k < dim2; k++) { J[k] = d[nqp + q*dim2 + k]; }
+      }
+      d += nqp * (1 + dim2);
+      double *M = Me_inv(z).Data();
+      for (int k = 0; k < me_size; k++) { M[k] = d[k]; }
+   }
+}
+
+void LagrangianHydroOperator::AssembleVelocityMass()
+{
+   const int offset = integ_rule.GetNPoints() * (1 + dim*dim) +
+                      l2dofs_cnt*l2dofs_cnt;
+   Array<int> vdofs;
+   Vector data;
+   DenseMatrix elmat(dim*h1dofs_cnt);
+   elmat = 0.0;
+   Mv.Update();
+   for (int z = 0; z < nzones; z++)
+   {
+      zone_fes.GetElementVDofs(z, vdofs);
+      zone_data.GetSubVector(vdofs, data);
+      DenseMatrix Mv_z(data.GetData() + offset, h1dofs_cnt, h1dofs_cnt);
+      for (int d = 0; d < dim; d++)
+      {
+         elmat.CopyMN(Mv_z, d*h1dofs_cnt, d*h1dofs_cnt);
+      }
+      Mv.AssembleElementMatrix(z, elmat);
+   }
+}
+
 void LagrangianHydroOperator::AMRUpdate(const Vector &S, bool quick)
 {
    ParMesh *pmesh = H1FESpace.GetParMesh();
 
    width = height = S.Size();
+   const int old_nzones = nzones;
    nzones = pmesh->GetNE();
 
    x0_gf.Update();
    rho0.Update();
 
-   if (quick) { return; }
-
-   // go back to initial mesh configuration temporarily
-   int own_nodes = 0;
-   GridFunction *x_gf = &x0_gf;
-   pmesh->SwapNodes(x_gf, own_nodes);
-
-   // update mass matrix
-   // TODO: don't reassemble everything!
-   Mv.Update();
-   Mv.Assemble();
-
-   // update Me_inv
-   // TODO: do this better too
+   // Transfer the time-zero data of the zones. This is exact for the zones
+   // that didn't change, including the ones moved by rebalancing.
+   zone_fes.Update();
+   zone_data.Update();
+   zone_fes.UpdatesFinished();
+
+   // Find the zones that were refined or derefined. A new zone is unchanged
+   // when it is the only child of its parent in the refinement transforms,
+   // or the parent of a single old zone in the derefinement transforms.
+   Array<int> changed;
+   if (pmesh->GetLastOperation() == Mesh::REFINE)
    {
-      Me_inv.SetSize(l2dofs_cnt, l2dofs_cnt, nzones);
-
-      DenseMatrix Me(l2dofs_cnt);
-      DenseMatrixInverse inv(&Me);
-      MassIntegrator mi(rho0_coeff, &integ_rule);
+      const CoarseFineTransformations &tr = pmesh->GetRefinementTransforms();
+      Array<int> nchildren(old_nzones);
+      nchildren = 0;
+      for (int i = 0; i < nzones; i++) { nchildren[tr.embeddings[i].parent]++; }
       for (int i = 0; i < nzones; i++)
       {
-         mi.AssembleElementMatrix(*L2FESpace.GetFE(i),
-                                  *L2FESpace.GetElementTransformation(i), Me);
-         inv.Factor();
-         inv.GetInverseMatrix(Me_inv(i));
+         if (nchildren[tr.embeddings[i].parent] > 1) { changed.Append(i); }
       }
    }
-
-   // resize quadrature data and make sure 'stressJinvT' will be recomputed
-   quad_data.Resize(dim, nzones, integ_rule.GetNPoints());
-   quad_data_is_current = false;
-
-   // update 'rho0DetJ0' and 'Jac0inv' at all quadrature points
-   // TODO: remove code duplication
-   const int nqp = integ_rule.GetNPoints();
-   Vector rho_vals(nqp);
-   for (int i = 0; i < nzones; i++)
+   else if (pmesh->GetLastOperation() == Mesh::DEREFINE)
    {
-      rho0.GetValues(i, integ_rule, rho_vals);
-      ElementTransformation *T = H1FESpace.GetElementTransformation(i);
-      for (int q = 0; q < nqp; q++)
+      const CoarseFineTransformations &tr =
+         pmesh->pncmesh->GetDerefinementTransforms();
+      Array<int> nchildren(nzones);
+      nchildren = 0;
+      for (int i = 0; i < tr.embeddings.Size(); i++)
       {
-         const IntegrationPoint &ip = integ_rule.IntPoint(q);
-         T->SetIntPoint(&ip);
+         nchildren[tr.embeddings[i].parent]++;
+      }
+      for (int i = 0; i < nzones; i++)
+      {
+         if (nchildren[i] > 1) { changed.Append(i); }
+      }
+   }
 
-         DenseMatrixInverse Jinv(T->Jacobian());
-         Jinv.GetInverseMatrix(quad_data.Jac0inv(i*nqp + q));
+   // go back to initial mesh configuration temporarily
+   int own_nodes = 0;
+   GridFunction *x_gf = &x0_gf;
+   if (changed.Size())
+   {
+      pmesh->SwapNodes(x_gf, own_nodes);
+      for (int i = 0; i < changed.Size(); i++) { ComputeZoneData(changed[i]); }
 
-         const double rho0DetJ0 = T->Weight() * rho_vals(q);
-         quad_data.rho0DetJ0w(i*nqp + q) = rho0DetJ0 *
-                                           integ_rule.IntPoint(q).weight;
-      }
+      // swap back to deformed mesh configuration
+      pmesh->SwapNodes(x_gf, own_nodes);
    }
 
-   // swap back to deformed mesh configuration
-   pmesh->SwapNodes(x_gf, own_nodes);
+   if (quick) { return; }
+
+   // update 'rho0DetJ0', 'Jac0inv', 'Me_inv' and the velocity mass matrix,
+   // where only the changed zones were integrated, and make sure
+   // 'stressJinvT' will be recomputed
+   UnpackZoneData();
+   if (!p_assembly) { AssembleVelocityMass(); }
+   quad_data_is_current = false;
+   ForcePA.AMRUpdate();
+   VMassPA.AMRUpdate();
 }
 
 } // namespace hydrodynamics
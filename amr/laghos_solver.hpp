@@ -87,17 +87,29 @@ protected:
    Coefficient *material_pcf;
 
    ParGridFunction &rho0;
-   GridFunctionCoefficient rho0_coeff; // TODO: remove when Mv update improved
+   GridFunctionCoefficient rho0_coeff;
    ParGridFunction x0_gf; // copy of initial mesh position
 
    // Velocity mass matrix and local inverses of the energy mass matrices. These
    // are constant in time, due to the pointwise mass conservation property.
+   // With full assembly, Mv is summed from the scalar zone mass matrices kept
+   // in zone_data.
    mutable ParBilinearForm Mv;
    DenseTensor Me_inv;
 
    // Integration rule for all assemblies.
    const IntegrationRule &integ_rule;
 
+   // The time-zero data of every zone (rho0DetJ0w and Jac0inv at all
+   // quadrature points, Me_inv, and with full assembly the scalar H1 mass
+   // matrix of the zone), stored as the components of a piecewise
+   // constant vector function. This way the mesh update operators transfer it
+   // on refinement, derefinement and rebalancing, and only the zones that
+   // changed are recomputed in AMRUpdate.
+   L2_FECollection zone_fec;
+   ParFiniteElementSpace zone_fes;
+   ParGridFunction zone_data;
+
    // Data associated with each quadrature point in the mesh. These values are
    // recomputed at each time step.
    mutable QuadratureData quad_data;
@@ -111,13 +123,9 @@ protected:
    // Same as above, but done through partial assembly.
    ForcePAOperator ForcePA;
 
-   // Mass matrices done through partial assembly:
-   // velocity (coupled H1 assembly) and energy (local L2 assemblies).
+   // Velocity mass matrix done through partial assembly. The energy solve uses
+   // the local inverses Me_inv with both assembly levels.
    mutable MassPAOperator VMassPA;
-   mutable LocalMassPAOperator locEMassPA;
-
-   // Linear solver for energy.
-   CGSolver locCG;
 
    mutable Vector zone_max_visc, zone_vgrad;
 
@@ -136,6 +144,14 @@ protected:
 
    void UpdateQuadratureData(const Vector &S) const;
 
+   // Computes the time-zero data of zone z in zone_data. The mesh nodes must
+   // be the initial ones, x0_gf.
+   void ComputeZoneData(int z);
+   // Copies zone_data to quad_data and Me_inv.
+   void UnpackZoneData();
+   // Assembles Mv from the zone mass matrices in zone_data.
+   void AssembleVelocityMass();
+
 public:
    LagrangianHydroOperator(int size, ParFiniteElementSpace &h1_fes,
                            ParFiniteElementSpace &l2_fes,
@@ -156,7 +172,9 @@ public:
    // projected as a ParGridFunction.
    void ComputeDensity(ParGridFunction &rho);
 
-   // Update all internal data on mesh change.
+   // Update all internal data on mesh change. Must be called once after every
+   // refinement, derefinement or rebalancing. With quick, the operator is not
+   // ready for use until the next (non-quick) update.
    void AMRUpdate(const Vector &S, bool quick);
 
    void SetH0(double h0) { quad_data.h0 = h0; }
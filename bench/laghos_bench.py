@@ -0,0 +1,240 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+# the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+# reserved. See files LICENSE and NOTICE for details.
+#
+# This file is part of CEED, a collection of benchmarks, miniapps, software
+# libraries and APIs for efficient high-order finite element and spectral
+# element discretizations for exascale applications. For more information and
+# source code availability see http://github.com/ceed.
+#
+# The CEED research is supported by the Exascale Computing Project 17-SC-20-SC,
+# a collaborative effort of two U.S. Department of Energy organizations (Office
+# of Science and the National Nuclear Security Administration) responsible for
+# the planning and preparation of a capable exascale ecosystem, including
+# software, applications, hardware, advanced system engineering and early
+# testbed platforms, in support of the nation's exascale computing imperative.
+#
+# Laghos benchmark suite driver.
+#
+# Runs Laghos over a sweep of dimensions, serial/parallel refinements, orders,
+# MPI ranks and devices on the Cartesian meshes in data/, collects the FOM
+# table of each run (-f) together with its region timings (-tof), and prints
+# weak- and strong-scaling tables of FOM0..FOM3. When a baseline file is given
+# (or bench/baseline.json exists), the FOMs are also reported relative to the
+# baseline run with the same parameters.
+#
+# Sample usage (see also 'make bench'):
+#    python3 bench/laghos_bench.py --ranks 1 2 4 8 --rs 2 3 --orders 2:1 3:2
+#    python3 bench/laghos_bench.py --dims 3 --devices cpu cuda --ranks 1
+#    python3 bench/laghos_bench.py --save-baseline bench/baseline.json
+
+import argparse
+import itertools
+import json
+import os
+import shlex
+import subprocess
+import sys
+
+# Cartesian meshes and the -pt partitionings that split them uniformly, given
+# as (mesh, pt, m) for rank counts m * 2^(dim*k), see the table in laghos.cpp.
+MESHES = {
+    2: [('data/square01_quad.mesh', 11, 1),
+        ('data/square01_quad.mesh', 21, 2)],
+    3: [('data/cube01_hex.mesh', 111, 1),
+        ('data/cube01_hex.mesh', 211, 2),
+        ('data/cube01_hex.mesh', 221, 4),
+        ('data/cube_12_hex.mesh', 311, 3),
+        ('data/cube_12_hex.mesh', 321, 6),
+        ('data/cube_12_hex.mesh', 322, 12),
+        ('data/cube_522_hex.mesh', 511, 5),
+        ('data/cube_522_hex.mesh', 521, 10),
+        ('data/cube_522_hex.mesh', 522, 20),
+        ('data/cube_922_hex.mesh', 911, 9),
+        ('data/cube_922_hex.mesh', 921, 18),
+        ('data/cube_922_hex.mesh', 922, 36)],
+}
+
+FOM_COLUMNS = ['Ranks', 'Zones', 'H1 dofs', 'L2 dofs', 'QP', 'N dofs',
+               'FOM0', 'FOM1', 'T1', 'FOM2', 'T2', 'FOM3', 'T3', 'FOM', 'TT']
+FOMS = ['FOM0', 'FOM1', 'FOM2', 'FOM3', 'FOM']
+
+
+def partitioning(dim, ranks):
+    """Returns the mesh and -pt option for a uniform split over the ranks."""
+    for mesh, pt, m in MESHES[dim]:
+        if ranks % m:
+            continue
+        n = ranks // m
+        while n % (2 ** dim) == 0:
+            n //= 2 ** dim
+        if n == 1:
+            return mesh, pt
+    return None, None
+
+
+def parse_fom_table(output):
+    """Returns the values of the FOM table printed by Laghos with -f."""
+    lines = output.splitlines()
+    for i, line in enumerate(lines):
+        if line.startswith('| Ranks') and i + 1 < len(lines):
+            values = [v.strip() for v in lines[i + 1].split('|')[1:-1]]
+            if len(values) != len(FOM_COLUMNS):
+                return None
+            return {c: float(v) for c, v in zip(FOM_COLUMNS, values)}
+    return None
+
+
+def run_key(run):
+    return '-'.join(str(run[k]) for k in
+                    ('problem', 'dim', 'device', 'ok', 'ot', 'rs', 'rp',
+                     'ranks'))
+
+
+def run_case(args, run):
+    """Runs one case and returns its result record (None on failure)."""
+    name = run_key(run)
+    timing_file = os.path.join(args.out, name + '.json')
+    cmd = shlex.split(args.mpiexec) + shlex.split(args.np_flag)
+    cmd += [str(run['ranks']), args.laghos,
+            '-p', str(run['problem']), '-dim', str(run['dim']),
+            '-m', run['mesh'], '-pt', str(run['pt']),
+            '-rs', str(run['rs']), '-rp', str(run['rp']),
+            '-ok', str(run['ok']), '-ot', str(run['ot']),
+            '-d', run['device'], '-ms', str(args.max_steps),
+            '-tf', str(args.t_final), '-pa', '-f', '-tof', timing_file]
+    cmd += shlex.split(args.extra)
+    print('Running ' + ' '.join(cmd), flush=True)
+    if args.dry_run:
+        return None
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT, universal_newlines=True)
+    with open(os.path.join(args.out, name + '.out'), 'w') as f:
+        f.write(proc.stdout)
+    fom = parse_fom_table(proc.stdout)
+    if proc.returncode != 0 or fom is None:
+        print('   FAILED (exit code %d), see %s.out' %
+              (proc.returncode, os.path.join(args.out, name)))
+        return None
+    result = dict(run)
+    result['key'] = name
+    result['fom'] = fom
+    result['command'] = ' '.join(cmd)
+    if os.path.exists(timing_file):
+        with open(timing_file) as f:
+            result['regions'] = json.load(f)['regions']
+    return result
+
+
+def print_table(title, groups, baseline):
+    """Prints one scaling table per group of runs (sorted by ranks)."""
+    print('\n' + title)
+    for label, runs in sorted(groups.items()):
+        if len(runs) < 2:
+            continue
+        runs.sort(key=lambda r: r['ranks'])
+        print('\n' + label)
+        head = '%6s %10s %10s' % ('ranks', 'zones', 'dofs')
+        head += ''.join('%11s' % f for f in FOMS) + '%8s' % 'eff'
+        if baseline:
+            head += '%10s' % 'FOM/base'
+        print(head)
+        r0 = runs[0]
+        for r in runs:
+            fom = r['fom']
+            line = '%6d %10d %10d' % (r['ranks'], fom['Zones'], fom['N dofs'])
+            line += ''.join('%11.3f' % fom[f] for f in FOMS)
+            # FOM is a rate, so ideal weak scaling keeps FOM/ranks constant
+            # and ideal strong scaling multiplies FOM by the rank ratio.
+            eff = (fom['FOM'] / r['ranks']) / (r0['fom']['FOM'] / r0['ranks'])
+            line += '%8.2f' % eff
+            if baseline:
+                b = baseline.get(r['key'])
+                line += ('%10.2f' % (fom['FOM'] / b['fom']['FOM'])
+                         if b else '%10s' % '-')
+            print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Laghos benchmark suite.')
+    parser.add_argument('--laghos', default='./laghos')
+    parser.add_argument('--mpiexec', default='mpirun')
+    parser.add_argument('--np-flag', default='-np')
+    parser.add_argument('--problem', type=int, default=1)
+    parser.add_argument('--dims', type=int, nargs='+', default=[2, 3])
+    parser.add_argument('--ranks', type=int, nargs='+', default=[1, 2, 4, 8])
+    parser.add_argument('--rs', type=int, nargs='+', default=[2, 3])
+    parser.add_argument('--rp', type=int, nargs='+', default=[0])
+    parser.add_argument('--orders', nargs='+', default=['2:1', '3:2'],
+                        help='kinematic:thermodynamic order pairs')
+    parser.add_argument('--devices', nargs='+', default=['cpu'])
+    parser.add_argument('--max-steps', type=int, default=10)
+    parser.add_argument('--t-final', type=float, default=0.6)
+    parser.add_argument('--extra', default='',
+                        help='additional Laghos options for every run')
+    parser.add_argument('--out', default='results/bench')
+    parser.add_argument('--baseline', default='bench/baseline.json')
+    parser.add_argument('--save-baseline', default=None,
+                        help='store the results of this sweep as a baseline')
+    parser.add_argument('--dry-run', action='store_true')
+    args = parser.parse_args()
+    os.makedirs(args.out, exist_ok=True)
+
+    results = []
+    for dim, device, order, rs, rp, ranks in itertools.product(
+            args.dims, args.devices, args.orders, args.rs, args.rp,
+            args.ranks):
+        mesh, pt = partitioning(dim, ranks)
+        if mesh is None:
+            print('Skipping %d ranks in %dD: no Cartesian partitioning'
+                  % (ranks, dim))
+            continue
+        ok, ot = (int(o) for o in order.split(':'))
+        run = {'problem': args.problem, 'dim': dim, 'device': device,
+               'mesh': mesh, 'pt': pt, 'ok': ok, 'ot': ot,
+               'rs': rs, 'rp': rp, 'ranks': ranks}
+        result = run_case(args, run)
+        if result:
+            results.append(result)
+
+    summary = os.path.join(args.out, 'bench.json')
+    with open(summary, 'w') as f:
+        json.dump(results, f, indent=1)
+    with open(os.path.join(args.out, 'bench.csv'), 'w') as f:
+        f.write('key,' + ','.join(c.replace(' ', '_') for c in FOM_COLUMNS)
+                + '\n')
+        for r in results:
+            f.write(r['key'] + ',' +
+                    ','.join(str(r['fom'][c]) for c in FOM_COLUMNS) + '\n')
+    print('\nSaved %d runs in %s' % (len(results), summary))
+
+    baseline = None
+    if args.baseline and os.path.exists(args.baseline) and \
+       args.baseline != args.save_baseline:
+        with open(args.baseline) as f:
+            baseline = {r['key']: r for r in json.load(f)}
+        print('Comparing with the baseline in ' + args.baseline)
+
+    # Weak scaling: same zones per rank; strong scaling: same global zones.
+    weak, strong = {}, {}
+    for r in results:
+        label = '%dD, %s, Q%d-Q%d' % (r['dim'], r['device'], r['ok'], r['ot'])
+        zones = int(r['fom']['Zones'])
+        weak.setdefault('%s, %d zones/rank' % (label, zones // r['ranks']),
+                        []).append(r)
+        strong.setdefault('%s, %d zones' % (label, zones), []).append(r)
+    print_table('Weak scaling (eff = FOM/ranks relative to the first row):',
+                weak, baseline)
+    print_table('Strong scaling (eff = FOM/ranks relative to the first row):',
+                strong, baseline)
+
+    if args.save_baseline:
+        with open(args.save_baseline, 'w') as f:
+            json.dump(results, f, indent=1)
+        print('\nSaved the baseline in ' + args.save_baseline)
+    return 0 if results or args.dry_run else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
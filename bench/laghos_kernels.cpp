@@ -0,0 +1,336 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project 17-SC-20-SC,
+// a collaborative effort of two U.S. Department of Energy organizations (Office
+// of Science and the National Nuclear Security Administration) responsible for
+// the planning and preparation of a capable exascale ecosystem, including
+// software, applications, hardware, advanced system engineering and early
+// testbed platforms, in support of the nation's exascale computing imperative.
+//
+//                 Laghos kernel micro-benchmarks
+//
+// Times the partial assembly kernels of Laghos in isolation, without the CG
+// solves, the time stepping and the MPI communication of the miniapp:
+//    - ForcePAOperator::Mult          (ForceMult2D/3D),
+//    - ForcePAOperator::MultTranspose (ForceMultTranspose2D/3D),
+//    - QUpdate::UpdateQuadratureData  (QKernel<DIM,Q1D>, and the state
+//                                      interpolation to the points),
+//    - MassPAOperator::Mult           (velocity mass action).
+// The serial Cartesian mesh has -nx zones in each direction, and it is set up
+// for every dimension and kinematic order (-dims, -orders). The orders 2, 3
+// and 4 cover all registered dispatch keys of the tensor kernels; other orders
+// run the generic kernels. The quadrature data is synthetic: unit density,
+// 1.4 gamma, unit specific internal energy and a small random velocity.
+//
+// For each kernel, the time per call, and the achieved GFLOP/s and GB/s
+// according to the operation and memory traffic estimates below are reported.
+// When the peak rates of the machine are given (-pf, -pb), the fraction of the
+// roofline bound min(peak flops, arithmetic intensity * peak bandwidth) is
+// also reported.
+//
+// Sample runs:
+//    bench/laghos_kernels
+//    bench/laghos_kernels -dims 3 -nx 24 -orders 2 3 -it 50
+//    bench/laghos_kernels -d cuda -nx 32 -pf 7000 -pb 900
+//    bench/laghos_kernels -mp -d cuda
+
+#include "laghos_solver.hpp"
+#include <iomanip>
+
+using namespace std;
+using namespace mfem;
+using namespace mfem::hydrodynamics;
+
+namespace
+{
+
+void DeviceSync()
+{
+   if (Device::Allows(Backend::DEVICE_MASK)) { MFEM_DEVICE_SYNC; }
+}
+
+// Average time of one call of f, after a warm-up call.
+template <typename F>
+double TimeKernel(const int iters, F &&f)
+{
+   f();
+   DeviceSync();
+   StopWatch sw;
+   sw.Start();
+   for (int i = 0; i < iters; i++) { f(); }
+   DeviceSync();
+   sw.Stop();
+   return sw.RealTime() / iters;
+}
+
+// Operations of the sum factorized interpolation from n1 to n2 points in each
+// of the dim directions.
+double SumFactFlops(const int dim, const int n1, const int n2)
+{
+   double flops = 0.0;
+   for (int k = 1; k <= dim; k++)
+   {
+      flops += 2.0 * pow(n2, k) * pow(n1, dim - k + 1);
+   }
+   return flops;
+}
+
+struct KernelResult
+{
+   string name;
+   int key, NE;
+   double time, flops, bytes;
+};
+
+void PrintResults(const vector<KernelResult> &results,
+                  const double peak_flops, const double peak_bw)
+{
+   const bool roof = peak_flops > 0.0 && peak_bw > 0.0;
+   cout << endl << left << setw(22) << "kernel" << right
+        << setw(7) << "key" << setw(9) << "zones" << setw(13) << "time [ms]"
+        << setw(10) << "GFLOP/s" << setw(9) << "GB/s" << setw(8) << "AI";
+   if (roof) { cout << setw(8) << "roof%"; }
+   cout << endl;
+   for (const KernelResult &r : results)
+   {
+      const double gflops = 1e-9 * r.flops / r.time;
+      const double gbs = 1e-9 * r.bytes / r.time;
+      const double ai = r.flops / r.bytes;
+      cout << left << setw(22) << r.name << right << "  0x" << hex << left
+           << setw(3) << r.key << dec << right << setw(9) << r.NE
+           << fixed << setprecision(4) << setw(13) << 1e3 * r.time
+           << setprecision(2) << setw(10) << gflops << setw(9) << gbs
+           << setw(8) << ai;
+      if (roof)
+      {
+         const double bound = fmin(peak_flops, ai * peak_bw);
+         cout << setprecision(1) << setw(8) << 100.0 * gflops / bound;
+      }
+      cout << endl;
+   }
+}
+
+void BenchmarkKernels(const int dim, const int order_v, const int nx,
+                      const int iters, const bool mixed_precision,
+                      vector<KernelResult> &results)
+{
+   const int order_e = order_v - 1;
+   Mesh mesh = (dim == 2) ?
+               Mesh::MakeCartesian2D(nx, nx, Element::QUADRILATERAL, true) :
+               Mesh::MakeCartesian3D(nx, nx, nx, Element::HEXAHEDRON, true);
+   ParMesh pmesh(MPI_COMM_WORLD, mesh);
+   mesh.Clear();
+   const int NE = pmesh.GetNE();
+
+   L2_FECollection L2FEC(order_e, dim, BasisType::Positive);
+   H1_FECollection H1FEC(order_v, dim);
+   ParFiniteElementSpace L2(&pmesh, &L2FEC);
+   ParFiniteElementSpace H1(&pmesh, &H1FEC, dim);
+   ParFiniteElementSpace H1c(&pmesh, &H1FEC, 1);
+   L2_FECollection mat_fec(0, dim);
+   ParFiniteElementSpace mat_fes(&pmesh, &mat_fec);
+   ParGridFunction gamma_gf(&mat_fes);
+   gamma_gf = 1.4;
+
+   // Same quadrature rule and 1D size as LagrangianHydroOperator.
+   const IntegrationRule &ir =
+      IntRules.Get(pmesh.GetElementBaseGeometry(0), 3 * order_v + order_e - 1);
+   const int NQ = ir.GetNPoints();
+   const int Q1D = int(floor(0.7 + pow(NQ, 1.0 / dim)));
+   const int D1D = order_v + 1, L1D = order_e + 1;
+   const int DIM2 = dim * dim;
+   const int ND = H1c.GetFE(0)->GetDof(), NL = L2.GetFE(0)->GetDof();
+   const int force_key = (dim << 8) | (D1D << 4) | Q1D;
+   const int qkernel_key = (dim << 4) | Q1D;
+
+   // State vector (position, velocity, specific internal energy).
+   Array<int> offset(4);
+   offset[0] = 0;
+   offset[1] = offset[0] + H1.GetVSize();
+   offset[2] = offset[1] + H1.GetVSize();
+   offset[3] = offset[2] + L2.GetVSize();
+   BlockVector S(offset, Device::GetMemoryType());
+   ParGridFunction x_gf, v_gf, e_gf;
+   x_gf.MakeRef(&H1, S, offset[0]);
+   v_gf.MakeRef(&H1, S, offset[1]);
+   e_gf.MakeRef(&L2, S, offset[2]);
+   pmesh.SetNodalGridFunction(&x_gf);
+   x_gf.SyncAliasMemory(S);
+   v_gf.Randomize(1);
+   v_gf *= 0.01;
+   v_gf.SyncAliasMemory(S);
+   e_gf = 1.0;
+   e_gf.SyncAliasMemory(S);
+
+   // Quadrature data of the initial (affine, uniform) mesh: J0 = I / nx.
+   QuadratureData qdata(dim, NE, NQ, dim > 1 && mixed_precision);
+   {
+      double *J0inv = HostWrite(qdata.Jac0inv.GetMemory(),
+                                qdata.Jac0inv.TotalSize());
+      const double *W = ir.GetWeights().HostRead();
+      double *rho0DetJ0w = qdata.rho0DetJ0w.HostWrite();
+      const double detJ0 = pow(1.0 / nx, dim);
+      for (int e = 0; e < NE; e++)
+      {
+         for (int q = 0; q < NQ; q++)
+         {
+            for (int i = 0; i < dim; i++)
+            {
+               for (int j = 0; j < dim; j++)
+               {
+                  J0inv[q + NQ*(i + dim*j + DIM2*e)] = (i == j) ? nx : 0.0;
+               }
+            }
+            rho0DetJ0w[e*NQ + q] = detJ0 * W[q];
+         }
+      }
+   }
+   qdata.h0 = 1.0 / nx / order_v;
+   qdata.dt_est = numeric_limits<double>::infinity();
+   const size_t stress_size = mixed_precision ? sizeof(float) : sizeof(double);
+
+   // QKernel. The regions of QUpdate separate the interpolation of the state
+   // to the points from the kernel itself.
+   TimingData timer(L2.GetTrueVSize());
+   // With the tabulated EOS, the ideal gas law of gamma_gf is tabulated.
+   EOSTable eos_table;
+   eos_table.SetIdealGas(1.4, 64, 64, 2.0, 2.0);
+   QUpdate qupdate(dim, NE, Q1D, true, false, 0.5, &timer, gamma_gf, ir,
+                   H1, L2, GetMaterialEOS(&eos_table, true));
+   qupdate.UpdateQuadratureData(S, qdata);
+   DeviceSync();
+   timer.regions.Enable(true);
+   for (int i = 0; i < iters; i++) { qupdate.UpdateQuadratureData(S, qdata); }
+   timer.regions.Enable(false);
+   {
+      // Nominal operation count per point, dominated by the eigenvalues and
+      // singular values of the 2x2 or 3x3 matrices.
+      const double flops_q = (dim == 2) ? 250.0 : 800.0;
+      const double bytes_q = 8.0 * (2 * DIM2 + 2) +
+                             8.0 * qdata.Jac0inv.SizeI() * DIM2 / NQ +
+                             stress_size * DIM2;
+      results.push_back({"QKernel", qkernel_key, NE,
+                         timer.regions.RealTime("QKernel") / iters,
+                         flops_q * NQ * NE, bytes_q * NQ * NE});
+      // Values of e and gradients of x and v, from the L-vectors.
+      const double flops_i = 2 * dim * dim * SumFactFlops(dim, D1D, Q1D) +
+                             SumFactFlops(dim, L1D, Q1D);
+      const double bytes_i = 8.0 * (2 * dim * ND + NL) * 2 +
+                             8.0 * (2 * DIM2 + 1) * NQ;
+      results.push_back({"QInterpolateState", qkernel_key, NE,
+                         timer.regions.RealTime("InterpolateState") / iters,
+                         flops_i * NE, bytes_i * NE});
+   }
+
+   // Force actions, including the element restrictions.
+   ForcePAOperator force(qdata, H1, L2, ir);
+   Vector one(L2.GetVSize()), rhs(H1.GetVSize()), e_rhs(L2.GetVSize());
+   one.UseDevice(true);
+   rhs.UseDevice(true);
+   e_rhs.UseDevice(true);
+   one = 1.0;
+   {
+      const double flops = SumFactFlops(dim, L1D, Q1D) + 2.0 * DIM2 * NQ +
+                           dim * dim * SumFactFlops(dim, Q1D, D1D);
+      const double bytes = stress_size * DIM2 * NQ +
+                           8.0 * (2 * NL + 2 * dim * ND) +
+                           8.0 * (NL + dim * ND);
+      const double time = TimeKernel(iters, [&]() { force.Mult(one, rhs); });
+      results.push_back({dim == 2 ? "ForceMult2D" : "ForceMult3D",
+                         force_key, NE, time, flops * NE, bytes * NE});
+      const double time_t =
+         TimeKernel(iters, [&]() { force.MultTranspose(v_gf, e_rhs); });
+      results.push_back({dim == 2 ? "ForceMultTranspose2D" :
+                         "ForceMultTranspose3D",
+                         force_key, NE, time_t, flops * NE, bytes * NE});
+   }
+
+   // Velocity mass action on the true dofs of one component.
+   ConstantCoefficient rho_coeff(1.0);
+   MassPAOperator mass(H1c, ir, rho_coeff);
+   Vector X(H1c.GetTrueVSize()), Y(H1c.GetTrueVSize());
+   X.UseDevice(true);
+   Y.UseDevice(true);
+   X.Randomize(2);
+   {
+      const double flops = 2.0 * SumFactFlops(dim, D1D, Q1D) + NQ;
+      const double bytes = 8.0 * (4 * ND + NQ);
+      const double time = TimeKernel(iters, [&]() { mass.Mult(X, Y); });
+      results.push_back({"MassPAOperator::Mult", force_key, NE, time,
+                         flops * NE, bytes * NE});
+   }
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+   MPI_Session mpi(argc, argv);
+   Array<int> dims, orders;
+   int nx = 0;
+   int iters = 20;
+   const char *device = "cpu";
+   int dev = 0;
+   bool mixed_precision = false;
+   double peak_flops = 0.0, peak_bw = 0.0;
+
+   OptionsParser args(argc, argv);
+   args.AddOption(&dims, "-dims", "--dimensions",
+                  "Dimensions to benchmark (default: 2 3).");
+   args.AddOption(&orders, "-orders", "--orders-kinematic",
+                  "Kinematic orders to benchmark (default: 2 3 4).");
+   args.AddOption(&nx, "-nx", "--zones-per-direction",
+                  "Zones in each direction (default: 64 in 2D, 16 in 3D).");
+   args.AddOption(&iters, "-it", "--iterations",
+                  "Number of timed calls of each kernel.");
+   args.AddOption(&device, "-d", "--device",
+                  "Device configuration string, see Device::Configure().");
+   args.AddOption(&dev, "-dev", "--dev", "GPU device to use.");
+   args.AddOption(&mixed_precision, "-mp", "--mixed-precision", "-no-mp",
+                  "--no-mixed-precision",
+                  "Store the stress in single precision.");
+   args.AddOption(&peak_flops, "-pf", "--peak-flops",
+                  "Peak GFLOP/s of the device, for the roofline bound.");
+   args.AddOption(&peak_bw, "-pb", "--peak-bandwidth",
+                  "Peak memory bandwidth (GB/s) of the device.");
+   args.Parse();
+   if (!args.Good())
+   {
+      if (mpi.Root()) { args.PrintUsage(cout); }
+      return 1;
+   }
+   if (mpi.Root()) { args.PrintOptions(cout); }
+   MFEM_VERIFY(mpi.WorldSize() == 1, "The kernel benchmarks run on one task.");
+   if (dims.Size() == 0) { dims.SetSize(2); dims[0] = 2; dims[1] = 3; }
+   if (orders.Size() == 0)
+   {
+      orders.SetSize(3);
+      orders[0] = 2; orders[1] = 3; orders[2] = 4;
+   }
+
+   Device backend;
+   backend.Configure(device, dev);
+   backend.Print();
+
+   vector<KernelResult> results;
+   for (int d = 0; d < dims.Size(); d++)
+   {
+      MFEM_VERIFY(dims[d] == 2 || dims[d] == 3, "Unsupported dimension!");
+      const int n = (nx > 0) ? nx : ((dims[d] == 2) ? 64 : 16);
+      for (int o = 0; o < orders.Size(); o++)
+      {
+         MFEM_VERIFY(orders[o] >= 1, "The kinematic order must be positive.");
+         BenchmarkKernels(dims[d], orders[o], n, iters, mixed_precision,
+                          results);
+      }
+   }
+   PrintResults(results, peak_flops, peak_bw);
+   return 0;
+}
@@ -63,6 +63,10 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include "laghos_solver.hpp"
+#include "laghos_io.hpp"
+#ifdef MFEM_USE_OPENMP
+#include <omp.h>
+#endif
 
 using std::cout;
 using std::endl;
@@ -76,10 +80,17 @@ double e0(const Vector &);
 double rho0(const Vector &);
 double gamma_func(const Vector &);
 void v0(const Vector &, Vector &);
+// Initial conditions projected on the device, see ProjectInitialL2.
+enum class InitialField { DENSITY, ENERGY, GAMMA };
+static void ProjectInitialL2(const ParGridFunction &x_gf, const InitialField f,
+                             ParGridFunction &gf);
+static void ProjectInitialVelocity(const ParGridFunction &x_gf,
+                                   ParGridFunction &v_gf);
 
 static long GetMaxRssMB();
 static void display_banner(std::ostream&);
-static void Checks(const int dim, const int ti, const double norm, int &checks);
+static void Checks(const int dim, const int ti, const double norm, int &checks,
+                   const double eps);
 
 int main(int argc, char *argv[])
 {
@@ -106,21 +117,37 @@ int main(int argc, char *argv[])
    double cg_tol = 1e-8;
    double ftz_tol = 0.0;
    int cg_max_iter = 300;
+   int cg_solver = 0;
+   bool cg_warm_start = false;
    int max_tsteps = -1;
    bool p_assembly = true;
+   bool block_cg = false;
+   bool fused_force = false;
+   int fa_batch = 16;
+   bool e_local_inv = false;
+   bool force_overlap = false;
+   bool persistent_halo = false;
+   bool mixed_precision = false;
    bool impose_visc = false;
    bool visualization = false;
    int vis_steps = 5;
    bool visit = false;
    bool gfprint = false;
+   bool parallel_io = false;
    const char *basename = "results/Laghos";
+   int checkpoint_steps = 0;
+   const char *restart_file = "";
    int partition_type = 0;
+   bool sfc_ordering = false;
    const char *device = "cpu";
    bool check = false;
    bool mem_usage = false;
    bool fom = false;
+   bool region_timing = false;
+   const char *timing_file = "";
    bool gpu_aware_mpi = false;
    int dev = 0;
+   const char *eos_file = "";
    double blast_energy = 0.25;
    double blast_position[] = {0.0, 0.0, 0.0};
 
@@ -153,11 +180,35 @@ int main(int argc, char *argv[])
                   "Absolute flush-to-zero tolerance.");
    args.AddOption(&cg_max_iter, "-cgm", "--cg-max-steps",
                   "Maximum number of CG iterations (velocity linear solve).");
+   args.AddOption(&cg_solver, "-cgs", "--cg-solver",
+                  "Velocity CG solver: 0 - standard, 1 - pipelined.");
+   args.AddOption(&cg_warm_start, "-cgw", "--cg-warm-start", "-no-cgw",
+                  "--no-cg-warm-start",
+                  "Use the previous velocity solution as CG initial guess.");
    args.AddOption(&max_tsteps, "-ms", "--max-steps",
                   "Maximum number of steps (negative means no restriction).");
    args.AddOption(&p_assembly, "-pa", "--partial-assembly", "-fa",
                   "--full-assembly",
                   "Activate 1D tensor-based assembly (partial assembly).");
+   args.AddOption(&block_cg, "-bcg", "--block-cg", "-no-bcg", "--no-block-cg",
+                  "Solve all velocity components in a single CG loop (PA only).");
+   args.AddOption(&fused_force, "-ff", "--fused-force", "-no-ff",
+                  "--no-fused-force",
+                  "Fuse the quadrature update with the force actions (PA only).");
+   args.AddOption(&e_local_inv, "-eli", "--energy-local-inverse", "-no-eli",
+                  "--no-energy-local-inverse",
+                  "Use local inverses instead of CG for the energy mass (PA).");
+   args.AddOption(&force_overlap, "-fo", "--force-overlap", "-no-fo",
+                  "--no-force-overlap",
+                  "Overlap the force RHS exchange with interior zones (PA).");
+   args.AddOption(&persistent_halo, "-ph", "--persistent-halo", "-no-ph",
+                  "--no-persistent-halo",
+                  "Persistent MPI requests for the velocity exchanges (PA).");
+   args.AddOption(&mixed_precision, "-mp", "--mixed-precision", "-no-mp",
+                  "--no-mixed-precision",
+                  "Store the force quadrature data in single precision (PA).");
+   args.AddOption(&fa_batch, "-fab", "--fa-batch",
+                  "Number of zones per batch of the 1D/FA quadrature update.");
    args.AddOption(&impose_visc, "-iv", "--impose-viscosity", "-niv",
                   "--no-impose-viscosity",
                   "Use active viscosity terms even for smooth problems.");
@@ -170,8 +221,21 @@ int main(int argc, char *argv[])
                   "Enable or disable VisIt visualization.");
    args.AddOption(&gfprint, "-print", "--print", "-no-print", "--no-print",
                   "Enable or disable result output (files in mfem format).");
+   args.AddOption(&parallel_io, "-pio", "--parallel-io", "-no-pio",
+                  "--no-parallel-io",
+                  "With -print, write the results in parallel, in binary format\n\t"
+                  "through nonblocking MPI-IO, instead of gathering them on one task.");
    args.AddOption(&basename, "-k", "--outputfilename",
                   "Name of the visit dump files");
+   args.AddOption(&checkpoint_steps, "-cs", "--checkpoint-steps",
+                  "Write a checkpoint <basename>_<step>.lghc every n-th timestep\n\t"
+                  "(0 for none).");
+   args.AddOption(&restart_file, "-rf", "--restart-file",
+                  "Restart from the given checkpoint, with the same options and\n\t"
+                  "number of tasks as the run that wrote it.");
+   args.AddOption(&eos_file, "-eos", "--eos-table",
+                  "Table file of the tabulated EOS, see EOSTable::Load(). Requires\n\t"
+                  "Laghos built with LAGHOS_EOS=tabulated.");
    args.AddOption(&partition_type, "-pt", "--partition",
                   "Customized x/y/z Cartesian MPI partitioning of the serial mesh.\n\t"
                   "Here x,y,z are relative task ratios in each direction.\n\t"
@@ -181,6 +245,11 @@ int main(int argc, char *argv[])
                   "of zones in each direction, e.g., the number of zones in direction x\n\t"
                   "must be divisible by the number of MPI tasks in direction x.\n\t"
                   "Available options: 11, 21, 111, 211, 221, 311, 321, 322, 432.");
+   args.AddOption(&sfc_ordering, "-sfc", "--sfc-ordering", "-no-sfc",
+                  "--no-sfc-ordering",
+                  "Reorder the zones of the serial mesh along a Hilbert curve, and\n\t"
+                  "split the curve in equal chunks when Cartesian partitioning\n\t"
+                  "can't be used (instead of METIS).");
    args.AddOption(&device, "-d", "--device",
                   "Device configuration string, see Device::Configure().");
    args.AddOption(&check, "-chk", "--checks", "-no-chk", "--no-checks",
@@ -189,6 +258,12 @@ int main(int argc, char *argv[])
                   "Enable memory usage.");
    args.AddOption(&fom, "-f", "--fom", "-no-fom", "--no-fom",
                   "Enable figure of merit output.");
+   args.AddOption(&region_timing, "-rt", "--region-timing", "-no-rt",
+                  "--no-region-timing",
+                  "Enable the hierarchical timing of the code regions.");
+   args.AddOption(&timing_file, "-tof", "--timing-output-file",
+                  "Save the region timings in this file (JSON if it ends with "
+                  ".json, CSV otherwise). Enables the region timing.");
    args.AddOption(&gpu_aware_mpi, "-gam", "--gpu-aware-mpi", "-no-gam",
                   "--no-gpu-aware-mpi", "Enable GPU aware MPI communications.");
    args.AddOption(&dev, "-dev", "--dev", "GPU device to use.");
@@ -204,6 +279,12 @@ int main(int argc, char *argv[])
    Device backend;
    backend.Configure(device, dev);
    if (mpi.Root()) { backend.Print(); }
+#ifdef MFEM_USE_OPENMP
+   if (mpi.Root() && Device::Allows(Backend::OMP_MASK))
+   {
+      cout << "OpenMP threads per task: " << omp_get_max_threads() << endl;
+   }
+#endif
    backend.SetGPUAwareMPI(gpu_aware_mpi);
 
    // On all processors, use the default builtin 1D/2D/3D mesh or read the
@@ -266,6 +347,17 @@ int main(int argc, char *argv[])
       cout << "Number of zones in the serial mesh: " << mesh_NE << endl;
    }
 
+   // Reorder the zones, and with them the vertices and the H1/L2 dofs, along a
+   // space-filling curve. The ParMesh keeps the global order of the zones in
+   // each task, so neighboring zones share dofs that are close in memory, and
+   // the element restriction gathers and scatters are cache-friendly.
+   if (sfc_ordering)
+   {
+      Array<int> ordering;
+      mesh->GetHilbertElementOrdering(ordering);
+      mesh->ReorderElements(ordering);
+   }
+
    // Parallel partitioning of the mesh.
    ParMesh *pmesh = nullptr;
    const int num_tasks = mpi.WorldSize(); int unit = 1;
@@ -378,6 +470,21 @@ int main(int argc, char *argv[])
       pmesh = new ParMesh(MPI_COMM_WORLD, *mesh, partitioning);
       delete [] partitioning;
    }
+   else if (sfc_ordering)
+   {
+      // All zones have the same order, i.e., the same cost, so the curve is
+      // split in chunks with the same number of zones.
+      if (myid == 0)
+      {
+         cout << "Non-Cartesian partitioning along the Hilbert curve.\n";
+      }
+      Array<int> partitioning(mesh_NE);
+      for (int i = 0; i < mesh_NE; i++)
+      {
+         partitioning[i] = static_cast<int>((long long) i * num_tasks / mesh_NE);
+      }
+      pmesh = new ParMesh(MPI_COMM_WORLD, *mesh, partitioning.GetData());
+   }
    else
    {
       if (myid == 0)
@@ -438,7 +545,7 @@ int main(int argc, char *argv[])
       case 1: ode_solver = new ForwardEulerSolver; break;
       case 2: ode_solver = new RK2Solver(0.5); break;
       case 3: ode_solver = new RK3SSPSolver; break;
-      case 4: ode_solver = new RK4Solver; break;
+      case 4: ode_solver = new HydroRK4Solver; break;
       case 6: ode_solver = new RK6Solver; break;
       case 7: ode_solver = new RK2AvgSolver; break;
       default:
@@ -488,12 +595,20 @@ int main(int argc, char *argv[])
    // Sync the data location of x_gf with its base, S
    x_gf.SyncAliasMemory(S);
 
-   // Initialize the velocity.
+   // On restart, v_gf, e_gf and the time-zero quadrature data are read from
+   // the checkpoint, after the setup of the hydro operator on the initial
+   // mesh, so the initial projections are skipped.
+   const bool restart = restart_file[0] != '\0';
+
+   // Initialize the velocity, on the device.
    VectorFunctionCoefficient v_coeff(pmesh->Dimension(), v0);
-   v_gf.ProjectCoefficient(v_coeff);
-   for (int i = 0; i < ess_vdofs.Size(); i++)
+   if (!restart)
    {
-      v_gf(ess_vdofs[i]) = 0.0;
+      ProjectInitialVelocity(x_gf, v_gf);
+      const int n_ess = ess_vdofs.Size();
+      const auto d_ess = ess_vdofs.Read();
+      auto d_v = v_gf.ReadWrite();
+      MFEM_FORALL(i, n_ess, d_v[d_ess[i]] = 0.0;);
    }
    // Sync the data location of v_gf with its base, S
    v_gf.SyncAliasMemory(S);
@@ -506,24 +621,23 @@ int main(int argc, char *argv[])
    // time evolution.
    ParGridFunction rho0_gf(&L2FESpace);
    FunctionCoefficient rho0_coeff(rho0);
-   L2_FECollection l2_fec(order_e, pmesh->Dimension());
-   ParFiniteElementSpace l2_fes(pmesh, &l2_fec);
-   ParGridFunction l2_rho0_gf(&l2_fes), l2_e(&l2_fes);
-   l2_rho0_gf.ProjectCoefficient(rho0_coeff);
-   rho0_gf.ProjectGridFunction(l2_rho0_gf);
-   if (problem == 1)
+   if (!restart)
    {
-      // For the Sedov test, we use a delta function at the origin.
-      DeltaCoefficient e_coeff(blast_position[0], blast_position[1],
-                               blast_position[2], blast_energy);
-      l2_e.ProjectCoefficient(e_coeff);
-   }
-   else
-   {
-      FunctionCoefficient e_coeff(e0);
-      l2_e.ProjectCoefficient(e_coeff);
+      L2_FECollection l2_fec(order_e, pmesh->Dimension());
+      ParFiniteElementSpace l2_fes(pmesh, &l2_fec);
+      ParGridFunction l2_rho0_gf(&l2_fes), l2_e(&l2_fes);
+      ProjectInitialL2(x_gf, InitialField::DENSITY, l2_rho0_gf);
+      rho0_gf.ProjectGridFunction(l2_rho0_gf);
+      if (problem == 1)
+      {
+         // For the Sedov test, we use a delta function at the origin.
+         DeltaCoefficient e_coeff(blast_position[0], blast_position[1],
+                                  blast_position[2], blast_energy);
+         l2_e.ProjectCoefficient(e_coeff);
+      }
+      else { ProjectInitialL2(x_gf, InitialField::ENERGY, l2_e); }
+      e_gf.ProjectGridFunction(l2_e);
    }
-   e_gf.ProjectGridFunction(l2_e);
    // Sync the data location of e_gf with its base, S
    e_gf.SyncAliasMemory(S);
 
@@ -532,8 +646,7 @@ int main(int argc, char *argv[])
    L2_FECollection mat_fec(0, pmesh->Dimension());
    ParFiniteElementSpace mat_fes(pmesh, &mat_fec);
    ParGridFunction mat_gf(&mat_fes);
-   FunctionCoefficient mat_coeff(gamma_func);
-   mat_gf.ProjectCoefficient(mat_coeff);
+   ProjectInitialL2(x_gf, InitialField::GAMMA, mat_gf);
 
    // Additional details, depending on the problem.
    int source = 0; bool visc = true, vorticity = false;
@@ -551,21 +664,74 @@ int main(int argc, char *argv[])
    }
    if (impose_visc) { visc = true; }
 
+   // Table data of the tabulated EOS; the ideal gas EOS uses gamma only.
+   hydrodynamics::EOSTable eos_table;
+#ifdef LAGHOS_TABULATED_EOS
+   MFEM_VERIFY(eos_file[0] != '\0', "The tabulated EOS requires -eos.");
+   eos_table.Load(eos_file);
+#else
+   MFEM_VERIFY(eos_file[0] == '\0', "Laghos was built with the ideal gas "
+               "EOS, see LAGHOS_EOS in the makefile.");
+#endif
+
    hydrodynamics::LagrangianHydroOperator hydro(S.Size(),
                                                 H1FESpace, L2FESpace, ess_tdofs,
                                                 rho0_coeff, rho0_gf,
                                                 mat_gf, source, cfl,
                                                 visc, vorticity, p_assembly,
                                                 cg_tol, cg_max_iter, ftz_tol,
-                                                order_q);
+                                                order_q, block_cg, fused_force,
+                                                e_local_inv, force_overlap,
+                                                persistent_halo, cg_solver,
+                                                cg_warm_start,
+                                                mixed_precision, restart,
+                                                &eos_table);
+   hydro.SetQuadratureBatchSize(fa_batch);
+   hydrodynamics::RegionTimer &regions = hydro.GetRegionTimer();
+   regions.Enable(region_timing || timing_file[0] != '\0');
+
+   // Time stepping data at the start of the run.
+   int ti_start = 0, steps_start = 0;
+   double t_start = 0.0, dt_start = 0.0, energy_start = 0.0;
+   if (restart)
+   {
+      hydrodynamics::ReadCheckpoint(pmesh->GetComm(), restart_file, *pmesh,
+                                    ti_start, steps_start, t_start, dt_start,
+                                    energy_start, S,
+                                    hydro.GetQuadratureData());
+      x_gf.SyncAliasMemory(S);
+      v_gf.SyncAliasMemory(S);
+      e_gf.SyncAliasMemory(S);
+      pmesh->NewNodes(x_gf, false);
+      hydro.TimeZeroDataRestored();
+      if (mpi.Root())
+      {
+         cout << "Restarting from " << restart_file << " at step "
+              << ti_start << ", t = " << t_start << endl;
+      }
+   }
+
+   // The local energy mass inverses (with -fa or -eli), which are computed by
+   // Gauss-Jordan elimination without pivoting, must match DenseMatrixInverse.
+   if (check)
+   {
+      const double me_inv_err = hydro.EnergyMassInverseError();
+      MFEM_VERIFY(me_inv_err < 1e-10, "check: energy mass inverses, error = "
+                  << me_inv_err);
+   }
 
    socketstream vis_rho, vis_v, vis_e;
    char vishost[] = "localhost";
    int  visport   = 19916;
 
+   // The density is projected only for the outputs that use it: GLVis (except
+   // for problems 0 and 4), VisIt and -print, the latter not at time zero.
+   const bool vis_density = visualization && problem != 0 && problem != 4;
    ParGridFunction rho_gf;
-   if (visualization || visit) { hydro.ComputeDensity(rho_gf); }
-   const double energy_init = hydro.InternalEnergy(e_gf) +
+   if (vis_density || visit) { hydro.ComputeDensity(rho_gf); }
+   // The energy conservation is measured from the start of the original run.
+   const double energy_init = restart ? energy_start :
+                              hydro.InternalEnergy(e_gf) +
                               hydro.KineticEnergy(v_gf);
 
    if (visualization)
@@ -579,7 +745,7 @@ int main(int argc, char *argv[])
       int Wx = 0, Wy = 0; // window position
       const int Ww = 350, Wh = 350; // window size
       int offx = Ww+10; // window offsets
-      if (problem != 0 && problem != 4)
+      if (vis_density)
       {
          hydrodynamics::VisualizeField(vis_rho, vishost, visport, rho_gf,
                                        "Density", Wx, Wy, Ww, Wh);
@@ -599,20 +765,29 @@ int main(int argc, char *argv[])
       visit_dc.RegisterField("Density",  &rho_gf);
       visit_dc.RegisterField("Velocity", &v_gf);
       visit_dc.RegisterField("Specific Internal Energy", &e_gf);
-      visit_dc.SetCycle(0);
-      visit_dc.SetTime(0.0);
+      visit_dc.SetCycle(ti_start);
+      visit_dc.SetTime(t_start);
       visit_dc.Save();
    }
 
+   // Parallel binary output, used by -print with -pio.
+   hydrodynamics::ParallelBinaryOutput pio(pmesh->GetComm(), basename);
+   // Checkpoints, used by -cs.
+   hydrodynamics::CheckpointWriter checkpoint(pmesh->GetComm(), basename);
+
    // Perform time-integration (looping over the time iterations, ti, with a
    // time-step dt). The object oper is of type LagrangianHydroOperator that
    // defines the Mult() method that used by the time integrators.
    ode_solver->Init(hydro);
    hydro.ResetTimeStepEstimate();
-   double t = 0.0, dt = hydro.GetTimeStepEstimate(S), t_old;
+   double t = t_start, t_old;
+   double dt = restart ? dt_start : hydro.GetTimeStepEstimate(S);
    bool last_step = false;
-   int steps = 0;
-   BlockVector S_old(S);
+   int steps = steps_start;
+   // The hydro ODE solvers keep the start of the step for a rollback.
+   HydroODESolver *hydro_ode = dynamic_cast<HydroODESolver *>(ode_solver);
+   BlockVector S_old;
+   if (!hydro_ode) { S_old.Update(offset, Device::GetMemoryType()); }
    long mem=0, mmax=0, msum=0;
    int checks = 0;
    //   const double internal_energy = hydro.InternalEnergy(e_gf);
@@ -636,7 +811,7 @@ int main(int argc, char *argv[])
    //      }
    //      cout << endl;
    //   }
-   for (int ti = 1; !last_step; ti++)
+   for (int ti = ti_start + 1; !last_step; ti++)
    {
       if (t + dt >= t_final)
       {
@@ -644,17 +819,27 @@ int main(int argc, char *argv[])
          last_step = true;
       }
       if (steps == max_tsteps) { last_step = true; }
-      S_old = S;
+      if (!hydro_ode) { S_old = S; }
       t_old = t;
       hydro.ResetTimeStepEstimate();
 
       // S is the vector of dofs, t is the current time, and dt is the time step
       // to advance.
+      regions.Start("step");
       ode_solver->Step(S, t, dt);
+      regions.Stop();
       steps++;
-
-      // Adaptive time step control.
-      const double dt_est = hydro.GetTimeStepEstimate(S);
+      // Lets MPI advance the writes of the last binary output and
+      // checkpoint, if any.
+      pio.Progress();
+      checkpoint.Progress();
+
+      // Adaptive time step control. A step that was rejected after one of its
+      // stages is repeated directly.
+      const bool rejected = hydro_ode && hydro_ode->StepRejected();
+      regions.Start("GetTimeStepEstimate");
+      const double dt_est = rejected ? 0.0 : hydro.GetTimeStepEstimate(S);
+      regions.Stop();
       if (dt_est < dt)
       {
          // Repeat (solve again) with a decreased time step - decrease of the
@@ -662,9 +847,13 @@ int main(int argc, char *argv[])
          dt *= 0.85;
          if (dt < std::numeric_limits<double>::epsilon())
          { MFEM_ABORT("The time step crashed!"); }
-         t = t_old;
-         S = S_old;
-         hydro.ResetQuadratureData();
+         if (hydro_ode) { hydro_ode->Rollback(S, t); }
+         else
+         {
+            t = t_old;
+            S = S_old;
+            hydro.ResetQuadratureData();
+         }
          if (mpi.Root()) { cout << "Repeating step " << ti << endl; }
          if (steps < max_tsteps) { last_step = false; }
          ti--; continue;
@@ -681,7 +870,15 @@ int main(int argc, char *argv[])
       // Make sure that the mesh corresponds to the new solution state. This is
       // needed, because some time integrators use different S-type vectors
       // and the oper object might have redirected the mesh positions to those.
+      regions.Start("NewNodes");
       pmesh->NewNodes(x_gf, false);
+      regions.Stop();
+
+      if (checkpoint_steps > 0 && (ti % checkpoint_steps) == 0)
+      {
+         checkpoint.Write(ti, steps, t, dt, energy_init, S,
+                          hydro.GetQuadratureData(), *pmesh);
+      }
 
       if (last_step || (ti % vis_steps) == 0)
       {
@@ -721,15 +918,15 @@ int main(int argc, char *argv[])
 
          // Make sure all ranks have sent their 'v' solution before initiating
          // another set of GLVis connections (one from each rank):
-         MPI_Barrier(pmesh->GetComm());
+         if (visualization) { MPI_Barrier(pmesh->GetComm()); }
 
-         if (visualization || visit || gfprint) { hydro.ComputeDensity(rho_gf); }
+         if (vis_density || visit || gfprint) { hydro.ComputeDensity(rho_gf); }
          if (visualization)
          {
             int Wx = 0, Wy = 0; // window position
             int Ww = 350, Wh = 350; // window size
             int offx = Ww+10; // window offsets
-            if (problem != 0 && problem != 4)
+            if (vis_density)
             {
                hydrodynamics::VisualizeField(vis_rho, vishost, visport, rho_gf,
                                              "Density", Wx, Wy, Ww, Wh);
@@ -751,7 +948,11 @@ int main(int argc, char *argv[])
             visit_dc.Save();
          }
 
-         if (gfprint)
+         if (gfprint && parallel_io)
+         {
+            pio.Write(ti, t, *pmesh, x_gf, v_gf, e_gf, rho_gf);
+         }
+         else if (gfprint)
          {
             std::ostringstream mesh_name, rho_name, v_name, e_name;
             mesh_name << basename << "_" << ti << "_mesh";
@@ -795,11 +996,18 @@ int main(int argc, char *argv[])
          MFEM_VERIFY(cfl==0.5, "check: cfl");
          MFEM_VERIFY(strncmp(mesh_file, "default", 7) == 0, "check: mesh_file");
          MFEM_VERIFY(dim==2 || dim==3, "check: dimension");
-         Checks(dim, ti, e_norm, checks);
+         // The single precision stress perturbs the results at the level of
+         // the float round-off, accumulated over the steps.
+         const double eps = mixed_precision ? 1e-5 : 1e-13;
+         Checks(dim, ti, e_norm, checks, eps);
       }
    }
    MFEM_VERIFY(!check || checks == 2, "Check error!");
+   pio.Finish();
+   checkpoint.Finish();
 
+   // Only the steps of this run are timed.
+   steps -= steps_start;
    switch (ode_solver_type)
    {
       case 2: steps *= 2; break;
@@ -810,6 +1018,7 @@ int main(int argc, char *argv[])
    }
 
    hydro.PrintTimingData(mpi.Root(), steps, fom);
+   if (timing_file[0] != '\0') { hydro.SaveTimingData(timing_file); }
 
    if (mem_usage)
    {
@@ -860,144 +1069,143 @@ int main(int argc, char *argv[])
    return 0;
 }
 
-double rho0(const Vector &x)
+// The initial conditions of problem pb at the point x of dimension sdim. They
+// are callable on the device, for the projections of the initial fields, and
+// they are wrapped by the host functions rho0, gamma_func, v0 and e0.
+MFEM_HOST_DEVICE static double Rho0(const int pb, const int sdim,
+                                    const double *x)
 {
-   switch (problem)
+   switch (pb)
    {
       case 0: return 1.0;
       case 1: return 1.0;
-      case 2: return (x(0) < 0.5) ? 1.0 : 0.1;
-      case 3: return (dim == 2) ? (x(0) > 1.0 && x(1) > 1.5) ? 0.125 : 1.0
-                        : x(0) > 1.0 && ((x(1) < 1.5 && x(2) < 1.5) ||
-                                         (x(1) > 1.5 && x(2) > 1.5)) ? 0.125 : 1.0;
+      case 2: return (x[0] < 0.5) ? 1.0 : 0.1;
+      case 3: return (sdim == 2) ? (x[0] > 1.0 && x[1] > 1.5) ? 0.125 : 1.0
+                        : x[0] > 1.0 && ((x[1] < 1.5 && x[2] < 1.5) ||
+                                         (x[1] > 1.5 && x[2] > 1.5)) ? 0.125 : 1.0;
       case 4: return 1.0;
       case 5:
       {
-         if (x(0) >= 0.5 && x(1) >= 0.5) { return 0.5313; }
-         if (x(0) <  0.5 && x(1) <  0.5) { return 0.8; }
+         if (x[0] >= 0.5 && x[1] >= 0.5) { return 0.5313; }
+         if (x[0] <  0.5 && x[1] <  0.5) { return 0.8; }
          return 1.0;
       }
       case 6:
       {
-         if (x(0) <  0.5 && x(1) >= 0.5) { return 2.0; }
-         if (x(0) >= 0.5 && x(1) <  0.5) { return 3.0; }
+         if (x[0] <  0.5 && x[1] >= 0.5) { return 2.0; }
+         if (x[0] >= 0.5 && x[1] <  0.5) { return 3.0; }
          return 1.0;
       }
-      case 7: return x(1) >= 0.0 ? 2.0 : 1.0;
-      default: MFEM_ABORT("Bad number given for problem id!"); return 0.0;
+      case 7: return x[1] >= 0.0 ? 2.0 : 1.0;
+      default: return 0.0;
    }
 }
 
-double gamma_func(const Vector &x)
+MFEM_HOST_DEVICE static double Gamma0(const int pb, const double *x)
 {
-   switch (problem)
+   switch (pb)
    {
       case 0: return 5.0 / 3.0;
       case 1: return 1.4;
       case 2: return 1.4;
-      case 3: return (x(0) > 1.0 && x(1) <= 1.5) ? 1.4 : 1.5;
+      case 3: return (x[0] > 1.0 && x[1] <= 1.5) ? 1.4 : 1.5;
       case 4: return 5.0 / 3.0;
       case 5: return 1.4;
       case 6: return 1.4;
       case 7: return 5.0 / 3.0;
-      default: MFEM_ABORT("Bad number given for problem id!"); return 0.0;
+      default: return 0.0;
    }
 }
 
-static double rad(double x, double y) { return sqrt(x*x + y*y); }
-
-void v0(const Vector &x, Vector &v)
+MFEM_HOST_DEVICE static void V0(const int pb, const int sdim, const double *x,
+                                double *v)
 {
-   const double atn = pow((x(0)*(1.0-x(0))*4*x(1)*(1.0-x(1))*4.0),0.4);
-   switch (problem)
+   for (int d = 0; d < sdim; d++) { v[d] = 0.0; }
+   switch (pb)
    {
       case 0:
-         v(0) =  sin(M_PI*x(0)) * cos(M_PI*x(1));
-         v(1) = -cos(M_PI*x(0)) * sin(M_PI*x(1));
-         if (x.Size() == 3)
+         v[0] =  sin(M_PI*x[0]) * cos(M_PI*x[1]);
+         v[1] = -cos(M_PI*x[0]) * sin(M_PI*x[1]);
+         if (sdim == 3)
          {
-            v(0) *= cos(M_PI*x(2));
-            v(1) *= cos(M_PI*x(2));
-            v(2) = 0.0;
+            v[0] *= cos(M_PI*x[2]);
+            v[1] *= cos(M_PI*x[2]);
          }
-         break;
-      case 1: v = 0.0; break;
-      case 2: v = 0.0; break;
-      case 3: v = 0.0; break;
+         return;
       case 4:
       {
-         v = 0.0;
-         const double r = rad(x(0), x(1));
+         const double r = sqrt(x[0]*x[0] + x[1]*x[1]);
          if (r < 0.2)
          {
-            v(0) =  5.0 * x(1);
-            v(1) = -5.0 * x(0);
+            v[0] =  5.0 * x[1];
+            v[1] = -5.0 * x[0];
          }
          else if (r < 0.4)
          {
-            v(0) =  2.0 * x(1) / r - 5.0 * x(1);
-            v(1) = -2.0 * x(0) / r + 5.0 * x(0);
+            v[0] =  2.0 * x[1] / r - 5.0 * x[1];
+            v[1] = -2.0 * x[0] / r + 5.0 * x[0];
          }
-         else { }
-         break;
-      }
-      case 5:
-      {
-         v = 0.0;
-         if (x(0) >= 0.5 && x(1) >= 0.5) { v(0)=0.0*atn, v(1)=0.0*atn; return;}
-         if (x(0) <  0.5 && x(1) >= 0.5) { v(0)=0.7276*atn, v(1)=0.0*atn; return;}
-         if (x(0) <  0.5 && x(1) <  0.5) { v(0)=0.0*atn, v(1)=0.0*atn; return;}
-         if (x(0) >= 0.5 && x(1) <  0.5) { v(0)=0.0*atn, v(1)=0.7276*atn; return; }
-         MFEM_ABORT("Error in problem 5!");
          return;
       }
+      case 5:
       case 6:
       {
-         v = 0.0;
-         if (x(0) >= 0.5 && x(1) >= 0.5) { v(0)=+0.75*atn, v(1)=-0.5*atn; return;}
-         if (x(0) <  0.5 && x(1) >= 0.5) { v(0)=+0.75*atn, v(1)=+0.5*atn; return;}
-         if (x(0) <  0.5 && x(1) <  0.5) { v(0)=-0.75*atn, v(1)=+0.5*atn; return;}
-         if (x(0) >= 0.5 && x(1) <  0.5) { v(0)=-0.75*atn, v(1)=-0.5*atn; return;}
-         MFEM_ABORT("Error in problem 6!");
+         const double atn = pow((x[0]*(1.0-x[0])*4*x[1]*(1.0-x[1])*4.0),0.4);
+         const bool right = x[0] >= 0.5, top = x[1] >= 0.5;
+         if (pb == 5)
+         {
+            if (!right && top)  { v[0] = 0.7276*atn; }
+            if (right && !top)  { v[1] = 0.7276*atn; }
+            return;
+         }
+         v[0] = (top ? 0.75 : -0.75) * atn;
+         v[1] = (right ? -0.5 : 0.5) * atn;
          return;
       }
       case 7:
-      {
-         v = 0.0;
-         v(1) = 0.02 * exp(-2*M_PI*x(1)*x(1)) * cos(2*M_PI*x(0));
-         break;
-      }
-      default: MFEM_ABORT("Bad number given for problem id!");
+         v[1] = 0.02 * exp(-2*M_PI*x[1]*x[1]) * cos(2*M_PI*x[0]);
+         return;
+      default: return;
    }
 }
 
-double e0(const Vector &x)
+MFEM_HOST_DEVICE static double E0(const int pb, const int sdim,
+                                  const double *x)
 {
-   switch (problem)
+   switch (pb)
    {
       case 0:
       {
          const double denom = 2.0 / 3.0;  // (5/3 - 1) * density.
          double val;
-         if (x.Size() == 2)
+         if (sdim == 2)
          {
-            val = 1.0 + (cos(2*M_PI*x(0)) + cos(2*M_PI*x(1))) / 4.0;
+            val = 1.0 + (cos(2*M_PI*x[0]) + cos(2*M_PI*x[1])) / 4.0;
          }
          else
          {
-            val = 100.0 + ((cos(2*M_PI*x(2)) + 2) *
-                           (cos(2*M_PI*x(0)) + cos(2*M_PI*x(1))) - 2) / 16.0;
+            val = 100.0 + ((cos(2*M_PI*x[2]) + 2) *
+                           (cos(2*M_PI*x[0]) + cos(2*M_PI*x[1])) - 2) / 16.0;
          }
          return val/denom;
       }
       case 1: return 0.0; // This case in initialized in main().
-      case 2: return (x(0) < 0.5) ? 1.0 / rho0(x) / (gamma_func(x) - 1.0)
-                        : 0.1 / rho0(x) / (gamma_func(x) - 1.0);
-      case 3: return (x(0) > 1.0) ? 0.1 / rho0(x) / (gamma_func(x) - 1.0)
-                        : 1.0 / rho0(x) / (gamma_func(x) - 1.0);
+      case 2:
+      {
+         const double rho = Rho0(pb, sdim, x), gamma = Gamma0(pb, x);
+         return (x[0] < 0.5) ? 1.0 / rho / (gamma - 1.0)
+                : 0.1 / rho / (gamma - 1.0);
+      }
+      case 3:
+      {
+         const double rho = Rho0(pb, sdim, x), gamma = Gamma0(pb, x);
+         return (x[0] > 1.0) ? 0.1 / rho / (gamma - 1.0)
+                : 1.0 / rho / (gamma - 1.0);
+      }
       case 4:
       {
-         const double r = rad(x(0), x(1)), rsq = x(0) * x(0) + x(1) * x(1);
+         const double r = sqrt(x[0]*x[0] + x[1]*x[1]);
+         const double rsq = x[0] * x[0] + x[1] * x[1];
          const double gamma = 5.0 / 3.0;
          if (r < 0.2)
          {
@@ -1013,33 +1221,128 @@ double e0(const Vector &x)
       }
       case 5:
       {
-         const double irg = 1.0 / rho0(x) / (gamma_func(x) - 1.0);
-         if (x(0) >= 0.5 && x(1) >= 0.5) { return 0.4 * irg; }
-         if (x(0) <  0.5 && x(1) >= 0.5) { return 1.0 * irg; }
-         if (x(0) <  0.5 && x(1) <  0.5) { return 1.0 * irg; }
-         if (x(0) >= 0.5 && x(1) <  0.5) { return 1.0 * irg; }
-         MFEM_ABORT("Error in problem 5!");
-         return 0.0;
+         const double irg = 1.0 / Rho0(pb, sdim, x) / (Gamma0(pb, x) - 1.0);
+         if (x[0] >= 0.5 && x[1] >= 0.5) { return 0.4 * irg; }
+         return 1.0 * irg;
       }
       case 6:
       {
-         const double irg = 1.0 / rho0(x) / (gamma_func(x) - 1.0);
-         if (x(0) >= 0.5 && x(1) >= 0.5) { return 1.0 * irg; }
-         if (x(0) <  0.5 && x(1) >= 0.5) { return 1.0 * irg; }
-         if (x(0) <  0.5 && x(1) <  0.5) { return 1.0 * irg; }
-         if (x(0) >= 0.5 && x(1) <  0.5) { return 1.0 * irg; }
-         MFEM_ABORT("Error in problem 5!");
-         return 0.0;
+         const double irg = 1.0 / Rho0(pb, sdim, x) / (Gamma0(pb, x) - 1.0);
+         return 1.0 * irg;
       }
       case 7:
       {
-         const double rho = rho0(x), gamma = gamma_func(x);
-         return (6.0 - rho * x(1)) / (gamma - 1.0) / rho;
+         const double rho = Rho0(pb, sdim, x), gamma = Gamma0(pb, x);
+         return (6.0 - rho * x[1]) / (gamma - 1.0) / rho;
       }
-      default: MFEM_ABORT("Bad number given for problem id!"); return 0.0;
+      default: return 0.0;
    }
 }
 
+static void CheckProblem()
+{
+   MFEM_VERIFY(problem >= 0 && problem <= 7,
+               "Bad number given for problem id!");
+}
+
+double rho0(const Vector &x)
+{
+   CheckProblem();
+   return Rho0(problem, x.Size(), x.GetData());
+}
+
+double gamma_func(const Vector &x)
+{
+   CheckProblem();
+   return Gamma0(problem, x.GetData());
+}
+
+void v0(const Vector &x, Vector &v)
+{
+   CheckProblem();
+   V0(problem, x.Size(), x.GetData(), v.GetData());
+}
+
+double e0(const Vector &x)
+{
+   CheckProblem();
+   return E0(problem, x.Size(), x.GetData());
+}
+
+// Physical coordinates (sdim, nodes, zones) of the nodes of the nodal finite
+// element fe in all zones, interpolated on the device from the mesh positions
+// x_gf. The element dofs and the nodes follow the native ordering.
+static void ZoneNodeCoordinates(const ParGridFunction &x_gf,
+                                const FiniteElement &fe, Vector &X)
+{
+   const ParFiniteElementSpace &H1 = *x_gf.ParFESpace();
+   const int NE = H1.GetNE(), SD = H1.GetVDim(), ND = H1.GetFE(0)->GetDof();
+   const IntegrationRule &nodes = fe.GetNodes();
+   const int NN = nodes.GetNPoints();
+   const Operator *R = H1.GetElementRestriction(ElementDofOrdering::NATIVE);
+   Vector xe(R->Height());
+   xe.UseDevice(true);
+   R->Mult(x_gf, xe);
+   const DofToQuad &maps = H1.GetFE(0)->GetDofToQuad(nodes, DofToQuad::FULL);
+   const auto B = Reshape(maps.B.Read(), NN, ND);
+   const auto XE = Reshape(xe.Read(), ND, SD, NE);
+   X.SetSize(SD*NN*NE);
+   X.UseDevice(true);
+   auto XN = Reshape(X.Write(), SD, NN, NE);
+   MFEM_FORALL(i, NN*NE,
+   {
+      const int n = i % NN, e = i / NN;
+      for (int c = 0; c < SD; c++)
+      {
+         double xc = 0.0;
+         for (int d = 0; d < ND; d++) { xc += B(n,d) * XE(d,c,e); }
+         XN(c,n,e) = xc;
+      }
+   });
+}
+
+// Interpolation of the initial density, specific internal energy or gamma in
+// the nodal L2 space of gf, on the device. This matches ProjectCoefficient
+// with the corresponding host function.
+static void ProjectInitialL2(const ParGridFunction &x_gf, const InitialField f,
+                             ParGridFunction &gf)
+{
+   const FiniteElement &fe = *gf.ParFESpace()->GetFE(0);
+   Vector X;
+   ZoneNodeCoordinates(x_gf, fe, X);
+   const int SD = x_gf.ParFESpace()->GetVDim(), pb = problem;
+   const int N = fe.GetDof() * gf.ParFESpace()->GetNE();
+   MFEM_VERIFY(gf.Size() == N, "Expected a scalar L2 space!");
+   const auto XN = Reshape(X.Read(), SD, N);
+   auto G = gf.Write();
+   MFEM_FORALL(i, N,
+   {
+      const double *x = &XN(0,i);
+      G[i] = (f == InitialField::DENSITY) ? Rho0(pb, SD, x) :
+             (f == InitialField::ENERGY)  ? E0(pb, SD, x) : Gamma0(pb, x);
+   });
+}
+
+// Interpolation of the initial velocity in the nodal H1 space of x_gf, on
+// the device. The dofs of each component are at the positions in x_gf.
+static void ProjectInitialVelocity(const ParGridFunction &x_gf,
+                                   ParGridFunction &v_gf)
+{
+   const ParFiniteElementSpace &H1 = *x_gf.ParFESpace();
+   MFEM_VERIFY(H1.GetOrdering() == Ordering::byNODES,
+               "Expected the byNODES ordering of the H1 space!");
+   const int N = H1.GetNDofs(), SD = H1.GetVDim(), pb = problem;
+   const auto X = Reshape(x_gf.Read(), N, SD);
+   auto V = Reshape(v_gf.Write(), N, SD);
+   MFEM_FORALL(i, N,
+   {
+      double x[3], v[3];
+      for (int c = 0; c < SD; c++) { x[c] = X(i,c); }
+      V0(pb, SD, x, v);
+      for (int c = 0; c < SD; c++) { V(i,c) = v[c]; }
+   });
+}
+
 static void display_banner(std::ostream &os)
 {
    os << endl
@@ -1071,10 +1374,10 @@ static bool rerr(const double a, const double v, const double eps)
    return fmax(err_a, err_v) < eps;
 }
 
-static void Checks(const int dim, const int ti, const double nrm, int &chk)
+static void Checks(const int dim, const int ti, const double nrm, int &chk,
+                   const double eps)
 {
    const int pb = problem;
-   const double eps = 1.e-13;
    printf("%.15e\n",nrm);
    if (dim==2)
    {
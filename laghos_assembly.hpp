@@ -20,6 +20,7 @@
 #include "mfem.hpp"
 #include "general/forall.hpp"
 #include "linalg/dtensor.hpp"
+#include <vector>
 
 namespace mfem
 {
@@ -31,14 +32,23 @@ namespace hydrodynamics
 struct QuadratureData
 {
    // Reference to physical Jacobian for the initial mesh.
-   // These are computed only at time zero and stored here.
+   // These are computed only at time zero and stored here, as NQ x dim*dim x
+   // NE with the component index i + dim*j of Jac0inv(i,j). When the initial
+   // Jacobians are constant in every zone (affine meshes), the first
+   // dimension is reduced to 1, i.e., one matrix is stored per zone.
    DenseTensor Jac0inv;
 
    // Quadrature data used for full/partial assembly of the force operator.
    // At each quadrature point, it combines the stress, inverse Jacobian,
    // determinant of the Jacobian and the integration weight.
-   // It must be recomputed in every time step.
+   // It must be recomputed in every time step. The layout is
+   // NQ x dim*dim x NE, where the component index is gd + dim*vd for the
+   // (vd, gd) entry, so that the quadrature points of a component of a zone
+   // are contiguous.
    DenseTensor stressJinvT;
+   // Single precision stressJinvT (same layout), which replaces it in the
+   // partial assembly kernels in the mixed precision mode.
+   Array<float> stressJinvT_sp;
 
    // Quadrature data used for full/partial assembly of the mass matrices.
    // At time zero, we compute and store (rho0 * det(J0) * qp_weight) at each
@@ -55,10 +65,19 @@ struct QuadratureData
    // recomputed at every time step to achieve adaptive time stepping.
    double dt_est;
 
-   QuadratureData(int dim, int NE, int quads_per_el)
-      : Jac0inv(dim, dim, NE * quads_per_el),
-        stressJinvT(NE * quads_per_el, dim, dim),
-        rho0DetJ0w(NE * quads_per_el) { }
+   QuadratureData(int dim, int NE, int quads_per_el,
+                  bool single_stress = false)
+      : Jac0inv(quads_per_el, dim * dim, NE),
+        stressJinvT(single_stress ? 0 : quads_per_el, dim * dim, NE),
+        stressJinvT_sp(single_stress ? NE * quads_per_el * dim * dim : 0),
+        rho0DetJ0w(NE * quads_per_el)
+   { FirstTouch(NE); }
+
+   // With the OpenMP backend, writes the zero value to all arrays with one
+   // zone per thread loop index, i.e., with the same static schedule as the
+   // kernels, so that the memory pages of every zone are mapped to the NUMA
+   // domain of the thread that computes it. Does nothing on other backends.
+   void FirstTouch(const int NE);
 };
 
 // This class is used only for visualization. It assembles (rho, phi) in each
@@ -101,7 +120,11 @@ private:
    const IntegrationRule &ir1D;
    const int D1D, Q1D, L1D, H1sz, L2sz;
    const DofToQuad *L2D2Q, *H1D2Q;
-   mutable Vector X, Y;
+   // Q is the quadrature point buffer of the generic (any order) kernels.
+   mutable Vector X, Y, Q, Yl;
+   // Zones with dofs shared with other tasks, and all the other zones.
+   const GroupCommunicator &gcomm;
+   Array<int> bdr_zones, int_zones;
 public:
    ForcePAOperator(const QuadratureData&,
                    ParFiniteElementSpace&,
@@ -109,6 +132,35 @@ public:
                    const IntegrationRule&);
    virtual void Mult(const Vector&, Vector&) const;
    virtual void MultTranspose(const Vector&, Vector&) const;
+   // Computes P^T Mult(x) on the H1 true dofs. The exchange of the shared
+   // dofs is started after the boundary zones, and overlaps with the force
+   // computation on the interior zones. Host memory only.
+   void MultTrueDofs(const Vector &x, Vector &y) const;
+};
+
+// Conforming prolongation of a parallel space, where the exchange of the
+// shared dofs is done through persistent MPI requests that are created once
+// for the mesh topology. The buffers are packed in the device memory space,
+// which is also given to MPI when it is GPU-aware.
+class PersistentProlongationOperator : public Operator
+{
+private:
+   MPI_Comm comm;
+   // Owned local dofs and their true dof numbers.
+   Array<int> own_ldofs, own_tdofs;
+   // Mult: true dofs sent by the group masters, local dofs received.
+   Array<int> bc_send_tdofs, bc_recv_ldofs;
+   // MultTranspose: local dofs sent to the group masters. For each owned
+   // shared true dof, the received contributions are in rd_recv at the
+   // positions rd_idx[rd_offsets[i]] ... rd_idx[rd_offsets[i+1]-1].
+   Array<int> rd_send_ldofs, rd_tdofs, rd_offsets, rd_idx;
+   mutable Vector bc_send, bc_recv, rd_send, rd_recv;
+   std::vector<MPI_Request> bc_reqs, rd_reqs;
+public:
+   PersistentProlongationOperator(ParFiniteElementSpace &pfes);
+   ~PersistentProlongationOperator();
+   virtual void Mult(const Vector &x, Vector &y) const;
+   virtual void MultTranspose(const Vector &x, Vector &y) const;
 };
 
 // Performs partial assembly for the velocity mass matrix.
@@ -121,15 +173,39 @@ private:
    int ess_tdofs_count;
    Array<int> ess_tdofs;
    OperatorPtr mass;
+   mutable Vector Xl, Yl;
 public:
-   MassPAOperator(ParFiniteElementSpace&, const IntegrationRule&, Coefficient&);
+   // When P is given, it replaces the prolongation of the space.
+   MassPAOperator(ParFiniteElementSpace&, const IntegrationRule&, Coefficient&,
+                  const Operator *P = nullptr);
    virtual void Mult(const Vector&, Vector&) const;
    void MultFull(const Vector &x, Vector &y) const { mass->Mult(x, y); }
+   // Applies MultFull to all components of x, where Pv is the prolongation of
+   // the byNODES vector space of the same scalar space, so that there is one
+   // exchange in each direction for all components. The components marked in
+   // skip are not computed and set to zero.
+   void MultComponents(const Operator &Pv, const Vector &x, Vector &y,
+                       const bool skip[] = nullptr) const;
    virtual void SetEssentialTrueDofs(Array<int>&);
    virtual void EliminateRHS(Vector&) const;
    const ParBilinearForm &GetBF() const { return pabf; }
 };
 
+// Applies the precomputed inverses of block diagonal (element-local) matrices
+// in an L2 space, as one batched matrix-vector product over all elements.
+class LocalInverseOperator : public Operator
+{
+private:
+   const int NE, ND;
+   const Operator *L2R;
+   Vector Minv;
+   mutable Vector X, Y;
+public:
+   // The blocks of Me_inv follow the native ordering of the element dofs.
+   LocalInverseOperator(ParFiniteElementSpace&, const DenseTensor &Me_inv);
+   virtual void Mult(const Vector&, Vector&) const;
+};
+
 } // namespace hydrodynamics
 
 } // namespace mfem
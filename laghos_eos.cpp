@@ -0,0 +1,92 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project 17-SC-20-SC,
+// a collaborative effort of two U.S. Department of Energy organizations (Office
+// of Science and the National Nuclear Security Administration) responsible for
+// the planning and preparation of a capable exascale ecosystem, including
+// software, applications, hardware, advanced system engineering and early
+// testbed platforms, in support of the nation's exascale computing imperative.
+
+#include "laghos_eos.hpp"
+#include <fstream>
+
+namespace mfem
+{
+
+namespace hydrodynamics
+{
+
+void EOSTable::SetSizes(const int nr_, const int ne_, const double rho_min_,
+                        const double rho_max_, const double e_min_,
+                        const double e_max_)
+{
+   MFEM_VERIFY(nr_ > 1 && ne_ > 1, "The EOS table needs 2 or more points "
+               "in each direction.");
+   MFEM_VERIFY(rho_max_ > rho_min_ && e_max_ > e_min_,
+               "Empty EOS table range.");
+   nr = nr_; ne = ne_;
+   rho_min = rho_min_; rho_max = rho_max_;
+   e_min = e_min_; e_max = e_max_;
+   p.SetSize(nr * ne);
+   cs.SetSize(nr * ne);
+   p.UseDevice(true);
+   cs.UseDevice(true);
+}
+
+void EOSTable::Load(const char *fname)
+{
+   std::ifstream in(fname);
+   MFEM_VERIFY(in, "Cannot open the EOS table " << fname);
+   int nr_, ne_;
+   double r0, r1, e0, e1;
+   in >> nr_ >> ne_ >> r0 >> r1 >> e0 >> e1;
+   MFEM_VERIFY(in, "Cannot read the header of the EOS table " << fname);
+   SetSizes(nr_, ne_, r0, r1, e0, e1);
+   double *h_p = p.HostWrite(), *h_cs = cs.HostWrite();
+   for (int k = 0; k < nr * ne; k++) { in >> h_p[k]; }
+   for (int k = 0; k < nr * ne; k++) { in >> h_cs[k]; }
+   MFEM_VERIFY(in, "Cannot read the values of the EOS table " << fname);
+}
+
+void EOSTable::SetIdealGas(const double gamma, const int nr_, const int ne_,
+                           const double rho_max_, const double e_max_)
+{
+   SetSizes(nr_, ne_, 0.0, rho_max_, 0.0, e_max_);
+   const IdealGasEOS eos;
+   double *h_p = p.HostWrite(), *h_cs = cs.HostWrite();
+   for (int i = 0; i < nr; i++)
+   {
+      const double rho = rho_min + i * (rho_max - rho_min) / (nr - 1);
+      for (int j = 0; j < ne; j++)
+      {
+         const double e = e_min + j * (e_max - e_min) / (ne - 1);
+         eos.Eval(gamma, rho, e, h_p[j + ne*i], h_cs[j + ne*i]);
+      }
+   }
+}
+
+TabulatedEOS EOSTable::GetEOS(const bool on_device) const
+{
+   MFEM_VERIFY(nr > 1, "The EOS table is not set.");
+   TabulatedEOS eos;
+   eos.p_tab = on_device ? p.Read() : p.HostRead();
+   eos.cs_tab = on_device ? cs.Read() : cs.HostRead();
+   eos.nr = nr;
+   eos.ne = ne;
+   eos.r0 = rho_min;
+   eos.idr = (nr - 1) / (rho_max - rho_min);
+   eos.e0 = e_min;
+   eos.ide = (ne - 1) / (e_max - e_min);
+   return eos;
+}
+
+} // namespace hydrodynamics
+
+} // namespace mfem
@@ -0,0 +1,135 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project 17-SC-20-SC,
+// a collaborative effort of two U.S. Department of Energy organizations (Office
+// of Science and the National Nuclear Security Administration) responsible for
+// the planning and preparation of a capable exascale ecosystem, including
+// software, applications, hardware, advanced system engineering and early
+// testbed platforms, in support of the nation's exascale computing imperative.
+
+#ifndef MFEM_LAGHOS_EOS
+#define MFEM_LAGHOS_EOS
+
+#include "mfem.hpp"
+
+namespace mfem
+{
+
+namespace hydrodynamics
+{
+
+// Equations of state. An EOS is a functor with the method
+//    MFEM_HOST_DEVICE void Eval(gamma, rho, e, p, cs) const
+// that computes the pressure p and the sound speed cs at one point from the
+// density rho and the specific internal energy e. The functors are copied by
+// value into the quadrature kernels, so they must only hold plain data and
+// pointers to memory that is valid in the space where they are evaluated.
+// The same functor is used by the device QKernel (one point per thread) and
+// by the batched host update of LagrangianHydroOperator.
+
+// Ideal gas law; gamma is the zone value of the adiabatic index.
+struct IdealGasEOS
+{
+   MFEM_HOST_DEVICE inline
+   void Eval(const double gamma, const double rho, const double e,
+             double &p, double &cs) const
+   {
+      p = (gamma - 1.0) * rho * e;
+      cs = sqrt(gamma * (gamma - 1.0) * e);
+   }
+};
+
+// Tabulated EOS: p and cs are given on a uniform nr x ne grid of the (rho, e)
+// box [r0, r0 + (nr-1)/idr] x [e0, e0 + (ne-1)/ide], and are interpolated
+// bilinearly. Points outside of the box are clamped to its boundary. The
+// table has a single material, i.e., gamma is not used.
+struct TabulatedEOS
+{
+   // Table values, with the e index running fastest: p_tab[j + ne*i] is the
+   // pressure at (r0 + i/idr, e0 + j/ide).
+   const double *p_tab, *cs_tab;
+   int nr, ne;
+   double r0, idr, e0, ide;
+
+   MFEM_HOST_DEVICE inline
+   void Eval(const double gamma, const double rho, const double e,
+             double &p, double &cs) const
+   {
+      const double xr = fmin(fmax((rho - r0) * idr, 0.0), nr - 1.0);
+      const double xe = fmin(fmax((e - e0) * ide, 0.0), ne - 1.0);
+      const int i = (xr < nr - 1.0) ? (int) xr : nr - 2;
+      const int j = (xe < ne - 1.0) ? (int) xe : ne - 2;
+      const double a = xr - i, b = xe - j;
+      const int k = j + ne * i;
+      p = (1.0 - a) * ((1.0 - b) * p_tab[k] + b * p_tab[k + 1]) +
+          a * ((1.0 - b) * p_tab[k + ne] + b * p_tab[k + ne + 1]);
+      cs = (1.0 - a) * ((1.0 - b) * cs_tab[k] + b * cs_tab[k + 1]) +
+           a * ((1.0 - b) * cs_tab[k + ne] + b * cs_tab[k + ne + 1]);
+   }
+};
+
+// Storage of the tables of a TabulatedEOS.
+class EOSTable
+{
+private:
+   int nr, ne;
+   double rho_min, rho_max, e_min, e_max;
+   Vector p, cs;
+
+   void SetSizes(const int nr, const int ne, const double rho_min,
+                 const double rho_max, const double e_min, const double e_max);
+
+public:
+   EOSTable() : nr(0), ne(0), rho_min(0.0), rho_max(0.0),
+      e_min(0.0), e_max(0.0) { }
+
+   // Reads an ASCII table file with the format:
+   //    nr ne
+   //    rho_min rho_max e_min e_max
+   //    nr*ne values of p, with the e index running fastest
+   //    nr*ne values of cs, in the same order.
+   void Load(const char *fname);
+
+   // Tabulates the ideal gas law with the given gamma, e.g., for testing.
+   void SetIdealGas(const double gamma, const int nr, const int ne,
+                    const double rho_max, const double e_max);
+
+   // Returns the functor that evaluates the table, with the data pointers in
+   // the device (or host) memory space.
+   TabulatedEOS GetEOS(const bool on_device) const;
+};
+
+// The EOS of the hydro operator is chosen at compile time, see LAGHOS_EOS in
+// the makefile: ideal gas by default, or tabulated.
+#ifdef LAGHOS_TABULATED_EOS
+typedef TabulatedEOS MaterialEOS;
+#else
+typedef IdealGasEOS MaterialEOS;
+#endif
+
+// Returns the MaterialEOS, evaluating the given table when it is tabulated.
+// The table is not used by the ideal gas EOS.
+inline MaterialEOS GetMaterialEOS(const EOSTable *table, const bool on_device)
+{
+#ifdef LAGHOS_TABULATED_EOS
+   MFEM_VERIFY(table, "The tabulated EOS requires a table, see -eos.");
+   return table->GetEOS(on_device);
+#else
+   MFEM_CONTRACT_VAR(table);
+   MFEM_CONTRACT_VAR(on_device);
+   return IdealGasEOS();
+#endif
+}
+
+} // namespace hydrodynamics
+
+} // namespace mfem
+
+#endif // MFEM_LAGHOS_EOS
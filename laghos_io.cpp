@@ -0,0 +1,281 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project 17-SC-20-SC,
+// a collaborative effort of two U.S. Department of Energy organizations (Office
+// of Science and the National Nuclear Security Administration) responsible for
+// the planning and preparation of a capable exascale ecosystem, including
+// software, applications, hardware, advanced system engineering and early
+// testbed platforms, in support of the nation's exascale computing imperative.
+
+#include "laghos_io.hpp"
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef MFEM_USE_MPI
+
+namespace mfem
+{
+
+namespace hydrodynamics
+{
+
+void AsyncFileWriter::Open(const std::string &name)
+{
+   Finish();
+   const int err = MPI_File_open(comm, name.c_str(),
+                                 MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                                 MPI_INFO_NULL, &file);
+   MFEM_VERIFY(err == MPI_SUCCESS, "Cannot open " << name);
+   MPI_File_set_size(file, 0);
+}
+
+void AsyncFileWriter::WriteAt(const MPI_Offset offset, const void *buf,
+                              const int count, MPI_Datatype type)
+{
+   MPI_Request req;
+   // MPI-2 interfaces take a non-const buffer.
+   MPI_File_iwrite_at(file, offset, const_cast<void *>(buf), count, type, &req);
+   requests.push_back(req);
+}
+
+void AsyncFileWriter::Progress()
+{
+   if (requests.empty()) { return; }
+   int done;
+   MPI_Testall(requests.size(), requests.data(), &done, MPI_STATUSES_IGNORE);
+}
+
+void AsyncFileWriter::Finish()
+{
+   if (file == MPI_FILE_NULL) { return; }
+   MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+   requests.clear();
+   MPI_File_close(&file);
+}
+
+ParallelBinaryOutput::ParallelBinaryOutput(MPI_Comm comm,
+                                           const char *basename) :
+   AsyncFileWriter(comm), basename(basename), mesh_saved(false) { }
+
+void ParallelBinaryOutput::Write(const int cycle, const double time,
+                                 const ParMesh &pmesh,
+                                 const ParGridFunction &x,
+                                 const ParGridFunction &v,
+                                 const ParGridFunction &e,
+                                 const ParGridFunction &rho)
+{
+   // The snapshot buffers are reused, so the previous dump must be complete.
+   Finish();
+   int rank;
+   MPI_Comm_rank(comm, &rank);
+
+   if (!mesh_saved)
+   {
+      std::ostringstream mesh_name;
+      mesh_name << basename << "_mesh." << std::setfill('0') << std::setw(6)
+                << rank;
+      std::ofstream mesh_ofs(mesh_name.str().c_str());
+      mesh_ofs.precision(16);
+      pmesh.ParPrint(mesh_ofs);
+      mesh_saved = true;
+   }
+
+   const ParGridFunction *fields[4] = { &x, &v, &e, &rho };
+   int64_t sizes[4];
+   MPI_Offset offsets[4];
+   for (int f = 0; f < 4; f++)
+   {
+      const ParFiniteElementSpace &pfes = *fields[f]->ParFESpace();
+      fields[f]->GetTrueDofs(snapshot[f]);
+      snapshot[f].HostRead();
+      sizes[f] = pfes.GlobalTrueVSize();
+      offsets[f] = pfes.GetMyTDofOffset();
+   }
+
+   const char magic[8] = { 'L', 'A', 'G', 'H', 'O', 'S', 'B', '1' };
+   const int64_t header_cycle = cycle, nfields = 4;
+   const size_t header_size = sizeof(magic) + 2 * sizeof(int64_t) +
+                              sizeof(double) + sizeof(sizes);
+   header.resize(header_size);
+   char *h = header.data();
+   std::memcpy(h, magic, sizeof(magic)); h += sizeof(magic);
+   std::memcpy(h, &header_cycle, sizeof(int64_t)); h += sizeof(int64_t);
+   std::memcpy(h, &nfields, sizeof(int64_t)); h += sizeof(int64_t);
+   std::memcpy(h, &time, sizeof(double)); h += sizeof(double);
+   std::memcpy(h, sizes, sizeof(sizes));
+
+   std::ostringstream file_name;
+   file_name << basename << "_" << cycle << ".lghb";
+   Open(file_name.str());
+
+   if (rank == 0) { WriteAt(0, header.data(), header_size, MPI_CHAR); }
+   MPI_Offset field_start = header_size;
+   for (int f = 0; f < 4; f++)
+   {
+      const MPI_Offset offset = field_start + offsets[f] * sizeof(double);
+      WriteAt(offset, snapshot[f].GetData(), snapshot[f].Size(), MPI_DOUBLE);
+      field_start += sizes[f] * sizeof(double);
+   }
+}
+
+static const char checkpoint_magic[8] =
+{ 'L', 'A', 'G', 'H', 'O', 'S', 'C', '1' };
+static const int checkpoint_nints = 5, checkpoint_ndoubles = 4;
+static const int checkpoint_index_size = 6;
+static const size_t checkpoint_header_size =
+   sizeof(checkpoint_magic) + checkpoint_nints * sizeof(int64_t) +
+   checkpoint_ndoubles * sizeof(double);
+
+CheckpointWriter::CheckpointWriter(MPI_Comm comm, const char *basename) :
+   AsyncFileWriter(comm), basename(basename),
+   index(checkpoint_index_size) { }
+
+void CheckpointWriter::Write(const int cycle, const int steps,
+                             const double time, const double dt,
+                             const double energy, const Vector &S,
+                             const QuadratureData &qdata,
+                             const ParMesh &pmesh)
+{
+   // The snapshot buffer is reused, so the previous checkpoint must be
+   // complete.
+   Finish();
+   int rank, nranks;
+   MPI_Comm_rank(comm, &rank);
+   MPI_Comm_size(comm, &nranks);
+
+   snapshot = S;
+   snapshot.HostRead();
+   const DenseTensor &J0 = qdata.Jac0inv;
+   const double *J0_data = HostRead(J0.GetMemory(), J0.TotalSize());
+   const double *rho0DetJ0w = qdata.rho0DetJ0w.HostRead();
+
+   const int64_t global_NE = pmesh.GetGlobalNE();
+   const int64_t ints[checkpoint_nints] =
+   { nranks, cycle, steps, pmesh.Dimension(), global_NE };
+   const double doubles[checkpoint_ndoubles] = { time, dt, qdata.h0, energy };
+   header.resize(checkpoint_header_size);
+   char *h = header.data();
+   std::memcpy(h, checkpoint_magic, sizeof(checkpoint_magic));
+   h += sizeof(checkpoint_magic);
+   std::memcpy(h, ints, sizeof(ints)); h += sizeof(ints);
+   std::memcpy(h, doubles, sizeof(doubles));
+
+   index[0] = pmesh.GetNE();
+   index[1] = snapshot.Size();
+   index[2] = J0.SizeI(); index[3] = J0.SizeJ(); index[4] = J0.SizeK();
+   index[5] = qdata.rho0DetJ0w.Size();
+
+   // Offset of the block of this task, after the blocks of the lower ranks.
+   int64_t block_size = index[1] + J0.TotalSize() + index[5], block_start;
+   MPI_Exscan(&block_size, &block_start, 1, MPI_INT64_T, MPI_SUM, comm);
+   if (rank == 0) { block_start = 0; }
+
+   std::ostringstream file_name;
+   file_name << basename << "_" << cycle << ".lghc";
+   Open(file_name.str());
+
+   if (rank == 0)
+   {
+      WriteAt(0, header.data(), checkpoint_header_size, MPI_CHAR);
+   }
+   const MPI_Offset index_bytes = checkpoint_index_size * sizeof(int64_t);
+   WriteAt(checkpoint_header_size + rank * index_bytes, index.data(),
+           checkpoint_index_size, MPI_INT64_T);
+   MPI_Offset offset = checkpoint_header_size + nranks * index_bytes +
+                       block_start * sizeof(double);
+   WriteAt(offset, snapshot.GetData(), snapshot.Size(), MPI_DOUBLE);
+   offset += snapshot.Size() * sizeof(double);
+   WriteAt(offset, J0_data, J0.TotalSize(), MPI_DOUBLE);
+   offset += J0.TotalSize() * sizeof(double);
+   WriteAt(offset, rho0DetJ0w, qdata.rho0DetJ0w.Size(), MPI_DOUBLE);
+}
+
+void ReadCheckpoint(MPI_Comm comm, const char *fname, const ParMesh &pmesh,
+                    int &cycle, int &steps, double &time, double &dt,
+                    double &energy, Vector &S, QuadratureData &qdata)
+{
+   int rank, nranks;
+   MPI_Comm_rank(comm, &rank);
+   MPI_Comm_size(comm, &nranks);
+
+   MPI_File file;
+   const int err = MPI_File_open(comm, const_cast<char *>(fname),
+                                 MPI_MODE_RDONLY, MPI_INFO_NULL, &file);
+   MFEM_VERIFY(err == MPI_SUCCESS, "Cannot open " << fname);
+
+   std::vector<char> header(checkpoint_header_size);
+   MPI_File_read_at(file, 0, header.data(), checkpoint_header_size, MPI_CHAR,
+                    MPI_STATUS_IGNORE);
+   int64_t ints[checkpoint_nints];
+   double doubles[checkpoint_ndoubles];
+   const char *h = header.data();
+   MFEM_VERIFY(std::memcmp(h, checkpoint_magic, sizeof(checkpoint_magic)) == 0,
+               fname << " is not a Laghos checkpoint!");
+   h += sizeof(checkpoint_magic);
+   std::memcpy(ints, h, sizeof(ints)); h += sizeof(ints);
+   std::memcpy(doubles, h, sizeof(doubles));
+   MFEM_VERIFY(ints[0] == nranks, "The checkpoint was written by " << ints[0]
+               << " tasks, restart with the same number of tasks!");
+   const int64_t global_NE = pmesh.GetGlobalNE();
+   MFEM_VERIFY(ints[3] == pmesh.Dimension() && ints[4] == global_NE,
+               "The checkpoint doesn't match the mesh!");
+   cycle = ints[1];
+   steps = ints[2];
+   time = doubles[0];
+   dt = doubles[1];
+   qdata.h0 = doubles[2];
+   energy = doubles[3];
+
+   // Every task reads the whole index to find the start of its block.
+   const int isize = checkpoint_index_size;
+   std::vector<int64_t> index(nranks * isize);
+   MPI_File_read_at(file, checkpoint_header_size, index.data(), nranks * isize,
+                    MPI_INT64_T, MPI_STATUS_IGNORE);
+   int64_t block_start = 0;
+   for (int r = 0; r < rank; r++)
+   {
+      const int64_t *ri = &index[r * isize];
+      block_start += ri[1] + ri[2] * ri[3] * ri[4] + ri[5];
+   }
+   const int64_t *my = &index[rank * isize];
+   MFEM_VERIFY(my[0] == pmesh.GetNE() && my[1] == S.Size() &&
+               my[3] == qdata.Jac0inv.SizeJ() && my[4] == pmesh.GetNE() &&
+               my[5] == qdata.rho0DetJ0w.Size(),
+               "The local sizes of the checkpoint don't match, restart with "
+               "the same options and partitioning!");
+
+   // Jac0inv may have been stored once per zone, see CompactJac0inv().
+   DenseTensor &J0 = qdata.Jac0inv;
+   if (J0.SizeI() != my[2])
+   {
+      J0.Clear();
+      J0.SetSize(my[2], my[3], my[4]);
+   }
+   MPI_Offset offset = checkpoint_header_size +
+                       nranks * isize * sizeof(int64_t) +
+                       block_start * sizeof(double);
+   MPI_File_read_at(file, offset, S.HostWrite(), S.Size(), MPI_DOUBLE,
+                    MPI_STATUS_IGNORE);
+   offset += S.Size() * sizeof(double);
+   MPI_File_read_at(file, offset, HostWrite(J0.GetMemory(), J0.TotalSize()),
+                    J0.TotalSize(), MPI_DOUBLE, MPI_STATUS_IGNORE);
+   offset += J0.TotalSize() * sizeof(double);
+   MPI_File_read_at(file, offset, qdata.rho0DetJ0w.HostWrite(),
+                    qdata.rho0DetJ0w.Size(), MPI_DOUBLE, MPI_STATUS_IGNORE);
+   MPI_File_close(&file);
+}
+
+} // namespace hydrodynamics
+
+} // namespace mfem
+
+#endif // MFEM_USE_MPI
@@ -0,0 +1,147 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project 17-SC-20-SC,
+// a collaborative effort of two U.S. Department of Energy organizations (Office
+// of Science and the National Nuclear Security Administration) responsible for
+// the planning and preparation of a capable exascale ecosystem, including
+// software, applications, hardware, advanced system engineering and early
+// testbed platforms, in support of the nation's exascale computing imperative.
+
+#ifndef MFEM_LAGHOS_IO
+#define MFEM_LAGHOS_IO
+
+#include "mfem.hpp"
+#include "laghos_assembly.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef MFEM_USE_MPI
+
+namespace mfem
+{
+
+namespace hydrodynamics
+{
+
+// Nonblocking writes of several buffers into one shared file through MPI-IO.
+// The buffers must not change until the requests are completed, at the next
+// Open() or at Finish(). Progress() can be called in the meantime to let the
+// MPI library advance the writes.
+class AsyncFileWriter
+{
+protected:
+   const MPI_Comm comm;
+   MPI_File file;
+   std::vector<MPI_Request> requests;
+
+   AsyncFileWriter(MPI_Comm comm) : comm(comm), file(MPI_FILE_NULL) { }
+   // Collective. Completes the previous file and creates (truncates) a new one.
+   void Open(const std::string &name);
+   // Local. Starts the write of count items of the given type at offset bytes.
+   void WriteAt(const MPI_Offset offset, const void *buf, const int count,
+                MPI_Datatype type);
+
+public:
+   ~AsyncFileWriter() { Finish(); }
+
+   // Local. Tests the pending writes, which gives the MPI library a chance
+   // to progress them.
+   void Progress();
+   // Collective. Completes the pending writes and closes the file.
+   void Finish();
+};
+
+// Parallel binary output of the position, velocity, specific internal energy
+// and density, as an alternative to the ASCII PrintAsOne/SaveAsOne dumps that
+// gather everything on one task.
+//
+// Every dump is a single file <basename>_<cycle>.lghb, written through MPI-IO:
+//    char[8]   "LAGHOSB1"
+//    int64     cycle, number of fields (4)
+//    double    time
+//    int64     global true size of each field (x, v, e, rho)
+//    double    global true dof vector of each field, in the same order.
+// Each task writes the slab of its own true dofs, so no data is gathered, and
+// the file doesn't depend on the number of tasks beyond the parallel dof
+// numbering. The mesh topology doesn't change in time; it is saved once, at
+// the first dump, in the MFEM parallel format <basename>_mesh.<rank>.
+//
+// The fields are copied in a snapshot buffer, and written by nonblocking MPI
+// requests. The time stepping continues while the data is written, and the
+// requests are completed at the next dump (or at Finish()).
+class ParallelBinaryOutput : public AsyncFileWriter
+{
+private:
+   const std::string basename;
+   bool mesh_saved;
+   // Snapshot of the true dofs of x, v, e, rho, and the header.
+   Vector snapshot[4];
+   std::vector<char> header;
+
+public:
+   ParallelBinaryOutput(MPI_Comm comm, const char *basename);
+
+   // Collective. Starts the output of the given fields at the given cycle.
+   void Write(const int cycle, const double time, const ParMesh &pmesh,
+              const ParGridFunction &x, const ParGridFunction &v,
+              const ParGridFunction &e, const ParGridFunction &rho);
+};
+
+// Checkpoints of the full hydro state: the state vector S, the time, time step
+// and step counters, and the time-zero quadrature data (Jac0inv, rho0DetJ0w,
+// h0), which can't be recomputed after the mesh has moved.
+//
+// Every checkpoint is a single partitioned file <basename>_<cycle>.lghc:
+//    char[8]   "LAGHOSC1"
+//    int64     number of tasks, cycle, steps, dimension, global number of zones
+//    double    time, dt, h0, initial total energy
+//    int64     for each task: number of zones, size of S, sizes I, J, K of
+//              Jac0inv, size of rho0DetJ0w
+//    double    for each task, in order: S (local dofs), Jac0inv, rho0DetJ0w.
+// The per-task index makes the blocks self-describing, so that the data can
+// be redistributed to a different number of tasks by a separate tool; the
+// restart itself requires the same mesh, options and number of tasks.
+//
+// As for ParallelBinaryOutput, S is copied in a snapshot buffer and the data
+// is written by nonblocking requests. The quadrature data doesn't change
+// after the initialization and is written directly.
+class CheckpointWriter : public AsyncFileWriter
+{
+private:
+   const std::string basename;
+   Vector snapshot;
+   std::vector<char> header;
+   std::vector<int64_t> index;
+
+public:
+   CheckpointWriter(MPI_Comm comm, const char *basename);
+
+   // Collective. Starts the checkpoint of the given state at the given cycle.
+   void Write(const int cycle, const int steps, const double time,
+              const double dt, const double energy, const Vector &S,
+              const QuadratureData &qdata, const ParMesh &pmesh);
+};
+
+// Collective. Reads a checkpoint written by CheckpointWriter into S and the
+// time-zero part of qdata, and returns the time stepping data. The local sizes
+// must match those of the checkpoint, i.e., the run must be restarted with the
+// same mesh, refinements, orders, partitioning and number of tasks.
+void ReadCheckpoint(MPI_Comm comm, const char *fname, const ParMesh &pmesh,
+                    int &cycle, int &steps, double &time, double &dt,
+                    double &energy, Vector &S, QuadratureData &qdata);
+
+} // namespace hydrodynamics
+
+} // namespace mfem
+
+#endif // MFEM_USE_MPI
+
+#endif // MFEM_LAGHOS_IO
@@ -0,0 +1,1465 @@
+// Copyright (c) 2017, Lawrence Livermore National Security, LLC. Produced at
+// the Lawrence Livermore National Laboratory. LLNL-CODE-734707. All Rights
+// reserved. See files LICENSE and NOTICE for details.
+//
+// This file is part of CEED, a collection of benchmarks, miniapps, software
+// libraries and APIs for efficient high-order finite element and spectral
+// element discretizations for exascale applications. For more information and
+// source code availability see http://github.com/ceed.
+//
+// The CEED research is supported by the Exascale Computing Project 17-SC-20-SC,
+// a collaborative effort of two U.S. Department of Energy organizations (Office
+// of Science and the National Nuclear Security Administration) responsible for
+// the planning and preparation of a capable exascale ecosystem, including
+// software, applications, hardware, advanced system engineering and early
+// testbed platforms, in support of the nation's exascale computing imperative.
+
+#ifndef MFEM_LAGHOS_PA_KERNELS
+#define MFEM_LAGHOS_PA_KERNELS
+
+#include "mfem.hpp"
+#include "general/forall.hpp"
+#include "linalg/kernels.hpp"
+#include "laghos_eos.hpp"
+#include <limits>
+#include <unordered_map>
+
+// Partial assembly kernels of the force operator and of the quadrature data
+// update. They only depend on the 1D bases, the E-vectors and the quadrature
+// data arrays, so they are shared by the parallel miniapp and by the serial
+// and AMR versions in serial/ and amr/. All kernels use the MFEM_FORALL
+// macros, i.e., they run on the device, or are threaded by the OpenMP backend.
+//
+// Layouts of the quadrature data, see QuadratureData:
+//    stressJinvT  NQ x dim*dim x NE, component index gd + dim*vd,
+//    Jac0inv      NJ0 x dim*dim x NE, where NJ0 is NQ, or 1 for affine zones,
+//    rho0DetJ0w   NQ x NE.
+// The Jacobians and velocity gradients are dim x dim x NQ x NE, as given by
+// the QuadratureInterpolator with the QVectorLayout::byVDIM layout.
+
+namespace mfem
+{
+
+namespace hydrodynamics
+{
+
+// Smooth transition between 0 and 1 for x in [-eps, eps].
+MFEM_HOST_DEVICE inline double smooth_step_01(double x, double eps)
+{
+   const double y = (x + eps) / (2.0 * eps);
+   if (y < 0.0) { return 0.0; }
+   if (y > 1.0) { return 1.0; }
+   return (3.0 - 2.0 * y) * y * y;
+}
+
+/// Trace of a square matrix
+template<int H, int W, typename T>
+MFEM_HOST_DEVICE inline
+double Trace(const T * __restrict__ data)
+{
+   double t = 0.0;
+   for (int i = 0; i < W; i++) { t += data[i+i*H]; }
+   return t;
+}
+
+template<int H, int W, typename T>
+MFEM_HOST_DEVICE static inline
+void SFNorm(double &scale_factor, double &scaled_fnorm2,
+            const T * __restrict__ data)
+{
+   int i;
+   constexpr int hw = H * W;
+   T max_norm = 0.0, entry, fnorm2;
+
+   for (i = 0; i < hw; i++)
+   {
+      entry = fabs(data[i]);
+      if (entry > max_norm)
+      {
+         max_norm = entry;
+      }
+   }
+
+   if (max_norm == 0.0)
+   {
+      scale_factor = scaled_fnorm2 = 0.0;
+      return;
+   }
+
+   fnorm2 = 0.0;
+   for (i = 0; i < hw; i++)
+   {
+      entry = data[i] / max_norm;
+      fnorm2 += entry * entry;
+   }
+
+   scale_factor = max_norm;
+   scaled_fnorm2 = fnorm2;
+}
+
+/// Compute the Frobenius norm of the matrix
+template<int H, int W, typename T>
+MFEM_HOST_DEVICE inline
+double FNorm(const T * __restrict__ data)
+{
+   double s, n2;
+   SFNorm<H,W>(s, n2, data);
+   return s*sqrt(n2);
+}
+
+template<int DIM, typename T> MFEM_HOST_DEVICE static inline
+void QUpdateBody(const int NE, const int e,
+                 const int NQ, const int q,
+                 const bool use_viscosity,
+                 const bool use_vorticity,
+                 const double h0,
+                 const double h1order,
+                 const double cfl,
+                 const double infinity,
+                 double* __restrict__ Jinv,
+                 double* __restrict__ stress,
+                 double* __restrict__ sgrad_v,
+                 double* __restrict__ eig_val_data,
+                 double* __restrict__ eig_vec_data,
+                 double* __restrict__ compr_dir,
+                 double* __restrict__ Jpi,
+                 double* __restrict__ ph_dir,
+                 double* __restrict__ stressJiT,
+                 const double* __restrict__ d_gamma,
+                 const double* __restrict__ d_weights,
+                 const double* __restrict__ d_Jacobians,
+                 const double* __restrict__ d_rho0DetJ0w,
+                 const double* __restrict__ d_e_quads,
+                 const double* __restrict__ d_grad_v_ext,
+                 const int NJ0,
+                 const double* __restrict__ d_Jac0inv,
+                 const MaterialEOS &eos,
+                 double &dt_est,
+                 T *d_stressJinvT)
+{
+   constexpr int DIM2 = DIM*DIM;
+   double min_detJ = infinity;
+
+   const int eq = e * NQ + q;
+   const double gamma = d_gamma[e];
+   const double weight =  d_weights[q];
+   const double inv_weight = 1. / weight;
+   const double *J = d_Jacobians + DIM2*(NQ*e + q);
+   const double detJ = kernels::Det<DIM>(J);
+   min_detJ = fmin(min_detJ, detJ);
+   kernels::CalcInverse<DIM>(J, Jinv);
+   const double R = inv_weight * d_rho0DetJ0w[eq] / detJ;
+   const double E = fmax(0.0, d_e_quads[eq]);
+   double P, S;
+   eos.Eval(gamma, R, E, P, S);
+   for (int k = 0; k < DIM2; k++) { stress[k] = 0.0; }
+   for (int d = 0; d < DIM; d++) { stress[d*DIM+d] = -P; }
+   double visc_coeff = 0.0;
+   if (use_viscosity)
+   {
+      // Compression-based length scale at the point. The first
+      // eigenvector of the symmetric velocity gradient gives the
+      // direction of maximal compression. This is used to define the
+      // relative change of the initial length scale.
+      const double *dV = d_grad_v_ext + DIM2*(NQ*e + q);
+      kernels::Mult(DIM, DIM, DIM, dV, Jinv, sgrad_v);
+
+      double vorticity_coeff = 1.0;
+      if (use_vorticity)
+      {
+         const double grad_norm = FNorm<DIM,DIM>(sgrad_v);
+         const double div_v = fabs(Trace<DIM,DIM>(sgrad_v));
+         vorticity_coeff = (grad_norm > 0.0) ? div_v / grad_norm : 1.0;
+      }
+
+      kernels::Symmetrize(DIM, sgrad_v);
+      if (DIM == 1)
+      {
+         eig_val_data[0] = sgrad_v[0];
+         eig_vec_data[0] = 1.;
+      }
+      else
+      {
+         kernels::CalcEigenvalues<DIM>(sgrad_v, eig_val_data, eig_vec_data);
+      }
+      for (int k=0; k<DIM; k++) { compr_dir[k] = eig_vec_data[k]; }
+      // Computes the initial->physical transformation Jacobian. Jac0inv is
+      // stored once per zone when the initial Jacobians are constant.
+      double J0inv[DIM2];
+      const int j0 = (NJ0 > 1) ? q : 0;
+      for (int k = 0; k < DIM2; k++)
+      {
+         J0inv[k] = d_Jac0inv[j0 + NJ0*(k + DIM2*e)];
+      }
+      kernels::Mult(DIM, DIM, DIM, J, J0inv, Jpi);
+      kernels::Mult(DIM, DIM, Jpi, compr_dir, ph_dir);
+      // Change of the initial mesh size in the compression direction.
+      const double ph_dir_nl2 = kernels::Norml2(DIM, ph_dir);
+      const double compr_dir_nl2 = kernels::Norml2(DIM, compr_dir);
+      const double H = h0 * ph_dir_nl2 / compr_dir_nl2;
+      // Measure of maximal compression.
+      const double mu = eig_val_data[0];
+      visc_coeff = 2.0 * R * H * H * fabs(mu);
+      // The following represents a "smooth" version of the statement
+      // "if (mu < 0) visc_coeff += 0.5 rho h sound_speed".  Note that
+      // eps must be scaled appropriately if a different unit system is
+      // being used.
+      const double eps = 1e-12;
+      visc_coeff += 0.5 * R * H  * S * vorticity_coeff *
+                    (1.0 - smooth_step_01(mu-2.0*eps, eps));
+      kernels::Add(DIM, DIM, visc_coeff, stress, sgrad_v, stress);
+   }
+   // Time step estimate at the point. Here the more relevant length
+   // scale is related to the actual mesh deformation; we use the min
+   // singular value of the ref->physical Jacobian. In addition, the
+   // time step estimate should be aware of the presence of shocks.
+   const double sv = kernels::CalcSingularvalue<DIM>(J, DIM - 1);
+   const double h_min = sv / h1order;
+   const double ih_min = 1. / h_min;
+   const double irho_ih_min_sq = ih_min * ih_min / R ;
+   const double idt = S * ih_min + 2.5 * visc_coeff * irho_ih_min_sq;
+   if (min_detJ < 0.0)
+   {
+      // This will force repetition of the step with smaller dt.
+      dt_est = 0.0;
+   }
+   else
+   {
+      if (idt > 0.0)
+      {
+         const double cfl_inv_dt = cfl / idt;
+         dt_est = fmin(dt_est, cfl_inv_dt);
+      }
+   }
+   // Quadrature data for partial assembly of the force operator.
+   kernels::MultABt(DIM, DIM, DIM, stress, Jinv, stressJiT);
+   for (int k = 0; k < DIM2; k++) { stressJiT[k] *= weight * detJ; }
+   // The fused force kernels use stressJiT directly and don't store it.
+   if (d_stressJinvT == nullptr) { return; }
+   for (int vd = 0 ; vd < DIM; vd++)
+   {
+      for (int gd = 0; gd < DIM; gd++)
+      {
+         const int offset = q + NQ*(gd + vd*DIM + DIM2*e);
+         d_stressJinvT[offset] = stressJiT[vd + gd*DIM];
+      }
+   }
+}
+
+// Stores the minimum of the NQ point estimates of element e, which are in the
+// shared memory of the thread block.
+MFEM_HOST_DEVICE static inline
+void ElementDtEstimate(const int e, const int NQ, const double *dt_q,
+                       double *d_dt_est)
+{
+   if (MFEM_THREAD_ID(x) == 0 && MFEM_THREAD_ID(y) == 0 &&
+       MFEM_THREAD_ID(z) == 0)
+   {
+      double dt = dt_q[0];
+      for (int q = 1; q < NQ; q++) { dt = fmin(dt, dt_q[q]); }
+      d_dt_est[e] = dt;
+   }
+}
+
+template<int DIM, int Q1D, typename T> static inline
+void QKernel(const int NE, const int NQ,
+             const bool use_viscosity,
+             const bool use_vorticity,
+             const double h0,
+             const double h1order,
+             const double cfl,
+             const double infinity,
+             const Vector &gamma,
+             const Array<double> &weights,
+             const Vector &Jacobians,
+             const Vector &rho0DetJ0w,
+             const Vector &e_quads,
+             const Vector &grad_v_ext,
+             const DenseTensor &Jac0inv,
+             const MaterialEOS eos,
+             Vector &dt_est,
+             Memory<T> &stressJinvT)
+{
+   constexpr int DIM2 = DIM*DIM;
+   const auto d_gamma = gamma.Read();
+   const auto d_weights = weights.Read();
+   const auto d_Jacobians = Jacobians.Read();
+   const auto d_rho0DetJ0w = rho0DetJ0w.Read();
+   const auto d_e_quads = e_quads.Read();
+   const auto d_grad_v_ext = grad_v_ext.Read();
+   const int NJ0 = Jac0inv.SizeI();
+   const auto d_Jac0inv = Read(Jac0inv.GetMemory(), Jac0inv.TotalSize());
+   auto d_dt_est = dt_est.Write();
+   auto d_stressJinvT = Write(stressJinvT, NE*NQ*DIM2);
+   if (DIM == 2)
+   {
+      MFEM_FORALL_2D(e, NE, Q1D, Q1D, 1,
+      {
+         double Jinv[DIM2];
+         double stress[DIM2];
+         double sgrad_v[DIM2];
+         double eig_val_data[3];
+         double eig_vec_data[9];
+         double compr_dir[DIM];
+         double Jpi[DIM2];
+         double ph_dir[DIM];
+         double stressJiT[DIM2];
+         MFEM_SHARED double DT[Q1D*Q1D];
+         MFEM_FOREACH_THREAD(qx,x,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qy,y,Q1D)
+            {
+               const int q = qx + qy * Q1D;
+               DT[q] = infinity;
+               QUpdateBody<DIM>(NE, e, NQ, q,
+                                use_viscosity, use_vorticity, h0, h1order, cfl, infinity,
+                                Jinv, stress, sgrad_v, eig_val_data, eig_vec_data,
+                                compr_dir, Jpi, ph_dir, stressJiT,
+                                d_gamma, d_weights, d_Jacobians, d_rho0DetJ0w,
+                                d_e_quads, d_grad_v_ext, NJ0, d_Jac0inv,
+                                eos, DT[q], d_stressJinvT);
+            }
+         }
+         MFEM_SYNC_THREAD;
+         ElementDtEstimate(e, Q1D*Q1D, DT, d_dt_est);
+      });
+   }
+   if (DIM == 3)
+   {
+      MFEM_FORALL_3D(e, NE, Q1D, Q1D, Q1D,
+      {
+         double Jinv[DIM2];
+         double stress[DIM2];
+         double sgrad_v[DIM2];
+         double eig_val_data[3];
+         double eig_vec_data[9];
+         double compr_dir[DIM];
+         double Jpi[DIM2];
+         double ph_dir[DIM];
+         double stressJiT[DIM2];
+         MFEM_SHARED double DT[Q1D*Q1D*Q1D];
+         MFEM_FOREACH_THREAD(qx,x,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qy,y,Q1D)
+            {
+               MFEM_FOREACH_THREAD(qz,z,Q1D)
+               {
+                  const int q = qx + Q1D * (qy + qz * Q1D);
+                  DT[q] = infinity;
+                  QUpdateBody<DIM>(NE, e, NQ, q,
+                                   use_viscosity, use_vorticity, h0, h1order, cfl, infinity,
+                                   Jinv, stress, sgrad_v, eig_val_data, eig_vec_data,
+                                   compr_dir, Jpi, ph_dir, stressJiT,
+                                   d_gamma, d_weights, d_Jacobians, d_rho0DetJ0w,
+                                   d_e_quads, d_grad_v_ext, NJ0, d_Jac0inv,
+                                   eos, DT[q], d_stressJinvT);
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         ElementDtEstimate(e, Q1D*Q1D*Q1D, DT, d_dt_est);
+      });
+   }
+}
+
+// Generic version of QKernel for any number of quadrature points, with one
+// thread per quadrature point.
+template<int DIM, typename T> static
+void QKernelGeneric(const int NE, const int NQ,
+                    const bool use_viscosity,
+                    const bool use_vorticity,
+                    const double h0,
+                    const double h1order,
+                    const double cfl,
+                    const double infinity,
+                    const Vector &gamma,
+                    const Array<double> &weights,
+                    const Vector &Jacobians,
+                    const Vector &rho0DetJ0w,
+                    const Vector &e_quads,
+                    const Vector &grad_v_ext,
+                    const DenseTensor &Jac0inv,
+                    const MaterialEOS eos,
+                    Vector &dt_est,
+                    Memory<T> &stressJinvT)
+{
+   constexpr int DIM2 = DIM*DIM;
+   const auto d_gamma = gamma.Read();
+   const auto d_weights = weights.Read();
+   const auto d_Jacobians = Jacobians.Read();
+   const auto d_rho0DetJ0w = rho0DetJ0w.Read();
+   const auto d_e_quads = e_quads.Read();
+   const auto d_grad_v_ext = grad_v_ext.Read();
+   const int NJ0 = Jac0inv.SizeI();
+   const auto d_Jac0inv = Read(Jac0inv.GetMemory(), Jac0inv.TotalSize());
+   auto d_dt_est = dt_est.Write();
+   auto d_stressJinvT = Write(stressJinvT, NE*NQ*DIM2);
+   MFEM_FORALL(eq, NE*NQ,
+   {
+      double Jinv[DIM2];
+      double stress[DIM2];
+      double sgrad_v[DIM2];
+      double eig_val_data[3];
+      double eig_vec_data[9];
+      double compr_dir[DIM];
+      double Jpi[DIM2];
+      double ph_dir[DIM];
+      double stressJiT[DIM2];
+      double dt_q = infinity;
+      QUpdateBody<DIM>(NE, eq / NQ, NQ, eq % NQ,
+                       use_viscosity, use_vorticity, h0, h1order, cfl, infinity,
+                       Jinv, stress, sgrad_v, eig_val_data, eig_vec_data,
+                       compr_dir, Jpi, ph_dir, stressJiT,
+                       d_gamma, d_weights, d_Jacobians, d_rho0DetJ0w,
+                       d_e_quads, d_grad_v_ext, NJ0, d_Jac0inv,
+                       eos, dt_q, d_stressJinvT);
+      d_dt_est[eq] = dt_q;
+   });
+}
+
+template<typename T, int DIM, int D1D, int Q1D, int L1D, int NBZ = 1> static
+void ForceMult2D(const int NE,
+                 const Array<double> &B_,
+                 const Array<double> &Bt_,
+                 const Array<double> &Gt_,
+                 const Memory<T> &sJit_,
+                 const Vector &x, Vector &y,
+                 const Array<int> *elems)
+{
+   auto b = Reshape(B_.Read(), Q1D, L1D);
+   auto bt = Reshape(Bt_.Read(), D1D, Q1D);
+   auto gt = Reshape(Gt_.Read(), D1D, Q1D);
+   const T *StressJinvT = Read(sJit_, Q1D*Q1D*NE*DIM*DIM);
+   auto sJit = Reshape(StressJinvT, Q1D, Q1D, DIM, DIM, NE);
+   auto energy = Reshape(x.Read(), L1D, L1D, NE);
+   const double eps1 = std::numeric_limits<double>::epsilon();
+   const double eps2 = eps1*eps1;
+   // With a list of zones, the other zones of y are left unchanged.
+   const int NEL = elems ? elems->Size() : NE;
+   const int *d_elems = elems ? elems->Read() : nullptr;
+   double *d_y = elems ? y.ReadWrite() : y.Write();
+   auto velocity = Reshape(d_y, D1D, D1D, DIM, NE);
+
+   MFEM_FORALL_2D(i, NEL, Q1D, Q1D, 1,
+   {
+      const int e = d_elems ? d_elems[i] : i;
+      const int z = MFEM_THREAD_ID(z);
+
+      MFEM_SHARED double B[Q1D][L1D];
+      MFEM_SHARED double Bt[D1D][Q1D];
+      MFEM_SHARED double Gt[D1D][Q1D];
+
+      MFEM_SHARED double Ez[NBZ][L1D][L1D];
+      double (*E)[L1D] = (double (*)[L1D])(Ez + z);
+
+      MFEM_SHARED double LQz[2][NBZ][D1D][Q1D];
+      double (*LQ0)[Q1D] = (double (*)[Q1D])(LQz[0] + z);
+      double (*LQ1)[Q1D] = (double (*)[Q1D])(LQz[1] + z);
+
+      MFEM_SHARED double QQz[3][NBZ][Q1D][Q1D];
+      double (*QQ)[Q1D] = (double (*)[Q1D])(QQz[0] + z);
+      double (*QQ0)[Q1D] = (double (*)[Q1D])(QQz[1] + z);
+      double (*QQ1)[Q1D] = (double (*)[Q1D])(QQz[2] + z);
+
+      if (z == 0)
+      {
+         MFEM_FOREACH_THREAD(q,x,Q1D)
+         {
+            MFEM_FOREACH_THREAD(l,y,Q1D)
+            {
+               if (l < L1D) { B[q][l] = b(q,l); }
+               if (l < D1D) { Bt[l][q] = bt(l,q); }
+               if (l < D1D) { Gt[l][q] = gt(l,q); }
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+
+      MFEM_FOREACH_THREAD(lx,x,L1D)
+      {
+         MFEM_FOREACH_THREAD(ly,y,L1D)
+         {
+            E[lx][ly] = energy(lx,ly,e);
+         }
+      }
+      MFEM_SYNC_THREAD;
+
+      MFEM_FOREACH_THREAD(ly,y,L1D)
+      {
+         MFEM_FOREACH_THREAD(qx,x,Q1D)
+         {
+            double u = 0.0;
+            for (int lx = 0; lx < L1D; ++lx)
+            {
+               u += B[qx][lx] * E[lx][ly];
+            }
+            LQ0[ly][qx] = u;
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(qy,y,Q1D)
+      {
+         MFEM_FOREACH_THREAD(qx,x,Q1D)
+         {
+            double u = 0.0;
+            for (int ly = 0; ly < L1D; ++ly)
+            {
+               u += B[qy][ly] * LQ0[ly][qx];
+            }
+            QQ[qy][qx] = u;
+         }
+      }
+      MFEM_SYNC_THREAD;
+
+      for (int c = 0; c < DIM; ++c)
+      {
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               const double esx = QQ[qy][qx] * sJit(qx,qy,0,c,e);
+               const double esy = QQ[qy][qx] * sJit(qx,qy,1,c,e);
+               QQ0[qy][qx] = esx;
+               QQ1[qy][qx] = esy;
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(dx,x,D1D)
+            {
+               double u = 0.0;
+               double v = 0.0;
+               for (int qx = 0; qx < Q1D; ++qx)
+               {
+                  u += Gt[dx][qx] * QQ0[qy][qx];
+                  v += Bt[dx][qx] * QQ1[qy][qx];
+               }
+               LQ0[dx][qy] = u;
+               LQ1[dx][qy] = v;
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(dy,y,D1D)
+         {
+            MFEM_FOREACH_THREAD(dx,x,D1D)
+            {
+               double u = 0.0;
+               double v = 0.0;
+               for (int qy = 0; qy < Q1D; ++qy)
+               {
+                  u += LQ0[dx][qy] * Bt[dy][qy];
+                  v += LQ1[dx][qy] * Gt[dy][qy];
+               }
+               velocity(dx,dy,c,e) = u + v;
+            }
+         }
+         MFEM_SYNC_THREAD;
+      }
+      for (int c = 0; c < DIM; ++c)
+      {
+         MFEM_FOREACH_THREAD(dy,y,D1D)
+         {
+            MFEM_FOREACH_THREAD(dx,x,D1D)
+            {
+               const double v = velocity(dx,dy,c,e);
+               if (fabs(v) < eps2)
+               {
+                  velocity(dx,dy,c,e) = 0.0;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+      }
+   });
+}
+
+template<typename T, int DIM, int D1D, int Q1D, int L1D> static
+void ForceMult3D(const int NE,
+                 const Array<double> &B_,
+                 const Array<double> &Bt_,
+                 const Array<double> &Gt_,
+                 const Memory<T> &sJit_,
+                 const Vector &x, Vector &y,
+                 const Array<int> *elems)
+{
+   auto b = Reshape(B_.Read(), Q1D, L1D);
+   auto bt = Reshape(Bt_.Read(), D1D, Q1D);
+   auto gt = Reshape(Gt_.Read(), D1D, Q1D);
+   const T *StressJinvT = Read(sJit_, Q1D*Q1D*Q1D*NE*DIM*DIM);
+   auto sJit = Reshape(StressJinvT, Q1D, Q1D, Q1D, DIM, DIM, NE);
+   auto energy = Reshape(x.Read(), L1D, L1D, L1D, NE);
+   const double eps1 = std::numeric_limits<double>::epsilon();
+   const double eps2 = eps1*eps1;
+   // With a list of zones, the other zones of y are left unchanged.
+   const int NEL = elems ? elems->Size() : NE;
+   const int *d_elems = elems ? elems->Read() : nullptr;
+   double *d_y = elems ? y.ReadWrite() : y.Write();
+   auto velocity = Reshape(d_y, D1D, D1D, D1D, DIM, NE);
+
+   MFEM_FORALL_3D(i, NEL, Q1D, Q1D, Q1D,
+   {
+      const int e = d_elems ? d_elems[i] : i;
+      const int z = MFEM_THREAD_ID(z);
+
+      MFEM_SHARED double B[Q1D][L1D];
+      MFEM_SHARED double Bt[D1D][Q1D];
+      MFEM_SHARED double Gt[D1D][Q1D];
+
+      MFEM_SHARED double E[L1D][L1D][L1D];
+
+      MFEM_SHARED double sm0[3][Q1D*Q1D*Q1D];
+      MFEM_SHARED double sm1[3][Q1D*Q1D*Q1D];
+
+      double (*MMQ0)[D1D][Q1D] = (double (*)[D1D][Q1D]) (sm0+0);
+      double (*MMQ1)[D1D][Q1D] = (double (*)[D1D][Q1D]) (sm0+1);
+      double (*MMQ2)[D1D][Q1D] = (double (*)[D1D][Q1D]) (sm0+2);
+
+      double (*MQQ0)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+0);
+      double (*MQQ1)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+1);
+      double (*MQQ2)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+2);
+
+      MFEM_SHARED double QQQ[Q1D][Q1D][Q1D];
+      double (*QQQ0)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm0+0);
+      double (*QQQ1)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm0+1);
+      double (*QQQ2)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm0+2);
+
+      if (z == 0)
+      {
+         MFEM_FOREACH_THREAD(q,x,Q1D)
+         {
+            MFEM_FOREACH_THREAD(l,y,Q1D)
+            {
+               if (l < L1D) { B[q][l] = b(q,l); }
+               if (l < D1D) { Bt[l][q] = bt(l,q); }
+               if (l < D1D) { Gt[l][q] = gt(l,q); }
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(lx,x,L1D)
+      {
+         MFEM_FOREACH_THREAD(ly,y,L1D)
+         {
+            MFEM_FOREACH_THREAD(lz,z,L1D)
+            {
+               E[lx][ly][lz] = energy(lx,ly,lz,e);
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(lz,z,L1D)
+      {
+         MFEM_FOREACH_THREAD(ly,y,L1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               double u = 0.0;
+               for (int lx = 0; lx < L1D; ++lx)
+               {
+                  u += B[qx][lx] * E[lx][ly][lz];
+               }
+               MMQ0[lz][ly][qx] = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(lz,z,L1D)
+      {
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               double u = 0.0;
+               for (int ly = 0; ly < L1D; ++ly)
+               {
+                  u += B[qy][ly] * MMQ0[lz][ly][qx];
+               }
+               MQQ0[lz][qy][qx] = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(qz,z,Q1D)
+      {
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               double u = 0.0;
+               for (int lz = 0; lz < L1D; ++lz)
+               {
+                  u += B[qz][lz] * MQQ0[lz][qy][qx];
+               }
+               QQQ[qz][qy][qx] = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      for (int c = 0; c < 3; ++c)
+      {
+         MFEM_FOREACH_THREAD(qz,z,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qy,y,Q1D)
+            {
+               MFEM_FOREACH_THREAD(qx,x,Q1D)
+               {
+                  const double esx = QQQ[qz][qy][qx] * sJit(qx,qy,qz,0,c,e);
+                  const double esy = QQQ[qz][qy][qx] * sJit(qx,qy,qz,1,c,e);
+                  const double esz = QQQ[qz][qy][qx] * sJit(qx,qy,qz,2,c,e);
+                  QQQ0[qz][qy][qx] = esx;
+                  QQQ1[qz][qy][qx] = esy;
+                  QQQ2[qz][qy][qx] = esz;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(qz,z,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qy,y,Q1D)
+            {
+               MFEM_FOREACH_THREAD(hx,x,D1D)
+               {
+                  double u = 0.0;
+                  double v = 0.0;
+                  double w = 0.0;
+                  for (int qx = 0; qx < Q1D; ++qx)
+                  {
+                     u += Gt[hx][qx] * QQQ0[qz][qy][qx];
+                     v += Bt[hx][qx] * QQQ1[qz][qy][qx];
+                     w += Bt[hx][qx] * QQQ2[qz][qy][qx];
+                  }
+                  MQQ0[hx][qy][qz] = u;
+                  MQQ1[hx][qy][qz] = v;
+                  MQQ2[hx][qy][qz] = w;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(qz,z,Q1D)
+         {
+            MFEM_FOREACH_THREAD(hy,y,D1D)
+            {
+               MFEM_FOREACH_THREAD(hx,x,D1D)
+               {
+                  double u = 0.0;
+                  double v = 0.0;
+                  double w = 0.0;
+                  for (int qy = 0; qy < Q1D; ++qy)
+                  {
+                     u += MQQ0[hx][qy][qz] * Bt[hy][qy];
+                     v += MQQ1[hx][qy][qz] * Gt[hy][qy];
+                     w += MQQ2[hx][qy][qz] * Bt[hy][qy];
+                  }
+                  MMQ0[hx][hy][qz] = u;
+                  MMQ1[hx][hy][qz] = v;
+                  MMQ2[hx][hy][qz] = w;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(hz,z,D1D)
+         {
+            MFEM_FOREACH_THREAD(hy,y,D1D)
+            {
+               MFEM_FOREACH_THREAD(hx,x,D1D)
+               {
+                  double u = 0.0;
+                  double v = 0.0;
+                  double w = 0.0;
+                  for (int qz = 0; qz < Q1D; ++qz)
+                  {
+                     u += MMQ0[hx][hy][qz] * Bt[hz][qz];
+                     v += MMQ1[hx][hy][qz] * Bt[hz][qz];
+                     w += MMQ2[hx][hy][qz] * Gt[hz][qz];
+                  }
+                  velocity(hx,hy,hz,c,e) = u + v + w;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+      }
+      for (int c = 0; c < 3; ++c)
+      {
+         MFEM_FOREACH_THREAD(hz,z,D1D)
+         {
+            MFEM_FOREACH_THREAD(hy,y,D1D)
+            {
+               MFEM_FOREACH_THREAD(hx,x,D1D)
+               {
+                  const double v = velocity(hx,hy,hz,c,e);
+                  if (fabs(v) < eps2)
+                  {
+                     velocity(hx,hy,hz,c,e) = 0.0;
+                  }
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+      }
+   });
+}
+
+// Generic version of ForceMult2D/3D for any D1D, Q1D and L1D. The energy is
+// first interpolated at the quadrature points in QE (size NQ x NE), then each
+// velocity dof is computed as a direct sum over the quadrature points.
+template<typename T, int DIM> static
+void ForceMultGeneric(const int NE, const int D1D, const int Q1D,
+                      const int L1D,
+                      const Array<double> &B_,
+                      const Array<double> &Bt_,
+                      const Array<double> &Gt_,
+                      const Memory<T> &sJit_,
+                      const Vector &x, Vector &QE_, Vector &y,
+                      const Array<int> *elems)
+{
+   const int NQ = (DIM == 2) ? Q1D*Q1D : Q1D*Q1D*Q1D;
+   const int ND = (DIM == 2) ? D1D*D1D : D1D*D1D*D1D;
+   const int NL = (DIM == 2) ? L1D*L1D : L1D*L1D*L1D;
+   auto b = Reshape(B_.Read(), Q1D, L1D);
+   auto bt = Reshape(Bt_.Read(), D1D, Q1D);
+   auto gt = Reshape(Gt_.Read(), D1D, Q1D);
+   auto sJit = Reshape(Read(sJit_, NQ*NE*DIM*DIM), NQ, DIM, DIM, NE);
+   auto energy = Reshape(x.Read(), NL, NE);
+   auto QE = Reshape(QE_.Write(), NQ, NE);
+   const double eps1 = std::numeric_limits<double>::epsilon();
+   const double eps2 = eps1*eps1;
+   const int NEL = elems ? elems->Size() : NE;
+   const int *d_elems = elems ? elems->Read() : nullptr;
+   double *d_y = elems ? y.ReadWrite() : y.Write();
+   auto velocity = Reshape(d_y, ND, DIM, NE);
+
+   MFEM_FORALL(i, NQ*NEL,
+   {
+      const int q = i % NQ, e = d_elems ? d_elems[i / NQ] : i / NQ;
+      const int qx = q % Q1D, qy = (q / Q1D) % Q1D, qz = q / (Q1D*Q1D);
+      double u = 0.0;
+      for (int l = 0; l < NL; ++l)
+      {
+         const int lx = l % L1D, ly = (l / L1D) % L1D, lz = l / (L1D*L1D);
+         double phi = b(qx,lx) * b(qy,ly);
+         if (DIM == 3) { phi *= b(qz,lz); }
+         u += phi * energy(l,e);
+      }
+      QE(q,e) = u;
+   });
+
+   MFEM_FORALL(i, ND*DIM*NEL,
+   {
+      const int d = i % ND, c = (i / ND) % DIM;
+      const int e = d_elems ? d_elems[i / (ND*DIM)] : i / (ND*DIM);
+      const int dx = d % D1D, dy = (d / D1D) % D1D, dz = d / (D1D*D1D);
+      double u = 0.0;
+      for (int q = 0; q < NQ; ++q)
+      {
+         const int qx = q % Q1D, qy = (q / Q1D) % Q1D, qz = q / (Q1D*Q1D);
+         const double bz = (DIM == 3) ? bt(dz,qz) : 1.0;
+         const double gz = (DIM == 3) ? gt(dz,qz) : 0.0;
+         double s = gt(dx,qx) * bt(dy,qy) * bz * sJit(q,0,c,e) +
+                    bt(dx,qx) * gt(dy,qy) * bz * sJit(q,1,c,e);
+         if (DIM == 3) { s += bt(dx,qx) * bt(dy,qy) * gz * sJit(q,2,c,e); }
+         u += s * QE(q,e);
+      }
+      velocity(d,c,e) = (fabs(u) < eps2) ? 0.0 : u;
+   });
+}
+
+template<typename T>
+using fForceMult = void (*)(const int E,
+                            const Array<double> &B,
+                            const Array<double> &Bt,
+                            const Array<double> &Gt,
+                            const Memory<T> &stressJinvT,
+                            const Vector &X, Vector &Y,
+                            const Array<int> *elems);
+
+template<typename T>
+static void ForceMultT(const int DIM, const int D1D, const int Q1D,
+                       const int L1D, const int H1D, const int NE,
+                       const Array<double> &B,
+                       const Array<double> &Bt,
+                       const Array<double> &Gt,
+                       const Memory<T> &stressJinvT,
+                       const Vector &e,
+                       Vector &QE,
+                       Vector &v,
+                       const Array<int> *elems)
+{
+   MFEM_VERIFY(D1D==H1D, "D1D!=H1D");
+   const int id = ((DIM)<<8)|(D1D)<<4|(Q1D);
+   static std::unordered_map<int, fForceMult<T>> call =
+   {
+      // 2D
+      {0x234,&ForceMult2D<T,2,3,4,2>},
+      {0x246,&ForceMult2D<T,2,4,6,3>},
+      {0x258,&ForceMult2D<T,2,5,8,4>},
+      // 3D
+      {0x334,&ForceMult3D<T,3,3,4,2>},
+      {0x346,&ForceMult3D<T,3,4,6,3>},
+      {0x358,&ForceMult3D<T,3,5,8,4>},
+   };
+   // The tensor kernels are instantiated only for L1D = D1D-1.
+   if (L1D == D1D-1 && call[id])
+   {
+      return call[id](NE, B, Bt, Gt, stressJinvT, e, v, elems);
+   }
+   if (DIM == 2)
+   {
+      return ForceMultGeneric<T,2>(NE, D1D, Q1D, L1D, B, Bt, Gt,
+                                   stressJinvT, e, QE, v, elems);
+   }
+   if (DIM == 3)
+   {
+      return ForceMultGeneric<T,3>(NE, D1D, Q1D, L1D, B, Bt, Gt,
+                                   stressJinvT, e, QE, v, elems);
+   }
+   MFEM_ABORT("Unknown kernel");
+}
+
+template<typename T, int DIM, int D1D, int Q1D, int L1D, int NBZ = 1> static
+void ForceMultTranspose2D(const int NE,
+                          const Array<double> &Bt_,
+                          const Array<double> &B_,
+                          const Array<double> &G_,
+                          const Memory<T> &sJit_,
+                          const Vector &x, Vector &y)
+{
+   auto b = Reshape(B_.Read(), Q1D, D1D);
+   auto g = Reshape(G_.Read(), Q1D, D1D);
+   auto bt = Reshape(Bt_.Read(), L1D, Q1D);
+   const T *StressJinvT = Read(sJit_, Q1D*Q1D*NE*DIM*DIM);
+   auto sJit = Reshape(StressJinvT, Q1D, Q1D, DIM, DIM, NE);
+   auto velocity = Reshape(x.Read(), D1D, D1D, DIM, NE);
+   auto energy = Reshape(y.Write(), L1D, L1D, NE);
+
+   MFEM_FORALL_2D(e, NE, Q1D, Q1D, NBZ,
+   {
+      const int z = MFEM_THREAD_ID(z);
+
+      MFEM_SHARED double Bt[L1D][Q1D];
+      MFEM_SHARED double B[Q1D][D1D];
+      MFEM_SHARED double G[Q1D][D1D];
+
+      MFEM_SHARED double Vz[NBZ][D1D*D1D];
+      double (*V)[D1D] = (double (*)[D1D])(Vz + z);
+
+      MFEM_SHARED double DQz[DIM][NBZ][D1D*Q1D];
+      double (*DQ0)[Q1D] = (double (*)[Q1D])(DQz[0] + z);
+      double (*DQ1)[Q1D] = (double (*)[Q1D])(DQz[1] + z);
+
+      MFEM_SHARED double QQz[3][NBZ][Q1D*Q1D];
+      double (*QQ)[Q1D] = (double (*)[Q1D])(QQz[0] + z);
+      double (*QQ0)[Q1D] = (double (*)[Q1D])(QQz[1] + z);
+      double (*QQ1)[Q1D] = (double (*)[Q1D])(QQz[2] + z);
+
+      MFEM_SHARED double QLz[NBZ][Q1D*L1D];
+      double (*QL)[L1D] = (double (*)[L1D]) (QLz + z);
+
+      if (z == 0)
+      {
+         MFEM_FOREACH_THREAD(q,x,Q1D)
+         {
+            MFEM_FOREACH_THREAD(h,y,Q1D)
+            {
+               if (h < D1D) { B[q][h] = b(q,h); }
+               if (h < D1D) { G[q][h] = g(q,h); }
+               const int l = h;
+               if (l < L1D) { Bt[l][q] = bt(l,q); }
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(qy,y,Q1D)
+      {
+         MFEM_FOREACH_THREAD(qx,x,Q1D)
+         {
+            QQ[qy][qx] = 0.0;
+         }
+      }
+      MFEM_SYNC_THREAD;
+
+      for (int c = 0; c < DIM; ++c)
+      {
+
+         MFEM_FOREACH_THREAD(dx,x,D1D)
+         {
+            MFEM_FOREACH_THREAD(dy,y,D1D)
+            {
+               V[dx][dy] = velocity(dx,dy,c,e);
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(dy,y,D1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               double u = 0.0;
+               double v = 0.0;
+               for (int dx = 0; dx < D1D; ++dx)
+               {
+                  const double input = V[dx][dy];
+                  u += B[qx][dx] * input;
+                  v += G[qx][dx] * input;
+               }
+               DQ0[dy][qx] = u;
+               DQ1[dy][qx] = v;
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               double u = 0.0;
+               double v = 0.0;
+               for (int dy = 0; dy < D1D; ++dy)
+               {
+                  u += DQ1[dy][qx] * B[qy][dy];
+                  v += DQ0[dy][qx] * G[qy][dy];
+               }
+               QQ0[qy][qx] = u;
+               QQ1[qy][qx] = v;
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               const double esx = QQ0[qy][qx] * sJit(qx,qy,0,c,e);
+               const double esy = QQ1[qy][qx] * sJit(qx,qy,1,c,e);
+               QQ[qy][qx] += esx + esy;
+            }
+         }
+         MFEM_SYNC_THREAD;
+      }
+      MFEM_SYNC_THREAD;
+
+      MFEM_FOREACH_THREAD(qy,y,Q1D)
+      {
+         MFEM_FOREACH_THREAD(lx,x,L1D)
+         {
+            double u = 0.0;
+            for (int qx = 0; qx < Q1D; ++qx)
+            {
+               u += QQ[qy][qx] * Bt[lx][qx];
+            }
+            QL[qy][lx] = u;
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(ly,y,L1D)
+      {
+         MFEM_FOREACH_THREAD(lx,x,L1D)
+         {
+            double u = 0.0;
+            for (int qy = 0; qy < Q1D; ++qy)
+            {
+               u += QL[qy][lx] * Bt[ly][qy];
+            }
+            energy(lx,ly,e) = u;
+         }
+      }
+      MFEM_SYNC_THREAD;
+   });
+}
+
+template<typename T, int DIM, int D1D, int Q1D, int L1D> static
+void ForceMultTranspose3D(const int NE,
+                          const Array<double> &Bt_,
+                          const Array<double> &B_,
+                          const Array<double> &G_,
+                          const Memory<T> &sJit_,
+                          const Vector &v_,
+                          Vector &e_)
+{
+   auto b = Reshape(B_.Read(), Q1D, D1D);
+   auto g = Reshape(G_.Read(), Q1D, D1D);
+   auto bt = Reshape(Bt_.Read(), L1D, Q1D);
+   const T *StressJinvT = Read(sJit_, Q1D*Q1D*Q1D*NE*DIM*DIM);
+   auto sJit = Reshape(StressJinvT, Q1D, Q1D, Q1D, DIM, DIM, NE);
+   auto velocity = Reshape(v_.Read(), D1D, D1D, D1D, DIM, NE);
+   auto energy = Reshape(e_.Write(), L1D, L1D, L1D, NE);
+
+   MFEM_FORALL_3D(e, NE, Q1D, Q1D, Q1D,
+   {
+      const int z = MFEM_THREAD_ID(z);
+
+      MFEM_SHARED double Bt[L1D][Q1D];
+      MFEM_SHARED double B[Q1D][D1D];
+      MFEM_SHARED double G[Q1D][D1D];
+
+      MFEM_SHARED double sm0[3][Q1D*Q1D*Q1D];
+      MFEM_SHARED double sm1[3][Q1D*Q1D*Q1D];
+      double (*V)[D1D][D1D]    = (double (*)[D1D][D1D]) (sm0+0);
+      double (*MMQ0)[D1D][Q1D] = (double (*)[D1D][Q1D]) (sm0+1);
+      double (*MMQ1)[D1D][Q1D] = (double (*)[D1D][Q1D]) (sm0+2);
+
+      double (*MQQ0)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+0);
+      double (*MQQ1)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+1);
+      double (*MQQ2)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+2);
+
+      double (*QQQ0)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm0+0);
+      double (*QQQ1)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm0+1);
+      double (*QQQ2)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm0+2);
+
+      MFEM_SHARED double QQQ[Q1D][Q1D][Q1D];
+
+      if (z == 0)
+      {
+         MFEM_FOREACH_THREAD(q,x,Q1D)
+         {
+            MFEM_FOREACH_THREAD(h,y,Q1D)
+            {
+               if (h < D1D) { B[q][h] = b(q,h); }
+               if (h < D1D) { G[q][h] = g(q,h); }
+               const int l = h;
+               if (l < L1D) { Bt[l][q] = bt(l,q); }
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(qz,z,Q1D)
+      {
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               QQQ[qz][qy][qx] = 0.0;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+
+      for (int c = 0; c < DIM; ++c)
+      {
+         MFEM_FOREACH_THREAD(dx,x,D1D)
+         {
+            MFEM_FOREACH_THREAD(dy,y,D1D)
+            {
+               MFEM_FOREACH_THREAD(dz,z,D1D)
+               {
+                  V[dx][dy][dz] = velocity(dx,dy,dz,c,e);
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(dz,z,D1D)
+         {
+            MFEM_FOREACH_THREAD(dy,y,D1D)
+            {
+               MFEM_FOREACH_THREAD(qx,x,Q1D)
+               {
+                  double u = 0.0;
+                  double v = 0.0;
+                  for (int dx = 0; dx < D1D; ++dx)
+                  {
+                     const double input = V[dx][dy][dz];
+                     u += G[qx][dx] * input;
+                     v += B[qx][dx] * input;
+                  }
+                  MMQ0[dz][dy][qx] = u;
+                  MMQ1[dz][dy][qx] = v;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(dz,z,D1D)
+         {
+            MFEM_FOREACH_THREAD(qy,y,Q1D)
+            {
+               MFEM_FOREACH_THREAD(qx,x,Q1D)
+               {
+                  double u = 0.0;
+                  double v = 0.0;
+                  double w = 0.0;
+                  for (int dy = 0; dy < D1D; ++dy)
+                  {
+                     u += MMQ0[dz][dy][qx] * B[qy][dy];
+                     v += MMQ1[dz][dy][qx] * G[qy][dy];
+                     w += MMQ1[dz][dy][qx] * B[qy][dy];
+                  }
+                  MQQ0[dz][qy][qx] = u;
+                  MQQ1[dz][qy][qx] = v;
+                  MQQ2[dz][qy][qx] = w;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(qz,z,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qy,y,Q1D)
+            {
+               MFEM_FOREACH_THREAD(qx,x,Q1D)
+               {
+                  double u = 0.0;
+                  double v = 0.0;
+                  double w = 0.0;
+                  for (int dz = 0; dz < D1D; ++dz)
+                  {
+                     u += MQQ0[dz][qy][qx] * B[qz][dz];
+                     v += MQQ1[dz][qy][qx] * B[qz][dz];
+                     w += MQQ2[dz][qy][qx] * G[qz][dz];
+                  }
+                  QQQ0[qz][qy][qx] = u;
+                  QQQ1[qz][qy][qx] = v;
+                  QQQ2[qz][qy][qx] = w;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(qz,z,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qy,y,Q1D)
+            {
+               MFEM_FOREACH_THREAD(qx,x,Q1D)
+               {
+                  const double esx = QQQ0[qz][qy][qx] * sJit(qx,qy,qz,0,c,e);
+                  const double esy = QQQ1[qz][qy][qx] * sJit(qx,qy,qz,1,c,e);
+                  const double esz = QQQ2[qz][qy][qx] * sJit(qx,qy,qz,2,c,e);
+                  QQQ[qz][qy][qx] += esx + esy + esz;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(qz,z,Q1D)
+      {
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(lx,x,L1D)
+            {
+               double u = 0.0;
+               for (int qx = 0; qx < Q1D; ++qx)
+               {
+                  u += QQQ[qz][qy][qx] * Bt[lx][qx];
+               }
+               MQQ0[qz][qy][lx] = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(qz,z,Q1D)
+      {
+         MFEM_FOREACH_THREAD(ly,y,L1D)
+         {
+            MFEM_FOREACH_THREAD(lx,x,L1D)
+            {
+               double u = 0.0;
+               for (int qy = 0; qy < Q1D; ++qy)
+               {
+                  u += MQQ0[qz][qy][lx] * Bt[ly][qy];
+               }
+               MMQ0[qz][ly][lx] = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(lz,z,L1D)
+      {
+         MFEM_FOREACH_THREAD(ly,y,L1D)
+         {
+            MFEM_FOREACH_THREAD(lx,x,L1D)
+            {
+               double u = 0.0;
+               for (int qz = 0; qz < Q1D; ++qz)
+               {
+                  u += MMQ0[qz][ly][lx] * Bt[lz][qz];
+               }
+               energy(lx,ly,lz,e) = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+   });
+}
+
+// Generic version of ForceMultTranspose2D/3D for any D1D, Q1D and L1D. The
+// contraction of the velocity gradient with the stress is first stored in QQ
+// (size NQ x NE), then each energy dof is computed as a direct sum over the
+// quadrature points.
+template<typename T, int DIM> static
+void ForceMultTransposeGeneric(const int NE, const int D1D, const int Q1D,
+                               const int L1D,
+                               const Array<double> &Bt_,
+                               const Array<double> &B_,
+                               const Array<double> &G_,
+                               const Memory<T> &sJit_,
+                               const Vector &v_, Vector &QQ_, Vector &e_)
+{
+   const int NQ = (DIM == 2) ? Q1D*Q1D : Q1D*Q1D*Q1D;
+   const int ND = (DIM == 2) ? D1D*D1D : D1D*D1D*D1D;
+   const int NL = (DIM == 2) ? L1D*L1D : L1D*L1D*L1D;
+   auto b = Reshape(B_.Read(), Q1D, D1D);
+   auto g = Reshape(G_.Read(), Q1D, D1D);
+   auto bt = Reshape(Bt_.Read(), L1D, Q1D);
+   auto sJit = Reshape(Read(sJit_, NQ*NE*DIM*DIM), NQ, DIM, DIM, NE);
+   auto velocity = Reshape(v_.Read(), ND, DIM, NE);
+   auto QQ = Reshape(QQ_.Write(), NQ, NE);
+   auto energy = Reshape(e_.Write(), NL, NE);
+
+   MFEM_FORALL(i, NQ*NE,
+   {
+      const int q = i % NQ, e = i / NQ;
+      const int qx = q % Q1D, qy = (q / Q1D) % Q1D, qz = q / (Q1D*Q1D);
+      double u = 0.0;
+      for (int d = 0; d < ND; ++d)
+      {
+         const int dx = d % D1D, dy = (d / D1D) % D1D, dz = d / (D1D*D1D);
+         const double bz = (DIM == 3) ? b(qz,dz) : 1.0;
+         const double gz = (DIM == 3) ? g(qz,dz) : 0.0;
+         const double g0 = g(qx,dx) * b(qy,dy) * bz;
+         const double g1 = b(qx,dx) * g(qy,dy) * bz;
+         const double g2 = b(qx,dx) * b(qy,dy) * gz;
+         for (int c = 0; c < DIM; ++c)
+         {
+            double s = g0 * sJit(q,0,c,e) + g1 * sJit(q,1,c,e);
+            if (DIM == 3) { s += g2 * sJit(q,2,c,e); }
+            u += s * velocity(d,c,e);
+         }
+      }
+      QQ(q,e) = u;
+   });
+
+   MFEM_FORALL(i, NL*NE,
+   {
+      const int l = i % NL, e = i / NL;
+      const int lx = l % L1D, ly = (l / L1D) % L1D, lz = l / (L1D*L1D);
+      double u = 0.0;
+      for (int q = 0; q < NQ; ++q)
+      {
+         const int qx = q % Q1D, qy = (q / Q1D) % Q1D, qz = q / (Q1D*Q1D);
+         double phi = bt(lx,qx) * bt(ly,qy);
+         if (DIM == 3) { phi *= bt(lz,qz); }
+         u += phi * QQ(q,e);
+      }
+      energy(l,e) = u;
+   });
+}
+
+template<typename T>
+using fForceMultTranspose = void (*)(const int NE,
+                                     const Array<double> &Bt,
+                                     const Array<double> &B,
+                                     const Array<double> &G,
+                                     const Memory<T> &sJit,
+                                     const Vector &X, Vector &Y);
+
+template<typename T>
+static void ForceMultTransposeT(const int DIM, const int D1D, const int Q1D,
+                                const int L1D, const int NE,
+                                const Array<double> &L2Bt,
+                                const Array<double> &H1B,
+                                const Array<double> &H1G,
+                                const Memory<T> &stressJinvT,
+                                const Vector &v,
+                                Vector &QQ,
+                                Vector &e)
+{
+   const int id = ((DIM)<<8)|(D1D)<<4|(Q1D);
+   static std::unordered_map<int, fForceMultTranspose<T>> call =
+   {
+      {0x234,&ForceMultTranspose2D<T,2,3,4,2>},
+      {0x246,&ForceMultTranspose2D<T,2,4,6,3>},
+      {0x258,&ForceMultTranspose2D<T,2,5,8,4>},
+      {0x334,&ForceMultTranspose3D<T,3,3,4,2>},
+      {0x346,&ForceMultTranspose3D<T,3,4,6,3>},
+      {0x358,&ForceMultTranspose3D<T,3,5,8,4>}
+   };
+   // DIM, D1D, Q1D, L1D(=D1D-1)
+   if (L1D == D1D-1 && call[id])
+   {
+      return call[id](NE, L2Bt, H1B, H1G, stressJinvT, v, e);
+   }
+   if (DIM == 2)
+   {
+      return ForceMultTransposeGeneric<T,2>(NE, D1D, Q1D, L1D, L2Bt, H1B, H1G,
+                                            stressJinvT, v, QQ, e);
+   }
+   if (DIM == 3)
+   {
+      return ForceMultTransposeGeneric<T,3>(NE, D1D, Q1D, L1D, L2Bt, H1B, H1G,
+                                            stressJinvT, v, QQ, e);
+   }
+   MFEM_ABORT("Unknown kernel");
+}
+
+// Action of the mass matrix with the point weights rho0DetJ0w (NQ x NE) on the
+// VDIM components of a lexicographic H1 E-vector (ND x VDIM x NE), for any D1D
+// and Q1D. The weighted values at the quadrature points are first stored in
+// QX (size NQ x VDIM x NE), then each dof is computed as a direct sum over the
+// quadrature points, as in ForceMultGeneric.
+template<int DIM> static
+void MassMultGeneric(const int NE, const int VDIM, const int D1D,
+                     const int Q1D,
+                     const Array<double> &B_,
+                     const Array<double> &Bt_,
+                     const Vector &rho0DetJ0w,
+                     const Vector &x, Vector &QX_, Vector &y)
+{
+   const int NQ = (DIM == 2) ? Q1D*Q1D : Q1D*Q1D*Q1D;
+   const int ND = (DIM == 2) ? D1D*D1D : D1D*D1D*D1D;
+   auto b = Reshape(B_.Read(), Q1D, D1D);
+   auto bt = Reshape(Bt_.Read(), D1D, Q1D);
+   auto W = Reshape(rho0DetJ0w.Read(), NQ, NE);
+   auto X = Reshape(x.Read(), ND, VDIM, NE);
+   auto QX = Reshape(QX_.Write(), NQ, VDIM, NE);
+   auto Y = Reshape(y.Write(), ND, VDIM, NE);
+
+   MFEM_FORALL(i, NQ*VDIM*NE,
+   {
+      const int q = i % NQ, c = (i / NQ) % VDIM, e = i / (NQ*VDIM);
+      const int qx = q % Q1D, qy = (q / Q1D) % Q1D, qz = q / (Q1D*Q1D);
+      double u = 0.0;
+      for (int d = 0; d < ND; ++d)
+      {
+         const int dx = d % D1D, dy = (d / D1D) % D1D, dz = d / (D1D*D1D);
+         double phi = b(qx,dx) * b(qy,dy);
+         if (DIM == 3) { phi *= b(qz,dz); }
+         u += phi * X(d,c,e);
+      }
+      QX(q,c,e) = W(q,e) * u;
+   });
+
+   MFEM_FORALL(i, ND*VDIM*NE,
+   {
+      const int d = i % ND, c = (i / ND) % VDIM, e = i / (ND*VDIM);
+      const int dx = d % D1D, dy = (d / D1D) % D1D, dz = d / (D1D*D1D);
+      double u = 0.0;
+      for (int q = 0; q < NQ; ++q)
+      {
+         const int qx = q % Q1D, qy = (q / Q1D) % Q1D, qz = q / (Q1D*Q1D);
+         double phi = bt(dx,qx) * bt(dy,qy);
+         if (DIM == 3) { phi *= bt(dz,qz); }
+         u += phi * QX(q,c,e);
+      }
+      Y(d,c,e) = u;
+   });
+}
+
+static inline void MassMult(const int DIM, const int NE, const int VDIM,
+                            const int D1D, const int Q1D,
+                            const Array<double> &B,
+                            const Array<double> &Bt,
+                            const Vector &rho0DetJ0w,
+                            const Vector &x, Vector &QX, Vector &y)
+{
+   if (DIM == 2)
+   {
+      return MassMultGeneric<2>(NE, VDIM, D1D, Q1D, B, Bt, rho0DetJ0w,
+                                x, QX, y);
+   }
+   if (DIM == 3)
+   {
+      return MassMultGeneric<3>(NE, VDIM, D1D, Q1D, B, Bt, rho0DetJ0w,
+                                x, QX, y);
+   }
+   MFEM_ABORT("Unknown kernel");
+}
+
+} // namespace hydrodynamics
+
+} // namespace mfem
+
+#endif // MFEM_LAGHOS_PA_KERNELS
@@ -16,9 +16,23 @@
 
 #include "general/forall.hpp"
 #include "laghos_solver.hpp"
+#include "laghos_pa_kernels.hpp"
 #include "linalg/kernels.hpp"
+#include <algorithm>
+#include <fstream>
+#include <set>
 #include <unordered_map>
 
+#ifdef LAGHOS_USE_NVTX
+#include <nvToolsExt.h>
+#endif
+#ifdef LAGHOS_USE_ROCTX
+#include <roctx.h>
+#endif
+#ifdef LAGHOS_USE_CALIPER
+#include <caliper/cali.h>
+#endif
+
 #ifdef MFEM_USE_MPI
 
 namespace mfem
@@ -88,6 +102,8 @@ static void Rho0DetJ0Vol(const int dim, const int NE,
                          QuadratureData &qdata,
                          double &volume);
 
+static void CompactJac0inv(DenseTensor &Jac0inv);
+
 LagrangianHydroOperator::LagrangianHydroOperator(const int size,
                                                  ParFiniteElementSpace &h1,
                                                  ParFiniteElementSpace &l2,
@@ -103,7 +119,17 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
                                                  const double cgt,
                                                  const int cgiter,
                                                  double ftz,
-                                                 const int oq) :
+                                                 const int oq,
+                                                 const bool bcg,
+                                                 const bool ff,
+                                                 const bool eli,
+                                                 const bool fo,
+                                                 const bool ph,
+                                                 const int cgs,
+                                                 const bool cgw,
+                                                 const bool mp,
+                                                 const bool restart,
+                                                 const EOSTable *eos_table) :
    TimeDependentOperator(size),
    H1(h1), L2(l2), H1c(H1.GetParMesh(), H1.FEColl(), 1),
    pmesh(H1.GetParMesh()),
@@ -124,22 +150,37 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
    use_viscosity(visc),
    use_vorticity(vort),
    p_assembly(p_assembly),
+   block_cg(bcg),
+   fused_force(false),
+   force_overlap(false),
+   e_local_inv(!p_assembly || eli),
    cg_rel_tol(cgt), cg_max_iter(cgiter),ftz_tol(ftz),
    gamma_gf(gamma_gf),
-   Mv(&H1), Mv_spmat_copy(),
+   Mv(&H1), Mv_spmat_copy(), Mv_A(), Mv_prec(),
+   cg_warm_start(cgw),
+   dv_prev(cgw ? H1Vsize : 0),
    Me(l2dofs_cnt, l2dofs_cnt, NE),
    Me_inv(l2dofs_cnt, l2dofs_cnt, NE),
    ir(IntRules.Get(pmesh->GetElementBaseGeometry(0),
                    (oq > 0) ? oq : 3 * H1.GetOrder(0) + L2.GetOrder(0) - 1)),
    Q1D(int(floor(0.7 + pow(ir.GetNPoints(), 1.0 / dim)))),
-   qdata(dim, NE, ir.GetNPoints()),
+   qdata(dim, NE, ir.GetNPoints(), p_assembly && dim > 1 && mp),
    qdata_is_current(false),
    forcemat_is_assembled(false),
+   forces_are_current(false),
+   dt_est_reduced(false),
+   dt_est_loc(0.0), dt_est_glob(0.0),
+   dt_est_req(MPI_REQUEST_NULL),
    Force(&L2, &H1),
    ForcePA(nullptr), VMassPA(nullptr), EMassPA(nullptr),
    VMassPA_Jprec(nullptr),
+   HaloP(nullptr), HaloPv(nullptr),
+   EMassInv(nullptr),
    CG_VMass(H1.GetParMesh()->GetComm()),
    CG_EMass(L2.GetParMesh()->GetComm()),
+   PCG_VMass(H1.GetParMesh()->GetComm()),
+   VMassCG(nullptr),
+   BlockCG_VMass(nullptr),
    timer(p_assembly ? L2TVSize : 1),
    qupdate(nullptr),
    X(H1c.GetTrueVSize()),
@@ -148,7 +189,11 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
    rhs(H1Vsize),
    e_rhs(L2Vsize),
    rhs_c_gf(&H1c),
-   dvc_gf(&H1c)
+   dvc_gf(&H1c),
+   fa_batch(16),
+   e_source_coeff(nullptr),
+   e_source(nullptr),
+   eos_table(eos_table)
 {
    block_offsets[0] = 0;
    block_offsets[1] = block_offsets[0] + H1Vsize;
@@ -156,13 +201,39 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
    block_offsets[3] = block_offsets[2] + L2Vsize;
    one.UseDevice(true);
    one = 1.0;
+   dv_prev.UseDevice(true);
+   dv_prev = 0.0;
 
    if (p_assembly)
    {
       qupdate = new QUpdate(dim, NE, Q1D, visc, vort, cfl,
-                            &timer, gamma_gf, ir, H1, L2);
+                            &timer, gamma_gf, ir, H1, L2,
+                            GetMaterialEOS(eos_table, true));
       ForcePA = new ForcePAOperator(qdata, H1, L2, ir);
-      VMassPA = new MassPAOperator(H1c, ir, rho0_coeff);
+      // The fused kernels are not available for all orders, in which case
+      // the forces are computed by ForcePA.
+      fused_force = ff && dim > 1 && qupdate->HasForceKernel();
+      if (ff && !fused_force && H1.GetMyRank() == 0)
+      {
+         mfem::out << "Fused force kernel is not available, "
+                   << "using the ForcePA operator." << std::endl;
+      }
+      // The overlapped exchange works on host memory and conforming meshes.
+      force_overlap = fo && !Device::Allows(Backend::DEVICE_MASK) &&
+                      !pmesh->Nonconforming();
+      if (fo && !force_overlap && H1.GetMyRank() == 0)
+      {
+         mfem::out << "Force overlap is not available, "
+                   << "using the ForcePA operator." << std::endl;
+      }
+      if (force_overlap) { rhs_tdofs.SetSize(H1TVSize); }
+      // The velocity exchanges (mass action and the RHS/solution transfers)
+      // use the persistent requests on conforming meshes.
+      if (ph && !pmesh->Nonconforming())
+      {
+         HaloP = new PersistentProlongationOperator(H1c);
+      }
+      VMassPA = new MassPAOperator(H1c, ir, rho0_coeff, HaloP);
       EMassPA = new MassPAOperator(L2, ir, rho0_coeff);
       // Inside the above constructors for mass, there is reordering of the mesh
       // nodes which is performed on the host. Since the mesh nodes are a
@@ -187,27 +258,128 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
    }
    else
    {
-      // Standard local assembly and inversion for energy mass matrices.
-      // 'Me' is used in the computation of the internal energy
-      // which is used twice: once at the start and once at the end of the run.
-      MassIntegrator mi(rho0_coeff, &ir);
-      for (int e = 0; e < NE; e++)
-      {
-         DenseMatrixInverse inv(&Me(e));
-         const FiniteElement &fe = *L2.GetFE(e);
-         ElementTransformation &Tr = *L2.GetElementTransformation(e);
-         mi.AssembleElementMatrix(fe, Tr, Me(e));
-         inv.Factor();
-         inv.GetInverseMatrix(Me_inv(e));
-      }
       // Standard assembly for the velocity mass matrix.
       VectorMassIntegrator *vmi = new VectorMassIntegrator(rho0_coeff, &ir);
       Mv.AddDomainIntegrator(vmi);
       Mv.Assemble();
       Mv_spmat_copy = Mv.SpMat();
+      // Mv is constant in time, so the parallel matrix with the eliminated
+      // essential dofs is formed once. The later calls of FormLinearSystem()
+      // only transform and eliminate the right-hand side.
+      Mv.FormSystemMatrix(ess_tdofs, Mv_A);
+   }
+
+   // On restart, the time-zero data is read from the checkpoint instead, as
+   // it would require the initial density projection.
+   if (!restart) { InitQuadratureData(rho0_gf); }
+
+   // Local inverses of the energy mass matrices, formed from the time-zero
+   // data. In partial assembly mode, this replaces the global CG energy
+   // solve. On restart, they are formed by TimeZeroDataRestored().
+   if (e_local_inv && !restart) { AssembleEnergyMassInverses(); }
+
+   if (dim == 1 || !p_assembly)
+   {
+      // Reference shape functions for the 1D/FA quadrature update.
+      const FiniteElement &h1_fe = *H1.GetFE(0);
+      const FiniteElement &l2_fe = *L2.GetFE(0);
+      const int nqp = ir.GetNPoints();
+      fa_dshape.SetSize(h1dofs_cnt, dim, nqp);
+      fa_shape.SetSize(l2dofs_cnt, nqp);
+      Vector shape;
+      for (int q = 0; q < nqp; q++)
+      {
+         const IntegrationPoint &ip = ir.IntPoint(q);
+         h1_fe.CalcDShape(ip, fa_dshape(q));
+         fa_shape.GetColumnReference(q, shape);
+         l2_fe.CalcShape(ip, shape);
+      }
+   }
+
+   switch (cgs)
+   {
+      case 0: VMassCG = &CG_VMass; break;
+      case 1: VMassCG = &PCG_VMass; break;
+      default: MFEM_ABORT("Unknown velocity CG solver type!");
+   }
+   VMassCG->SetRelTol(cg_rel_tol);
+   VMassCG->SetAbsTol(0.0);
+   VMassCG->SetMaxIter(cg_max_iter);
+   VMassCG->SetPrintLevel(-1);
+
+   if (p_assembly)
+   {
+      // Setup the preconditioner of the velocity mass operator.
+      // BC are handled by the VMassPA, so ess_tdofs here can be empty.
+      Array<int> empty_tdofs;
+      VMassPA_Jprec = new OperatorJacobiSmoother(VMassPA->GetBF(), empty_tdofs);
+      VMassCG->SetPreconditioner(*VMassPA_Jprec);
+      VMassCG->SetOperator(*VMassPA);
+
+      if (block_cg)
+      {
+         // The byNODES true dofs of H1 are the components of the H1c ones,
+         // i.e., the layout of the BlockCG multivectors.
+         const Operator *Pv = H1.GetProlongationMatrix();
+         if (HaloP)
+         {
+            HaloPv = new PersistentProlongationOperator(H1);
+            Pv = HaloPv;
+         }
+         BlockCG_VMass = new BlockCGSolver(H1.GetParMesh()->GetComm(), dim,
+                                           H1c.GetTrueVSize(), *VMassPA, *Pv,
+                                           *VMassPA_Jprec, c_tdofs);
+         BlockCG_VMass->SetRelTol(cg_rel_tol);
+         BlockCG_VMass->SetRhsRelTol(cg_warm_start);
+         BlockCG_VMass->SetMaxIter(cg_max_iter);
+         BX.SetSize(dim * H1c.GetTrueVSize());
+         BB.SetSize(dim * H1c.GetTrueVSize());
+         BX.UseDevice(true);
+         BB.UseDevice(true);
+      }
+
+      CG_EMass.SetOperator(*EMassPA);
+      CG_EMass.iterative_mode = false;
+      CG_EMass.SetRelTol(cg_rel_tol);
+      CG_EMass.SetAbsTol(0.0);
+      CG_EMass.SetMaxIter(cg_max_iter);
+      CG_EMass.SetPrintLevel(-1);
+   }
+   else
+   {
+      Mv_prec.SetType(HypreSmoother::Jacobi, 1);
+      VMassCG->SetPreconditioner(Mv_prec);
+      VMassCG->SetOperator(*Mv_A);
+
+      ForceIntegrator *fi = new ForceIntegrator(qdata);
+      fi->SetIntRule(&ir);
+      Force.AddDomainIntegrator(fi);
+      // Make a dummy assembly to figure out the sparsity.
+      Force.Assemble(0);
+      Force.Finalize(0);
+   }
+
+   if (source_type == 1) // 2D Taylor-Green.
+   {
+      e_source_coeff = new TaylorCoefficient;
+      e_source = new LinearForm(&L2);
+      e_source->AddDomainIntegrator(new DomainLFIntegrator(*e_source_coeff,
+                                                           &ir));
    }
+   if (source_type == 2) // Rayleigh-Taylor.
+   {
+      accel_src_gf.SetSpace(&H1);
+      RTCoefficient accel_coeff(dim);
+      accel_src_gf.ProjectCoefficient(accel_coeff);
+      accel_src_gf.Read();
+      AssembleAccelerationSource();
+   }
+}
 
-   // Values of rho0DetJ0 and Jac0inv at all quadrature points.
+// Values of rho0DetJ0 and Jac0inv at all quadrature points, and the initial
+// local mesh size. These are computed on the initial mesh.
+void LagrangianHydroOperator::InitQuadratureData(ParGridFunction &rho0_gf)
+{
    // Initial local mesh size (assumes all mesh elements are the same).
    int Ne, ne = NE;
    double Volume, vol = 0.0;
@@ -217,8 +389,10 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
    }
    else
    {
+      H1.GetParMesh()->GetNodes()->HostRead();
       const int NQ = ir.GetNPoints();
       Vector rho_vals(NQ);
+      DenseMatrix Jac0inv_q(dim);
       for (int e = 0; e < NE; e++)
       {
          rho0_gf.GetValues(e, ir, rho_vals);
@@ -228,13 +402,18 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
             const IntegrationPoint &ip = ir.IntPoint(q);
             Tr.SetIntPoint(&ip);
             DenseMatrixInverse Jinv(Tr.Jacobian());
-            Jinv.GetInverseMatrix(qdata.Jac0inv(e*NQ + q));
+            Jinv.GetInverseMatrix(Jac0inv_q);
+            for (int k = 0; k < dim*dim; k++)
+            {
+               qdata.Jac0inv(q, k, e) = Jac0inv_q.GetData()[k];
+            }
             const double rho0DetJ0 = Tr.Weight() * rho_vals(q);
             qdata.rho0DetJ0w(e*NQ + q) = rho0DetJ0 * ir.IntPoint(q).weight;
          }
       }
       for (int e = 0; e < NE; e++) { vol += pmesh->GetElementVolume(e); }
    }
+   CompactJac0inv(qdata.Jac0inv);
    MPI_Allreduce(&vol, &Volume, 1, MPI_DOUBLE, MPI_SUM, pmesh->GetComm());
    MPI_Allreduce(&ne, &Ne, 1, MPI_INT, MPI_SUM, pmesh->GetComm());
    switch (pmesh->GetElementBaseGeometry(0))
@@ -247,47 +426,26 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
       default: MFEM_ABORT("Unknown zone type!");
    }
    qdata.h0 /= (double) H1.GetOrder(0);
-
-   if (p_assembly)
-   {
-      // Setup the preconditioner of the velocity mass operator.
-      // BC are handled by the VMassPA, so ess_tdofs here can be empty.
-      Array<int> empty_tdofs;
-      VMassPA_Jprec = new OperatorJacobiSmoother(VMassPA->GetBF(), empty_tdofs);
-      CG_VMass.SetPreconditioner(*VMassPA_Jprec);
-
-      CG_VMass.SetOperator(*VMassPA);
-      CG_VMass.SetRelTol(cg_rel_tol);
-      CG_VMass.SetAbsTol(0.0);
-      CG_VMass.SetMaxIter(cg_max_iter);
-      CG_VMass.SetPrintLevel(-1);
-
-      CG_EMass.SetOperator(*EMassPA);
-      CG_EMass.iterative_mode = false;
-      CG_EMass.SetRelTol(cg_rel_tol);
-      CG_EMass.SetAbsTol(0.0);
-      CG_EMass.SetMaxIter(cg_max_iter);
-      CG_EMass.SetPrintLevel(-1);
-   }
-   else
-   {
-      ForceIntegrator *fi = new ForceIntegrator(qdata);
-      fi->SetIntRule(&ir);
-      Force.AddDomainIntegrator(fi);
-      // Make a dummy assembly to figure out the sparsity.
-      Force.Assemble(0);
-      Force.Finalize(0);
-   }
 }
 
 LagrangianHydroOperator::~LagrangianHydroOperator()
 {
+   if (dt_est_req != MPI_REQUEST_NULL)
+   {
+      MPI_Wait(&dt_est_req, MPI_STATUS_IGNORE);
+   }
    delete qupdate;
+   delete EMassInv;
+   delete e_source;
+   delete e_source_coeff;
    if (p_assembly)
    {
       delete EMassPA;
       delete VMassPA;
       delete VMassPA_Jprec;
+      delete HaloP;
+      delete HaloPv;
+      delete BlockCG_VMass;
       delete ForcePA;
    }
 }
@@ -297,6 +455,7 @@ void LagrangianHydroOperator::Mult(const Vector &S, Vector &dS_dt) const
    // Make sure that the mesh positions correspond to the ones in S. This is
    // needed only because some mfem time integrators don't update the solution
    // vector at every intermediate stage (hence they don't change the mesh).
+   TimedRegion region(timer.regions, "Mult");
    UpdateMesh(S);
    // The monolithic BlockVector stores the unknown fields as follows:
    // (Position, Velocity, Specific Internal Energy).
@@ -308,113 +467,204 @@ void LagrangianHydroOperator::Mult(const Vector &S, Vector &dS_dt) const
    ParGridFunction dx;
    dx.MakeRef(&H1, dS_dt, 0);
    dx = v;
+   if (fused_force && !qdata_is_current)
+   {
+      // Both force actions are computed together with the quadrature data,
+      // so that the stress is never stored.
+      TimedRegion qf_region(timer.regions, "UpdateQuadratureForces");
+      qupdate->UpdateQuadratureForces(S, qdata, rhs, e_rhs);
+      qdata_is_current = true;
+      dt_est_reduced = false;
+      forces_are_current = true;
+   }
    SolveVelocity(S, dS_dt);
    SolveEnergy(S, v, dS_dt);
    qdata_is_current = false;
+   forces_are_current = false;
 }
 
 void LagrangianHydroOperator::SolveVelocity(const Vector &S,
                                             Vector &dS_dt) const
 {
+   TimedRegion region(timer.regions, "SolveVelocity");
    UpdateQuadratureData(S);
    AssembleForceMatrix();
    // The monolithic BlockVector stores the unknown fields as follows:
    // (Position, Velocity, Specific Internal Energy).
    ParGridFunction dv;
    dv.MakeRef(&H1, dS_dt, H1Vsize);
-   dv = 0.0;
-
-   ParGridFunction accel_src_gf;
-   if (source_type == 2)
-   {
-      accel_src_gf.SetSpace(&H1);
-      RTCoefficient accel_coeff(dim);
-      accel_src_gf.ProjectCoefficient(accel_coeff);
-      accel_src_gf.Read();
-   }
+   // The essential dofs of dv_prev are zero, as in the solution.
+   if (cg_warm_start) { dv = dv_prev; }
+   else { dv = 0.0; }
 
    if (p_assembly)
    {
-      timer.sw_force.Start();
-      ForcePA->Mult(one, rhs);
-      timer.sw_force.Stop();
-      rhs.Neg();
+      // The fused kernel computes only the local rhs.
+      const bool overlap = force_overlap && !forces_are_current;
+      if (overlap)
+      {
+         timer.sw_force.Start();
+         timer.regions.Start("Force");
+         ForcePA->MultTrueDofs(one, rhs_tdofs);
+         timer.regions.Stop();
+         timer.sw_force.Stop();
+         rhs_tdofs.Neg();
+      }
+      else
+      {
+         if (!forces_are_current)
+         {
+            timer.sw_force.Start();
+            timer.regions.Start("Force");
+            ForcePA->Mult(one, rhs);
+            timer.regions.Stop();
+            timer.sw_force.Stop();
+         }
+         rhs.Neg();
+      }
 
       // Partial assembly solve for each velocity component
       const int size = H1c.GetVSize();
-      const Operator *Pconf = H1c.GetProlongationMatrix();
+      const int tsize = H1c.GetTrueVSize();
+      const Operator *Pconf = HaloP ? HaloP : H1c.GetProlongationMatrix();
+      Vector B_c, X_c, rhs_c, BA;
       for (int c = 0; c < dim; c++)
       {
          dvc_gf.MakeRef(&H1c, dS_dt, H1Vsize + c*size);
          rhs_c_gf.MakeRef(&H1c, rhs, c*size);
+         // In block mode, all components are stored in BB and BX.
+         if (block_cg) { B_c.MakeRef(BB, c*tsize, tsize); }
+         Vector &Bc = block_cg ? B_c : B;
 
-         if (Pconf) { Pconf->MultTranspose(rhs_c_gf, B); }
-         else { B = rhs_c_gf; }
+         if (overlap)
+         {
+            // The true dofs of H1 are ordered by components.
+            rhs_c.MakeRef(rhs_tdofs, c*tsize, tsize);
+            Bc = rhs_c;
+         }
+         else if (Pconf)
+         {
+            TimedRegion p_region(timer.regions, "Prolongation");
+            Pconf->MultTranspose(rhs_c_gf, Bc);
+         }
+         else { Bc = rhs_c_gf; }
 
          if (source_type == 2)
          {
-            ParGridFunction accel_comp;
-            accel_comp.MakeRef(&H1c, accel_src_gf, c*size);
-            Vector AC;
-            accel_comp.GetTrueDofs(AC);
-            Vector BA(AC.Size());
-            VMassPA->MultFull(AC, BA);
-            B += BA;
+            BA.MakeRef(accel_src_rhs, c*tsize, tsize);
+            Bc += BA;
+         }
+
+         if (block_cg)
+         {
+            X_c.MakeRef(BX, c*tsize, tsize);
+            timer.regions.Start("Restriction");
+            H1c.GetRestrictionMatrix()->Mult(dvc_gf, X_c);
+            timer.regions.Stop();
+            if (cg_warm_start) { X_c.SetSubVector(c_tdofs[c], 0.0); }
+            B_c.SetSubVector(c_tdofs[c], 0.0);
+            B_c.GetMemory().SyncAlias(BB.GetMemory(), tsize);
+            X_c.GetMemory().SyncAlias(BX.GetMemory(), tsize);
+            continue;
          }
 
+         timer.regions.Start("Restriction");
          H1c.GetRestrictionMatrix()->Mult(dvc_gf, X);
+         timer.regions.Stop();
+         if (cg_warm_start) { X.SetSubVector(c_tdofs[c], 0.0); }
          VMassPA->SetEssentialTrueDofs(c_tdofs[c]);
          VMassPA->EliminateRHS(B);
+         if (cg_warm_start)
+         {
+            VMassCG->SetAbsTol(WarmStartAbsTol(*VMassPA_Jprec, B));
+         }
          timer.sw_cgH1.Start();
-         CG_VMass.Mult(B, X);
+         timer.regions.Start("CG H1");
+         VMassCG->Mult(B, X);
+         timer.regions.Stop();
          timer.sw_cgH1.Stop();
-         timer.H1iter += CG_VMass.GetNumIterations();
+         timer.H1iter += VMassCG->GetNumIterations();
+         timer.regions.Start("Prolongation");
          if (Pconf) { Pconf->Mult(X, dvc_gf); }
          else { dvc_gf = X; }
+         timer.regions.Stop();
          // We need to sync the subvector 'dvc_gf' with its base vector
          // because it may have been moved to a different memory space.
+         timer.regions.Start("SyncAlias");
          dvc_gf.GetMemory().SyncAlias(dS_dt.GetMemory(), dvc_gf.Size());
+         timer.regions.Stop();
+      }
+
+      if (block_cg)
+      {
+         timer.sw_cgH1.Start();
+         timer.regions.Start("CG H1");
+         BlockCG_VMass->Mult(BB, BX);
+         timer.regions.Stop();
+         timer.sw_cgH1.Stop();
+         timer.H1iter += BlockCG_VMass->GetNumIterations();
+         for (int c = 0; c < dim; c++)
+         {
+            dvc_gf.MakeRef(&H1c, dS_dt, H1Vsize + c*size);
+            X_c.MakeRef(BX, c*tsize, tsize);
+            timer.regions.Start("Prolongation");
+            if (Pconf) { Pconf->Mult(X_c, dvc_gf); }
+            else { dvc_gf = X_c; }
+            timer.regions.Stop();
+            timer.regions.Start("SyncAlias");
+            dvc_gf.GetMemory().SyncAlias(dS_dt.GetMemory(), dvc_gf.Size());
+            timer.regions.Stop();
+         }
       }
    }
    else
    {
       timer.sw_force.Start();
+      timer.regions.Start("Force");
       Force.Mult(one, rhs);
+      timer.regions.Stop();
       timer.sw_force.Stop();
       rhs.Neg();
 
-      if (source_type == 2)
-      {
-         Vector rhs_accel(rhs.Size());
-         Mv_spmat_copy.Mult(accel_src_gf, rhs_accel);
-         rhs += rhs_accel;
-      }
+      if (source_type == 2) { rhs += accel_src_rhs; }
 
-      HypreParMatrix A;
-      Mv.FormLinearSystem(ess_tdofs, dv, rhs, A, X, B);
-
-      CGSolver cg(H1.GetParMesh()->GetComm());
-      HypreSmoother prec;
-      prec.SetType(HypreSmoother::Jacobi, 1);
-      cg.SetPreconditioner(prec);
-      cg.SetOperator(A);
-      cg.SetRelTol(cg_rel_tol);
-      cg.SetAbsTol(0.0);
-      cg.SetMaxIter(cg_max_iter);
-      cg.SetPrintLevel(-1);
+      // The interior of dv is kept in X when it is used as initial guess.
+      Mv.FormLinearSystem(ess_tdofs, dv, rhs, Mv_A, X, B, cg_warm_start);
+      if (cg_warm_start) { VMassCG->SetAbsTol(WarmStartAbsTol(Mv_prec, B)); }
       timer.sw_cgH1.Start();
-      cg.Mult(B, X);
+      timer.regions.Start("CG H1");
+      VMassCG->Mult(B, X);
+      timer.regions.Stop();
       timer.sw_cgH1.Stop();
-      timer.H1iter += cg.GetNumIterations();
+      timer.H1iter += VMassCG->GetNumIterations();
       Mv.RecoverFEMSolution(X, rhs, dv);
    }
+   if (cg_warm_start) { dv_prev = dv; }
+}
+
+// MFEM's CG stops when the preconditioned residual norm has been reduced by
+// the relative tolerance from its initial value, so with a warm start a good
+// initial guess would only make the target stricter. The absolute tolerance
+// rel_tol * sqrt(P B, B) gives the same target as the zero initial guess,
+// which is then reached in fewer iterations.
+double LagrangianHydroOperator::WarmStartAbsTol(Solver &prec,
+                                                const Vector &B) const
+{
+   warm_z.SetSize(B.Size());
+   warm_z.UseDevice(true);
+   prec.Mult(B, warm_z);
+   const double bnom = InnerProduct(H1.GetComm(), warm_z, B);
+   return cg_rel_tol * sqrt(fmax(bnom, 0.0));
 }
 
 void LagrangianHydroOperator::SolveEnergy(const Vector &S, const Vector &v,
                                           Vector &dS_dt) const
 {
+   TimedRegion region(timer.regions, "SolveEnergy");
    UpdateQuadratureData(S);
    AssembleForceMatrix();
+   // The reduction of the estimate completes during the energy solve.
+   StartTimeStepEstimate();
 
    // The monolithic BlockVector stores the unknown fields as follows:
    // (Position, Velocity, Specific Internal Energy).
@@ -423,78 +673,145 @@ void LagrangianHydroOperator::SolveEnergy(const Vector &S, const Vector &v,
    de = 0.0;
 
    // Solve for energy, assemble the energy source if such exists.
-   LinearForm *e_source = nullptr;
-   if (source_type == 1) // 2D Taylor-Green.
-   {
-      e_source = new LinearForm(&L2);
-      TaylorCoefficient coeff;
-      DomainLFIntegrator *d = new DomainLFIntegrator(coeff, &ir);
-      e_source->AddDomainIntegrator(d);
-      e_source->Assemble();
-   }
+   if (e_source) { e_source->Assemble(); }
 
-   Array<int> l2dofs;
    if (p_assembly)
    {
-      timer.sw_force.Start();
-      ForcePA->MultTranspose(v, e_rhs);
-      timer.sw_force.Stop();
+      if (!forces_are_current)
+      {
+         timer.sw_force.Start();
+         timer.regions.Start("Force");
+         ForcePA->MultTranspose(v, e_rhs);
+         timer.regions.Stop();
+         timer.sw_force.Stop();
+      }
       if (e_source) { e_rhs += *e_source; }
       timer.sw_cgL2.Start();
-      CG_EMass.Mult(e_rhs, de);
+      timer.regions.Start("CG L2");
+      // The local inverses need no communication; count them as one
+      // iteration over all L2 dofs.
+      if (EMassInv) { EMassInv->Mult(e_rhs, de); }
+      else { CG_EMass.Mult(e_rhs, de); }
+      timer.regions.Stop();
       timer.sw_cgL2.Stop();
-      const HYPRE_Int cg_num_iter = CG_EMass.GetNumIterations();
+      const HYPRE_Int cg_num_iter = EMassInv ? 1 : CG_EMass.GetNumIterations();
       timer.L2iter += (cg_num_iter==0) ? 1 : cg_num_iter;
       // Move the memory location of the subvector 'de' to the memory
       // location of the base vector 'dS_dt'.
+      TimedRegion sync_region(timer.regions, "SyncAlias");
       de.GetMemory().SyncAlias(dS_dt.GetMemory(), de.Size());
    }
    else // not p_assembly
    {
       timer.sw_force.Start();
+      timer.regions.Start("Force");
       Force.MultTranspose(v, e_rhs);
+      timer.regions.Stop();
       timer.sw_force.Stop();
       if (e_source) { e_rhs += *e_source; }
-      Vector loc_rhs(l2dofs_cnt), loc_de(l2dofs_cnt);
-      for (int e = 0; e < NE; e++)
-      {
-         L2.GetElementDofs(e, l2dofs);
-         e_rhs.GetSubVector(l2dofs, loc_rhs);
-         timer.sw_cgL2.Start();
-         Me_inv(e).Mult(loc_rhs, loc_de);
-         timer.sw_cgL2.Stop();
-         timer.L2iter += 1;
-         de.SetSubVector(l2dofs, loc_de);
-      }
+      timer.sw_cgL2.Start();
+      timer.regions.Start("CG L2");
+      EMassInv->Mult(e_rhs, de);
+      timer.regions.Stop();
+      timer.sw_cgL2.Stop();
+      // One local solve per zone.
+      timer.L2iter += NE;
+      TimedRegion sync_region(timer.regions, "SyncAlias");
+      de.GetMemory().SyncAlias(dS_dt.GetMemory(), de.Size());
+   }
+}
+
+void LagrangianHydroOperator::AssembleAccelerationSource()
+{
+   if (!p_assembly)
+   {
+      accel_src_rhs.SetSize(H1Vsize);
+      accel_src_rhs.UseDevice(true);
+      Mv_spmat_copy.Mult(accel_src_gf, accel_src_rhs);
+      return;
+   }
+   const int size = H1c.GetVSize();
+   const int tsize = H1c.GetTrueVSize();
+   accel_src_rhs.SetSize(dim * tsize);
+   accel_src_rhs.UseDevice(true);
+   ParGridFunction accel_comp;
+   Vector AC, BA;
+   for (int c = 0; c < dim; c++)
+   {
+      accel_comp.MakeRef(&H1c, accel_src_gf, c*size);
+      accel_comp.GetTrueDofs(AC);
+      BA.MakeRef(accel_src_rhs, c*tsize, tsize);
+      VMassPA->MultFull(AC, BA);
+      BA.GetMemory().SyncAlias(accel_src_rhs.GetMemory(), tsize);
    }
-   delete e_source;
 }
 
 void LagrangianHydroOperator::UpdateMesh(const Vector &S) const
 {
+   TimedRegion region(timer.regions, "UpdateMesh");
    Vector* sptr = const_cast<Vector*>(&S);
    x_gf.MakeRef(&H1, *sptr, 0);
-   H1.GetParMesh()->NewNodes(x_gf, false);
+   // When the mesh already uses x_gf, e.g., in the stages of a step after the
+   // first one, only the node values changed: the nodes are not replaced, and
+   // only the cached geometric factors are invalidated.
+   ParMesh *mesh = H1.GetParMesh();
+   if (mesh->GetNodes() == &x_gf) { mesh->DeleteGeometricFactors(); }
+   else { mesh->NewNodes(x_gf, false); }
 }
 
 double LagrangianHydroOperator::GetTimeStepEstimate(const Vector &S) const
 {
    UpdateMesh(S);
    UpdateQuadratureData(S);
-   double glob_dt_est;
+   return GetCurrentTimeStepEstimate();
+}
+
+double LagrangianHydroOperator::GetCurrentTimeStepEstimate() const
+{
+   if (dt_est_req != MPI_REQUEST_NULL)
+   {
+      TimedRegion wait_region(timer.regions, "MPI wait");
+      MPI_Wait(&dt_est_req, MPI_STATUS_IGNORE);
+   }
+   // All tasks update the quadrature data together, so they agree on whether
+   // a new reduction is needed.
+   if (!dt_est_reduced)
+   {
+      dt_est_loc = qdata.dt_est;
+      const MPI_Comm comm = H1.GetParMesh()->GetComm();
+      TimedRegion wait_region(timer.regions, "MPI wait");
+      MPI_Allreduce(&dt_est_loc, &dt_est_glob, 1, MPI_DOUBLE, MPI_MIN, comm);
+      dt_est_reduced = true;
+   }
+   return dt_est_glob;
+}
+
+void LagrangianHydroOperator::StartTimeStepEstimate() const
+{
+   if (dt_est_req != MPI_REQUEST_NULL)
+   {
+      TimedRegion wait_region(timer.regions, "MPI wait");
+      MPI_Wait(&dt_est_req, MPI_STATUS_IGNORE);
+   }
+   if (dt_est_reduced) { return; }
+   dt_est_loc = qdata.dt_est;
    const MPI_Comm comm = H1.GetParMesh()->GetComm();
-   MPI_Allreduce(&qdata.dt_est, &glob_dt_est, 1, MPI_DOUBLE, MPI_MIN, comm);
-   return glob_dt_est;
+   MPI_Iallreduce(&dt_est_loc, &dt_est_glob, 1, MPI_DOUBLE, MPI_MIN, comm,
+                  &dt_est_req);
+   dt_est_reduced = true;
 }
 
 void LagrangianHydroOperator::ResetTimeStepEstimate() const
 {
    qdata.dt_est = std::numeric_limits<double>::infinity();
+   dt_est_reduced = false;
 }
 
 void LagrangianHydroOperator::ComputeDensity(ParGridFunction &rho) const
 {
+   TimedRegion region(timer.regions, "ComputeDensity");
    rho.SetSpace(&L2);
+   if (dim > 1 && p_assembly) { ComputeDensityPA(rho); return; }
    DenseMatrix Mrho(l2dofs_cnt);
    Vector rhs(l2dofs_cnt), rho_z(l2dofs_cnt);
    Array<int> dofs(l2dofs_cnt);
@@ -515,7 +832,178 @@ void LagrangianHydroOperator::ComputeDensity(ParGridFunction &rho) const
    }
 }
 
+// Element mass matrices Me of the energy space on the initial mesh, and their
+// inverses Me_inv, for all elements in one batch. Due to the pointwise mass
+// conservation, the weights of Me are the time-zero values rho0DetJ0w, with
+// the same quadrature points as the other assemblies. Each matrix is formed
+// and inverted by one thread.
+void LagrangianHydroOperator::AssembleEnergyMassInverses()
+{
+   const int NQ = ir.GetNPoints(), ND = l2dofs_cnt, E = NE;
+   const DofToQuad &maps = L2.GetFE(0)->GetDofToQuad(ir, DofToQuad::FULL);
+   const auto B = Reshape(maps.B.Read(), NQ, ND);
+   const auto R0 = Reshape(qdata.rho0DetJ0w.Read(), NQ, NE);
+   auto M = Reshape(Write(Me.GetMemory(), ND*ND*NE), ND, ND, NE);
+   auto Minv = Reshape(Write(Me_inv.GetMemory(), ND*ND*NE), ND, ND, NE);
+   MFEM_FORALL(e, E,
+   {
+      for (int i = 0; i < ND; i++)
+      {
+         for (int j = 0; j <= i; j++)
+         {
+            double m = 0.0;
+            for (int q = 0; q < NQ; q++) { m += B(q,i) * B(q,j) * R0(q,e); }
+            M(i,j,e) = M(j,i,e) = m;
+            Minv(i,j,e) = Minv(j,i,e) = m;
+         }
+      }
+      // In place Gauss-Jordan inversion; Me is symmetric positive definite,
+      // so no pivoting is needed.
+      for (int k = 0; k < ND; k++)
+      {
+         const double ipiv = 1.0 / Minv(k,k,e);
+         Minv(k,k,e) = 1.0;
+         for (int j = 0; j < ND; j++) { Minv(k,j,e) *= ipiv; }
+         for (int i = 0; i < ND; i++)
+         {
+            if (i == k) { continue; }
+            const double f = Minv(i,k,e);
+            Minv(i,k,e) = 0.0;
+            for (int j = 0; j < ND; j++) { Minv(i,j,e) -= f * Minv(k,j,e); }
+         }
+      }
+   });
+   delete EMassInv;
+   EMassInv = new LocalInverseOperator(L2, Me_inv);
+}
+
+void LagrangianHydroOperator::TimeZeroDataRestored()
+{
+   if (e_local_inv) { AssembleEnergyMassInverses(); }
+   ResetQuadratureData();
+}
+
+double LagrangianHydroOperator::EnergyMassInverseError() const
+{
+   if (!e_local_inv) { return 0.0; }
+   const int ND = l2dofs_cnt, n = ND*ND*NE;
+   const double *h_M = HostRead(Me.GetMemory(), n);
+   const double *h_Minv = HostRead(Me_inv.GetMemory(), n);
+   double err = 0.0, glob_err;
+   for (int e = 0; e < NE; e++)
+   {
+      DenseMatrix M(const_cast<double*>(h_M) + e*ND*ND, ND, ND), inv(ND);
+      DenseMatrixInverse Minv(M);
+      Minv.GetInverseMatrix(inv);
+      const double inv_norm = inv.FNorm();
+      inv.Add(-1.0, DenseMatrix(const_cast<double*>(h_Minv) + e*ND*ND,
+                                ND, ND));
+      err = fmax(err, inv.FNorm() / inv_norm);
+   }
+   MPI_Allreduce(&err, &glob_err, 1, MPI_DOUBLE, MPI_MAX, pmesh->GetComm());
+   return glob_err;
+}
+
+// Weights w_q det(J) of the quadrature points of all elements, on the current
+// mesh, with the Jacobians interpolated by the H1 QuadratureInterpolator (as
+// in the QUpdate).
+void LagrangianHydroOperator::ComputeWeightedDetJ(Vector &wdetJ_) const
+{
+   const int NQ = ir.GetNPoints(), DIM = dim, E = NE;
+   const Operator *H1R =
+      H1.GetElementRestriction(ElementDofOrdering::LEXICOGRAPHIC);
+   const QuadratureInterpolator *qi = H1.GetQuadratureInterpolator(ir);
+   if (rho_x.Size() == 0)
+   {
+      rho_x.SetSize(H1R->Height());
+      rho_dx.SetSize(DIM*DIM*NQ*NE);
+      rho_x.UseDevice(true); rho_dx.UseDevice(true);
+   }
+   H1R->Mult(*pmesh->GetNodes(), rho_x);
+   qi->SetOutputLayout(QVectorLayout::byVDIM);
+   qi->Derivatives(rho_x, rho_dx);
+
+   const auto W = ir.GetWeights().Read();
+   const auto J = Reshape(rho_dx.Read(), DIM, DIM, NQ, NE);
+   auto wdetJ = Reshape(wdetJ_.Write(), NQ, NE);
+   MFEM_FORALL(i, NQ*E,
+   {
+      const int q = i % NQ, e = i / NQ;
+      double det;
+      if (DIM == 2)
+      {
+         det = J(0,0,q,e)*J(1,1,q,e) - J(0,1,q,e)*J(1,0,q,e);
+      }
+      else
+      {
+         det = J(0,0,q,e)*(J(1,1,q,e)*J(2,2,q,e) - J(1,2,q,e)*J(2,1,q,e)) -
+               J(0,1,q,e)*(J(1,0,q,e)*J(2,2,q,e) - J(1,2,q,e)*J(2,0,q,e)) +
+               J(0,2,q,e)*(J(1,0,q,e)*J(2,1,q,e) - J(1,1,q,e)*J(2,0,q,e));
+      }
+      wdetJ(q,e) = W[q] * det;
+   });
+}
 
+// The L2 projection of rho = rho0DetJ0 / detJ solves the element systems
+// M_e rho_e = b_e, where M_e is the L2 mass matrix on the current mesh and
+// b_e = B^T rho0DetJ0w doesn't depend on time. M_e is formed from the
+// weights of ComputeWeightedDetJ, and every element system is solved by one
+// thread.
+void LagrangianHydroOperator::ComputeDensityPA(ParGridFunction &rho) const
+{
+   const int NQ = ir.GetNPoints(), ND = l2dofs_cnt, E = NE;
+   const Operator *L2R = L2.GetElementRestriction(ElementDofOrdering::NATIVE);
+   if (rho_M.Size() == 0)
+   {
+      rho_wdetJ.SetSize(NQ*NE);
+      rho_M.SetSize(ND*ND*NE);
+      rho_e.SetSize(ND*NE);
+      rho_wdetJ.UseDevice(true); rho_M.UseDevice(true); rho_e.UseDevice(true);
+   }
+   ComputeWeightedDetJ(rho_wdetJ);
+
+   const DofToQuad &maps = L2.GetFE(0)->GetDofToQuad(ir, DofToQuad::FULL);
+   const auto B = Reshape(maps.B.Read(), NQ, ND);
+   const auto R0 = Reshape(qdata.rho0DetJ0w.Read(), NQ, NE);
+   const auto WD = Reshape(rho_wdetJ.Read(), NQ, NE);
+   auto M = Reshape(rho_M.Write(), ND, ND, NE);
+   auto r = Reshape(rho_e.Write(), ND, NE);
+   MFEM_FORALL(e, E,
+   {
+      for (int i = 0; i < ND; i++)
+      {
+         double b = 0.0;
+         for (int q = 0; q < NQ; q++) { b += B(q,i) * R0(q,e); }
+         r(i,e) = b;
+         for (int j = 0; j <= i; j++)
+         {
+            double m = 0.0;
+            for (int q = 0; q < NQ; q++) { m += B(q,i) * B(q,j) * WD(q,e); }
+            M(i,j,e) = m;
+            M(j,i,e) = m;
+         }
+      }
+      // M_e is symmetric positive definite, so no pivoting is needed.
+      for (int k = 0; k < ND; k++)
+      {
+         const double ipiv = 1.0 / M(k,k,e);
+         for (int i = k + 1; i < ND; i++)
+         {
+            const double f = M(i,k,e) * ipiv;
+            for (int j = k + 1; j < ND; j++) { M(i,j,e) -= f * M(k,j,e); }
+            r(i,e) -= f * r(k,e);
+         }
+      }
+      for (int i = ND - 1; i >= 0; i--)
+      {
+         double u = r(i,e);
+         for (int j = i + 1; j < ND; j++) { u -= M(i,j,e) * r(j,e); }
+         r(i,e) = u / M(i,i,e);
+      }
+   });
+   if (L2R) { L2R->MultTranspose(rho_e, rho); }
+   else { rho = rho_e; }
+}
 
 double ComputeVolumeIntegral(const int DIM, const int NE,const int NQ,
                              const int Q1D,const int VDIM,const double ln_norm,
@@ -641,10 +1129,185 @@ double LagrangianHydroOperator::KineticEnergy(const ParGridFunction &v) const
    return 0.5*glob_ke;
 }
 
+void RegionTimer::Start(const char *name)
+{
+#ifdef LAGHOS_USE_NVTX
+   nvtxRangePushA(name);
+#endif
+#ifdef LAGHOS_USE_ROCTX
+   roctxRangePushA(name);
+#endif
+#ifdef LAGHOS_USE_CALIPER
+   CALI_MARK_BEGIN(name);
+#endif
+   names.push_back(name);
+   if (!enabled) { return; }
+   paths.push_back(paths.empty() ? std::string(name) :
+                   paths.back() + "/" + name);
+   if (Device::Allows(Backend::DEVICE_MASK)) { MFEM_DEVICE_SYNC; }
+   Region &r = regions[paths.back()];
+   r.calls++;
+   r.sw.Start();
+}
+
+void RegionTimer::Stop()
+{
+   MFEM_VERIFY(!names.empty(), "There is no open region!");
+#ifdef LAGHOS_USE_NVTX
+   nvtxRangePop();
+#endif
+#ifdef LAGHOS_USE_ROCTX
+   roctxRangePop();
+#endif
+#ifdef LAGHOS_USE_CALIPER
+   CALI_MARK_END(names.back());
+#endif
+   names.pop_back();
+   if (!enabled) { return; }
+   if (Device::Allows(Backend::DEVICE_MASK)) { MFEM_DEVICE_SYNC; }
+   regions[paths.back()].sw.Stop();
+   paths.pop_back();
+}
+
+void RegionTimer::Reduce(MPI_Comm comm, std::vector<std::string> &all_paths,
+                         Vector &t_min, Vector &t_max, Vector &t_avg,
+                         Array<long> &calls) const
+{
+   // Some regions may not be visited by all tasks, so the sets of paths are
+   // merged first.
+   int nranks;
+   MPI_Comm_size(comm, &nranks);
+   std::string my_paths;
+   for (const auto &r : regions) { my_paths += r.first + '\n'; }
+   int my_len = my_paths.size(), len = 0;
+   Array<int> lens(nranks), offsets(nranks);
+   MPI_Allgather(&my_len, 1, MPI_INT, lens.GetData(), 1, MPI_INT, comm);
+   for (int i = 0; i < nranks; i++) { offsets[i] = len; len += lens[i]; }
+   std::vector<char> buf(len + 1);
+   MPI_Allgatherv(my_paths.c_str(), my_len, MPI_CHAR, buf.data(),
+                  lens.GetData(), offsets.GetData(), MPI_CHAR, comm);
+   std::set<std::string> merged;
+   std::string path;
+   for (int i = 0; i < len; i++)
+   {
+      if (buf[i] == '\n') { merged.insert(path); path.clear(); }
+      else { path += buf[i]; }
+   }
+   all_paths.assign(merged.begin(), merged.end());
+
+   const int n = all_paths.size();
+   Vector my_t(n);
+   Array<long> my_calls(n);
+   for (int i = 0; i < n; i++)
+   {
+      const auto it = regions.find(all_paths[i]);
+      const bool found = it != regions.end();
+      my_t(i) = found ? it->second.sw.RealTime() : 0.0;
+      my_calls[i] = found ? it->second.calls : 0;
+   }
+   t_min.SetSize(n);
+   t_max.SetSize(n);
+   t_avg.SetSize(n);
+   calls.SetSize(n);
+   MPI_Allreduce(my_t.GetData(), t_min.GetData(), n, MPI_DOUBLE, MPI_MIN, comm);
+   MPI_Allreduce(my_t.GetData(), t_max.GetData(), n, MPI_DOUBLE, MPI_MAX, comm);
+   MPI_Allreduce(my_t.GetData(), t_avg.GetData(), n, MPI_DOUBLE, MPI_SUM, comm);
+   MPI_Allreduce(my_calls.GetData(), calls.GetData(), n, MPI_LONG, MPI_MAX,
+                 comm);
+   t_avg /= nranks;
+}
+
+// The ratio of the maximal and the average time over the tasks.
+static double Imbalance(const double t_max, const double t_avg)
+{
+   return (t_avg > 0.0) ? t_max / t_avg : 1.0;
+}
+
+void RegionTimer::Print(MPI_Comm comm, std::ostream &os) const
+{
+   using namespace std;
+   std::vector<std::string> all_paths;
+   Vector t_min, t_max, t_avg;
+   Array<long> calls;
+   Reduce(comm, all_paths, t_min, t_max, t_avg, calls);
+   int rank;
+   MPI_Comm_rank(comm, &rank);
+   if (rank != 0) { return; }
+
+   const ios_base::fmtflags flags = os.flags();
+   const streamsize prec = os.precision();
+   os << endl;
+   os << "Region timings (seconds, over the MPI tasks):" << endl;
+   os << left << setw(44) << "region" << right
+      << setw(9) << "calls" << setw(11) << "min" << setw(11) << "avg"
+      << setw(11) << "max" << setw(11) << "max/avg" << endl;
+   for (size_t i = 0; i < all_paths.size(); i++)
+   {
+      // Children are indented below their parent, which precedes them in
+      // the ordered paths.
+      const std::string &p = all_paths[i];
+      const size_t depth = std::count(p.begin(), p.end(), '/');
+      const size_t last = p.rfind('/');
+      const std::string name = std::string(2*depth, ' ') +
+                               ((last == std::string::npos) ? p :
+                                p.substr(last + 1));
+      os << left << setw(44) << name << right << setw(9) << calls[i]
+         << fixed << setprecision(4)
+         << setw(11) << t_min(i) << setw(11) << t_avg(i) << setw(11) << t_max(i)
+         << setprecision(2) << setw(11) << Imbalance(t_max(i), t_avg(i))
+         << endl;
+   }
+   os.flags(flags);
+   os.precision(prec);
+}
+
+void RegionTimer::Save(MPI_Comm comm, const char *fname) const
+{
+   std::vector<std::string> all_paths;
+   Vector t_min, t_max, t_avg;
+   Array<long> calls;
+   Reduce(comm, all_paths, t_min, t_max, t_avg, calls);
+   int rank, nranks;
+   MPI_Comm_rank(comm, &rank);
+   MPI_Comm_size(comm, &nranks);
+   if (rank != 0) { return; }
+
+   const std::string file(fname), ext(".json");
+   const size_t n = file.size(), m = ext.size();
+   const bool json = n >= m && file.compare(n - m, m, ext) == 0;
+   std::ofstream ofs(fname);
+   MFEM_VERIFY(ofs, "Cannot open the timing file " << fname);
+   ofs.precision(8);
+   if (json)
+   {
+      ofs << "{\n  \"tasks\": " << nranks << ",\n  \"regions\": [";
+      for (size_t i = 0; i < all_paths.size(); i++)
+      {
+         ofs << (i ? "," : "") << "\n    {\"path\": \"" << all_paths[i]
+             << "\", \"calls\": " << calls[i]
+             << ", \"min\": " << t_min(i) << ", \"avg\": " << t_avg(i)
+             << ", \"max\": " << t_max(i)
+             << ", \"imbalance\": " << Imbalance(t_max(i), t_avg(i)) << "}";
+      }
+      ofs << "\n  ]\n}\n";
+   }
+   else
+   {
+      ofs << "path,calls,min,avg,max,imbalance\n";
+      for (size_t i = 0; i < all_paths.size(); i++)
+      {
+         ofs << all_paths[i] << "," << calls[i] << "," << t_min(i) << ","
+             << t_avg(i) << "," << t_max(i) << ","
+             << Imbalance(t_max(i), t_avg(i)) << "\n";
+      }
+   }
+}
+
 void LagrangianHydroOperator::PrintTimingData(bool IamRoot, int steps,
                                               const bool fom) const
 {
    const MPI_Comm com = H1.GetComm();
+   if (timer.regions.Enabled()) { timer.regions.Print(com, std::cout); }
    double my_rt[5], T[5];
    my_rt[0] = timer.sw_cgH1.RealTime();
    my_rt[1] = timer.sw_cgL2.RealTime();
@@ -723,372 +1386,257 @@ void LagrangianHydroOperator::PrintTimingData(bool IamRoot, int steps,
    }
 }
 
-// Smooth transition between 0 and 1 for x in [-eps, eps].
-MFEM_HOST_DEVICE inline double smooth_step_01(double x, double eps)
+void LagrangianHydroOperator::SaveTimingData(const char *fname) const
 {
-   const double y = (x + eps) / (2.0 * eps);
-   if (y < 0.0) { return 0.0; }
-   if (y > 1.0) { return 1.0; }
-   return (3.0 - 2.0 * y) * y * y;
+   timer.regions.Save(H1.GetComm(), fname);
 }
 
 void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
 {
    if (qdata_is_current) { return; }
 
+   TimedRegion region(timer.regions, "UpdateQuadratureData");
    qdata_is_current = true;
    forcemat_is_assembled = false;
+   dt_est_reduced = false;
 
    if (dim > 1 && p_assembly) { return qupdate->UpdateQuadratureData(S, qdata); }
 
    // This code is only for the 1D/FA mode
    timer.sw_qdata.Start();
-   const int nqp = ir.GetNPoints();
-   ParGridFunction x, v, e;
-   Vector* sptr = const_cast<Vector*>(&S);
-   x.MakeRef(&H1, *sptr, 0);
-   v.MakeRef(&H1, *sptr, H1.GetVSize());
+   switch (dim)
+   {
+      case 1: UpdateQuadratureDataFA<1>(S); break;
+      case 2: UpdateQuadratureDataFA<2>(S); break;
+      case 3: UpdateQuadratureDataFA<3>(S); break;
+      default: MFEM_ABORT("Unknown dimension!");
+   }
+   timer.sw_qdata.Stop();
+   timer.quad_tstep += NE;
+}
+
+// Closed-form eigen and singular value routines used by the 1D/FA quadrature
+// update; kernels:: provides the 2x2 and 3x3 versions.
+template<int DIM> static inline
+void CalcSymEigenvalues(const double *A, double *lambda, double *vec)
+{
+   kernels::CalcEigenvalues<DIM>(A, lambda, vec);
+}
+
+template<> inline
+void CalcSymEigenvalues<1>(const double *A, double *lambda, double *vec)
+{
+   lambda[0] = A[0];
+   vec[0] = 1.0;
+}
+
+template<int DIM> static inline
+double CalcMinSingularvalue(const double *J)
+{
+   return kernels::CalcSingularvalue<DIM>(J, DIM - 1);
+}
+
+template<> inline double CalcMinSingularvalue<1>(const double *J)
+{
+   return fabs(J[0]);
+}
+
+template<int DIM>
+void LagrangianHydroOperator::UpdateQuadratureDataFA(const Vector &S) const
+{
+   constexpr int DIM2 = DIM*DIM;
+   const int nqp = ir.GetNPoints();
+   const int nqp_batch = nqp * fa_batch;
+   const double h1order = (double) H1.GetOrder(0);
+   ParGridFunction x, v, e;
+   Vector* sptr = const_cast<Vector*>(&S);
+   x.MakeRef(&H1, *sptr, 0);
+   v.MakeRef(&H1, *sptr, H1.GetVSize());
    e.MakeRef(&L2, *sptr, 2*H1.GetVSize());
-   Vector e_vals;
-   DenseMatrix Jpi(dim), sgrad_v(dim), Jinv(dim), stress(dim), stressJiT(dim);
+   x.HostRead();
+   v.HostRead();
+   e.HostRead();
 
    // Batched computations are needed, because hydrodynamic codes usually
-   // involve expensive computations of material properties. Although this
-   // miniapp uses simple EOS equations, we still want to represent the batched
-   // cycle structure.
-   int nzones_batch = 3;
-   const int nbatches =  NE / nzones_batch + 1; // +1 for the remainder.
-   int nqp_batch = nqp * nzones_batch;
-   double *gamma_b = new double[nqp_batch],
-   *rho_b = new double[nqp_batch],
-   *e_b   = new double[nqp_batch],
-   *p_b   = new double[nqp_batch],
-   *cs_b  = new double[nqp_batch];
-   // Jacobians of reference->physical transformations for all quadrature points
-   // in the batch.
-   DenseTensor *Jpr_b = new DenseTensor[nzones_batch];
-   for (int b = 0; b < nbatches; b++)
+   // involve expensive computations of material properties. The scalar fields
+   // of a batch are stored as separate arrays over its quadrature points, the
+   // Jacobians and the velocity gradients are stored point by point.
+   fa_J.SetSize(DIM2 * nqp_batch);
+   fa_dV.SetSize(DIM2 * nqp_batch);
+   fa_detJ.SetSize(nqp_batch);
+   fa_gamma.SetSize(nqp_batch);
+   fa_rho.SetSize(nqp_batch);
+   fa_e.SetSize(nqp_batch);
+   fa_p.SetSize(nqp_batch);
+   fa_cs.SetSize(nqp_batch);
+   double *J_b = fa_J.HostWrite(), *dV_b = fa_dV.HostWrite();
+   double *detJ_b = fa_detJ.HostWrite(), *gamma_b = fa_gamma.HostWrite();
+   double *rho_b = fa_rho.HostWrite(), *e_b = fa_e.HostWrite();
+   double *p_b = fa_p.HostWrite(), *cs_b = fa_cs.HostWrite();
+   const double *W = ir.GetWeights().HostRead();
+   const double *rho0DetJ0w = qdata.rho0DetJ0w.HostRead();
+   const double *gamma = gamma_gf.HostRead();
+   const double *Jac0inv = HostRead(qdata.Jac0inv.GetMemory(),
+                                    qdata.Jac0inv.TotalSize());
+   const int NJ0 = qdata.Jac0inv.SizeI();
+   double *stressJinvT = HostWrite(qdata.stressJinvT.GetMemory(),
+                                   qdata.stressJinvT.TotalSize());
+   const double *dshape = fa_dshape.Data();
+   const double *shape = fa_shape.Data();
+   const int nd = h1dofs_cnt, nl = l2dofs_cnt;
+
+   Array<int> h1dofs, l2dofs;
+   Vector x_z, v_z, e_z;
+   double dt_est = qdata.dt_est;
+   for (int z_id = 0; z_id < NE; z_id += fa_batch)
    {
-      int z_id = b * nzones_batch; // Global index over zones.
       // The last batch might not be full.
-      if (z_id == NE) { break; }
-      else if (z_id + nzones_batch > NE)
-      {
-         nzones_batch = NE - z_id;
-         nqp_batch    = nqp * nzones_batch;
-      }
+      const int nzones_batch = std::min(fa_batch, NE - z_id);
 
       double min_detJ = std::numeric_limits<double>::infinity();
       for (int z = 0; z < nzones_batch; z++)
       {
-         ElementTransformation *T = H1.GetElementTransformation(z_id);
-         Jpr_b[z].SetSize(dim, dim, nqp);
-         e.GetValues(z_id, ir, e_vals);
+         H1.GetElementVDofs(z_id + z, h1dofs);
+         L2.GetElementDofs(z_id + z, l2dofs);
+         x.GetSubVector(h1dofs, x_z);
+         e.GetSubVector(l2dofs, e_z);
+         if (use_viscosity) { v.GetSubVector(h1dofs, v_z); }
          for (int q = 0; q < nqp; q++)
          {
-            const IntegrationPoint &ip = ir.IntPoint(q);
-            T->SetIntPoint(&ip);
-            Jpr_b[z](q) = T->Jacobian();
-            const double detJ = Jpr_b[z](q).Det();
-            min_detJ = fmin(min_detJ, detJ);
             const int idx = z * nqp + q;
+            const double *dsh = dshape + q * nd * DIM;
+            double *J = J_b + idx * DIM2, *dV = dV_b + idx * DIM2;
+            // Reference gradients of the position and of the velocity.
+            for (int k = 0; k < DIM2; k++) { J[k] = dV[k] = 0.0; }
+            for (int d = 0; d < DIM; d++)
+            {
+               for (int i = 0; i < nd; i++)
+               {
+                  const double g = dsh[i + d * nd];
+                  for (int c = 0; c < DIM; c++)
+                  {
+                     J[c + d * DIM] += x_z(c * nd + i) * g;
+                  }
+               }
+            }
+            if (use_viscosity)
+            {
+               for (int d = 0; d < DIM; d++)
+               {
+                  for (int i = 0; i < nd; i++)
+                  {
+                     const double g = dsh[i + d * nd];
+                     for (int c = 0; c < DIM; c++)
+                     {
+                        dV[c + d * DIM] += v_z(c * nd + i) * g;
+                     }
+                  }
+               }
+            }
+            double e_q = 0.0;
+            for (int j = 0; j < nl; j++) { e_q += e_z(j) * shape[j + q * nl]; }
+            const double detJ = kernels::Det<DIM>(J);
+            min_detJ = fmin(min_detJ, detJ);
+            detJ_b[idx] = detJ;
             // Assuming piecewise constant gamma that moves with the mesh.
-            gamma_b[idx] = gamma_gf(z_id);
-            rho_b[idx] = qdata.rho0DetJ0w(z_id*nqp + q) / detJ / ip.weight;
-            e_b[idx] = fmax(0.0, e_vals(q));
+            gamma_b[idx] = gamma[z_id + z];
+            rho_b[idx] = rho0DetJ0w[(z_id + z) * nqp + q] / detJ / W[q];
+            e_b[idx] = fmax(0.0, e_q);
          }
-         ++z_id;
       }
 
       // Batched computation of material properties.
-      ComputeMaterialProperties(nqp_batch, gamma_b, rho_b, e_b, p_b, cs_b);
+      ComputeMaterialProperties(nzones_batch * nqp, gamma_b, rho_b, e_b,
+                                p_b, cs_b);
 
-      z_id -= nzones_batch;
-      for (int z = 0; z < nzones_batch; z++)
+      for (int idx = 0; idx < nzones_batch * nqp; idx++)
       {
-         ElementTransformation *T = H1.GetElementTransformation(z_id);
-         for (int q = 0; q < nqp; q++)
+         const int q = idx % nqp, ez = z_id + idx / nqp;
+         const double *J = J_b + idx * DIM2;
+         const double detJ = detJ_b[idx], rho = rho_b[idx],
+                      p = p_b[idx], sound_speed = cs_b[idx];
+         double Jinv[DIM2], stress[DIM2], sgrad_v[DIM2], stressJiT[DIM2];
+         kernels::CalcInverse<DIM>(J, Jinv);
+         for (int k = 0; k < DIM2; k++) { stress[k] = 0.0; }
+         for (int d = 0; d < DIM; d++) { stress[d*DIM+d] = -p; }
+         double visc_coeff = 0.0;
+         if (use_viscosity)
          {
-            const IntegrationPoint &ip = ir.IntPoint(q);
-            T->SetIntPoint(&ip);
-            // Note that the Jacobian was already computed above. We've chosen
-            // not to store the Jacobians for all batched quadrature points.
-            const DenseMatrix &Jpr = Jpr_b[z](q);
-            CalcInverse(Jpr, Jinv);
-            const double detJ = Jpr.Det(), rho = rho_b[z*nqp + q],
-                         p = p_b[z*nqp + q], sound_speed = cs_b[z*nqp + q];
-            stress = 0.0;
-            for (int d = 0; d < dim; d++) { stress(d, d) = -p; }
-            double visc_coeff = 0.0;
-            if (use_viscosity)
+            // Compression-based length scale at the point. The first
+            // eigenvector of the symmetric velocity gradient gives the
+            // direction of maximal compression. This is used to define the
+            // relative change of the initial length scale.
+            kernels::Mult(DIM, DIM, DIM, dV_b + idx * DIM2, Jinv, sgrad_v);
+
+            double vorticity_coeff = 1.0;
+            if (use_vorticity)
             {
-               // Compression-based length scale at the point. The first
-               // eigenvector of the symmetric velocity gradient gives the
-               // direction of maximal compression. This is used to define the
-               // relative change of the initial length scale.
-               v.GetVectorGradient(*T, sgrad_v);
-
-               double vorticity_coeff = 1.0;
-               if (use_vorticity)
-               {
-                  const double grad_norm = sgrad_v.FNorm();
-                  const double div_v = fabs(sgrad_v.Trace());
-                  vorticity_coeff = (grad_norm > 0.0) ? div_v / grad_norm : 1.0;
-               }
-
-               sgrad_v.Symmetrize();
-               double eig_val_data[3], eig_vec_data[9];
-               if (dim==1)
-               {
-                  eig_val_data[0] = sgrad_v(0, 0);
-                  eig_vec_data[0] = 1.;
-               }
-               else { sgrad_v.CalcEigenvalues(eig_val_data, eig_vec_data); }
-               Vector compr_dir(eig_vec_data, dim);
-               // Computes the initial->physical transformation Jacobian.
-               mfem::Mult(Jpr, qdata.Jac0inv(z_id*nqp + q), Jpi);
-               Vector ph_dir(dim); Jpi.Mult(compr_dir, ph_dir);
-               // Change of the initial mesh size in the compression direction.
-               const double h = qdata.h0 * ph_dir.Norml2() /
-                                compr_dir.Norml2();
-               // Measure of maximal compression.
-               const double mu = eig_val_data[0];
-               visc_coeff = 2.0 * rho * h * h * fabs(mu);
-               // The following represents a "smooth" version of the statement
-               // "if (mu < 0) visc_coeff += 0.5 rho h sound_speed".  Note that
-               // eps must be scaled appropriately if a different unit system is
-               // being used.
-               const double eps = 1e-12;
-               visc_coeff += 0.5 * rho * h * sound_speed * vorticity_coeff *
-                             (1.0 - smooth_step_01(mu - 2.0 * eps, eps));
-               stress.Add(visc_coeff, sgrad_v);
+               const double grad_norm = FNorm<DIM,DIM>(sgrad_v);
+               const double div_v = fabs(Trace<DIM,DIM>(sgrad_v));
+               vorticity_coeff = (grad_norm > 0.0) ? div_v / grad_norm : 1.0;
             }
-            // Time step estimate at the point. Here the more relevant length
-            // scale is related to the actual mesh deformation; we use the min
-            // singular value of the ref->physical Jacobian. In addition, the
-            // time step estimate should be aware of the presence of shocks.
-            const double h_min =
-               Jpr.CalcSingularvalue(dim-1) / (double) H1.GetOrder(0);
-            const double inv_dt = sound_speed / h_min +
-                                  2.5 * visc_coeff / rho / h_min / h_min;
-            if (min_detJ < 0.0)
+
+            kernels::Symmetrize(DIM, sgrad_v);
+            double eig_val_data[3], eig_vec_data[9];
+            CalcSymEigenvalues<DIM>(sgrad_v, eig_val_data, eig_vec_data);
+            const double *compr_dir = eig_vec_data;
+            // Computes the initial->physical transformation Jacobian.
+            double J0inv[DIM2], Jpi[DIM2], ph_dir[DIM];
+            const int j0 = (NJ0 > 1) ? q : 0;
+            for (int k = 0; k < DIM2; k++)
             {
-               // This will force repetition of the step with smaller dt.
-               qdata.dt_est = 0.0;
+               J0inv[k] = Jac0inv[j0 + NJ0*(k + DIM2*ez)];
             }
-            else
+            kernels::Mult(DIM, DIM, DIM, J, J0inv, Jpi);
+            kernels::Mult(DIM, DIM, Jpi, compr_dir, ph_dir);
+            // Change of the initial mesh size in the compression direction.
+            const double h = qdata.h0 * kernels::Norml2(DIM, ph_dir) /
+                             kernels::Norml2(DIM, compr_dir);
+            // Measure of maximal compression.
+            const double mu = eig_val_data[0];
+            visc_coeff = 2.0 * rho * h * h * fabs(mu);
+            // The following represents a "smooth" version of the statement
+            // "if (mu < 0) visc_coeff += 0.5 rho h sound_speed".  Note that
+            // eps must be scaled appropriately if a different unit system is
+            // being used.
+            const double eps = 1e-12;
+            visc_coeff += 0.5 * rho * h * sound_speed * vorticity_coeff *
+                          (1.0 - smooth_step_01(mu - 2.0 * eps, eps));
+            kernels::Add(DIM, DIM, visc_coeff, stress, sgrad_v, stress);
+         }
+         // Time step estimate at the point. Here the more relevant length
+         // scale is related to the actual mesh deformation; we use the min
+         // singular value of the ref->physical Jacobian. In addition, the
+         // time step estimate should be aware of the presence of shocks.
+         const double h_min = CalcMinSingularvalue<DIM>(J) / h1order;
+         const double inv_dt = sound_speed / h_min +
+                               2.5 * visc_coeff / rho / h_min / h_min;
+         if (min_detJ < 0.0)
+         {
+            // This will force repetition of the step with smaller dt.
+            dt_est = 0.0;
+         }
+         else
+         {
+            if (inv_dt>0.0)
             {
-               if (inv_dt>0.0)
-               {
-                  qdata.dt_est = fmin(qdata.dt_est, cfl*(1.0/inv_dt));
-               }
+               dt_est = fmin(dt_est, cfl*(1.0/inv_dt));
             }
-            // Quadrature data for partial assembly of the force operator.
-            MultABt(stress, Jinv, stressJiT);
-            stressJiT *= ir.IntPoint(q).weight * detJ;
-            for (int vd = 0 ; vd < dim; vd++)
+         }
+         // Quadrature data for partial assembly of the force operator.
+         kernels::MultABt(DIM, DIM, DIM, stress, Jinv, stressJiT);
+         for (int k = 0; k < DIM2; k++) { stressJiT[k] *= W[q] * detJ; }
+         for (int vd = 0 ; vd < DIM; vd++)
+         {
+            for (int gd = 0; gd < DIM; gd++)
             {
-               for (int gd = 0; gd < dim; gd++)
-               {
-                  qdata.stressJinvT(vd)(z_id*nqp + q, gd) =
-                     stressJiT(vd, gd);
-               }
+               stressJinvT[q + nqp*(gd + vd*DIM + DIM2*ez)] =
+                  stressJiT[vd + gd*DIM];
             }
          }
-         ++z_id;
-      }
-   }
-   delete [] gamma_b;
-   delete [] rho_b;
-   delete [] e_b;
-   delete [] p_b;
-   delete [] cs_b;
-   delete [] Jpr_b;
-   timer.sw_qdata.Stop();
-   timer.quad_tstep += NE;
-}
-
-/// Trace of a square matrix
-template<int H, int W, typename T>
-MFEM_HOST_DEVICE inline
-double Trace(const T * __restrict__ data)
-{
-   double t = 0.0;
-   for (int i = 0; i < W; i++) { t += data[i+i*H]; }
-   return t;
-}
-
-template<int H, int W, typename T>
-MFEM_HOST_DEVICE static inline
-void SFNorm(double &scale_factor, double &scaled_fnorm2,
-            const T * __restrict__ data)
-{
-   int i;
-   constexpr int hw = H * W;
-   T max_norm = 0.0, entry, fnorm2;
-
-   for (i = 0; i < hw; i++)
-   {
-      entry = fabs(data[i]);
-      if (entry > max_norm)
-      {
-         max_norm = entry;
-      }
-   }
-
-   if (max_norm == 0.0)
-   {
-      scale_factor = scaled_fnorm2 = 0.0;
-      return;
-   }
-
-   fnorm2 = 0.0;
-   for (i = 0; i < hw; i++)
-   {
-      entry = data[i] / max_norm;
-      fnorm2 += entry * entry;
-   }
-
-   scale_factor = max_norm;
-   scaled_fnorm2 = fnorm2;
-}
-
-/// Compute the Frobenius norm of the matrix
-template<int H, int W, typename T>
-MFEM_HOST_DEVICE inline
-double FNorm(const T * __restrict__ data)
-{
-   double s, n2;
-   SFNorm<H,W>(s, n2, data);
-   return s*sqrt(n2);
-}
-
-template<int DIM> MFEM_HOST_DEVICE static inline
-void QUpdateBody(const int NE, const int e,
-                 const int NQ, const int q,
-                 const bool use_viscosity,
-                 const bool use_vorticity,
-                 const double h0,
-                 const double h1order,
-                 const double cfl,
-                 const double infinity,
-                 double* __restrict__ Jinv,
-                 double* __restrict__ stress,
-                 double* __restrict__ sgrad_v,
-                 double* __restrict__ eig_val_data,
-                 double* __restrict__ eig_vec_data,
-                 double* __restrict__ compr_dir,
-                 double* __restrict__ Jpi,
-                 double* __restrict__ ph_dir,
-                 double* __restrict__ stressJiT,
-                 const double* __restrict__ d_gamma,
-                 const double* __restrict__ d_weights,
-                 const double* __restrict__ d_Jacobians,
-                 const double* __restrict__ d_rho0DetJ0w,
-                 const double* __restrict__ d_e_quads,
-                 const double* __restrict__ d_grad_v_ext,
-                 const double* __restrict__ d_Jac0inv,
-                 double *d_dt_est,
-                 double *d_stressJinvT)
-{
-   constexpr int DIM2 = DIM*DIM;
-   double min_detJ = infinity;
-
-   const int eq = e * NQ + q;
-   const double gamma = d_gamma[e];
-   const double weight =  d_weights[q];
-   const double inv_weight = 1. / weight;
-   const double *J = d_Jacobians + DIM2*(NQ*e + q);
-   const double detJ = kernels::Det<DIM>(J);
-   min_detJ = fmin(min_detJ, detJ);
-   kernels::CalcInverse<DIM>(J, Jinv);
-   const double R = inv_weight * d_rho0DetJ0w[eq] / detJ;
-   const double E = fmax(0.0, d_e_quads[eq]);
-   const double P = (gamma - 1.0) * R * E;
-   const double S = sqrt(gamma * (gamma - 1.0) * E);
-   for (int k = 0; k < DIM2; k++) { stress[k] = 0.0; }
-   for (int d = 0; d < DIM; d++) { stress[d*DIM+d] = -P; }
-   double visc_coeff = 0.0;
-   if (use_viscosity)
-   {
-      // Compression-based length scale at the point. The first
-      // eigenvector of the symmetric velocity gradient gives the
-      // direction of maximal compression. This is used to define the
-      // relative change of the initial length scale.
-      const double *dV = d_grad_v_ext + DIM2*(NQ*e + q);
-      kernels::Mult(DIM, DIM, DIM, dV, Jinv, sgrad_v);
-
-      double vorticity_coeff = 1.0;
-      if (use_vorticity)
-      {
-         const double grad_norm = FNorm<DIM,DIM>(sgrad_v);
-         const double div_v = fabs(Trace<DIM,DIM>(sgrad_v));
-         vorticity_coeff = (grad_norm > 0.0) ? div_v / grad_norm : 1.0;
-      }
-
-      kernels::Symmetrize(DIM, sgrad_v);
-      if (DIM == 1)
-      {
-         eig_val_data[0] = sgrad_v[0];
-         eig_vec_data[0] = 1.;
-      }
-      else
-      {
-         kernels::CalcEigenvalues<DIM>(sgrad_v, eig_val_data, eig_vec_data);
-      }
-      for (int k=0; k<DIM; k++) { compr_dir[k] = eig_vec_data[k]; }
-      // Computes the initial->physical transformation Jacobian.
-      kernels::Mult(DIM, DIM, DIM, J, d_Jac0inv + eq*DIM*DIM, Jpi);
-      kernels::Mult(DIM, DIM, Jpi, compr_dir, ph_dir);
-      // Change of the initial mesh size in the compression direction.
-      const double ph_dir_nl2 = kernels::Norml2(DIM, ph_dir);
-      const double compr_dir_nl2 = kernels::Norml2(DIM, compr_dir);
-      const double H = h0 * ph_dir_nl2 / compr_dir_nl2;
-      // Measure of maximal compression.
-      const double mu = eig_val_data[0];
-      visc_coeff = 2.0 * R * H * H * fabs(mu);
-      // The following represents a "smooth" version of the statement
-      // "if (mu < 0) visc_coeff += 0.5 rho h sound_speed".  Note that
-      // eps must be scaled appropriately if a different unit system is
-      // being used.
-      const double eps = 1e-12;
-      visc_coeff += 0.5 * R * H  * S * vorticity_coeff *
-                    (1.0 - smooth_step_01(mu-2.0*eps, eps));
-      kernels::Add(DIM, DIM, visc_coeff, stress, sgrad_v, stress);
-   }
-   // Time step estimate at the point. Here the more relevant length
-   // scale is related to the actual mesh deformation; we use the min
-   // singular value of the ref->physical Jacobian. In addition, the
-   // time step estimate should be aware of the presence of shocks.
-   const double sv = kernels::CalcSingularvalue<DIM>(J, DIM - 1);
-   const double h_min = sv / h1order;
-   const double ih_min = 1. / h_min;
-   const double irho_ih_min_sq = ih_min * ih_min / R ;
-   const double idt = S * ih_min + 2.5 * visc_coeff * irho_ih_min_sq;
-   if (min_detJ < 0.0)
-   {
-      // This will force repetition of the step with smaller dt.
-      d_dt_est[eq] = 0.0;
-   }
-   else
-   {
-      if (idt > 0.0)
-      {
-         const double cfl_inv_dt = cfl / idt;
-         d_dt_est[eq] = fmin(d_dt_est[eq], cfl_inv_dt);
-      }
-   }
-   // Quadrature data for partial assembly of the force operator.
-   kernels::MultABt(DIM, DIM, DIM, stress, Jinv, stressJiT);
-   for (int k = 0; k < DIM2; k++) { stressJiT[k] *= weight * detJ; }
-   for (int vd = 0 ; vd < DIM; vd++)
-   {
-      for (int gd = 0; gd < DIM; gd++)
-      {
-         const int offset = eq + NQ*NE*(gd + vd*DIM);
-         d_stressJinvT[offset] = stressJiT[vd + gd*DIM];
       }
    }
+   qdata.dt_est = dt_est;
 }
 
 static void Rho0DetJ0Vol(const int dim, const int NE,
@@ -1116,7 +1664,7 @@ static void Rho0DetJ0Vol(const int dim, const int NE,
    Memory<double> &Jinv_m = qdata.Jac0inv.GetMemory();
    const MemoryClass mc = Device::GetMemoryClass();
    const int Ji_total_size = qdata.Jac0inv.TotalSize();
-   auto invJ = Reshape(Jinv_m.Write(mc, Ji_total_size), dim, dim, NQ, NE);
+   auto invJ = Reshape(Jinv_m.Write(mc, Ji_total_size), NQ, dim, dim, NE);
    Vector vol(NE*NQ), one(NE*NQ);
    auto A = Reshape(vol.Write(), NQ, NE);
    auto O = Reshape(one.Write(), NQ, NE);
@@ -1137,10 +1685,10 @@ static void Rho0DetJ0Vol(const int dim, const int NE,
                const double det = detJ(q,e);
                V(q,e) =  W[q] * R(q,e) * det;
                const double r_idetJ = 1.0 / det;
-               invJ(0,0,q,e) =  J22 * r_idetJ;
-               invJ(1,0,q,e) = -J12 * r_idetJ;
-               invJ(0,1,q,e) = -J21 * r_idetJ;
-               invJ(1,1,q,e) =  J11 * r_idetJ;
+               invJ(q,0,0,e) =  J22 * r_idetJ;
+               invJ(q,1,0,e) = -J12 * r_idetJ;
+               invJ(q,0,1,e) = -J21 * r_idetJ;
+               invJ(q,1,1,e) =  J11 * r_idetJ;
                A(q,e) = W[q] * det;
                O(q,e) = 1.0;
             }
@@ -1164,15 +1712,15 @@ static void Rho0DetJ0Vol(const int dim, const int NE,
                   const double det = detJ(q,e);
                   V(q,e) = W[q] * R(q,e) * det;
                   const double r_idetJ = 1.0 / det;
-                  invJ(0,0,q,e) = r_idetJ * ((J22 * J33)-(J23 * J32));
-                  invJ(1,0,q,e) = r_idetJ * ((J32 * J13)-(J33 * J12));
-                  invJ(2,0,q,e) = r_idetJ * ((J12 * J23)-(J13 * J22));
-                  invJ(0,1,q,e) = r_idetJ * ((J23 * J31)-(J21 * J33));
-                  invJ(1,1,q,e) = r_idetJ * ((J33 * J11)-(J31 * J13));
-                  invJ(2,1,q,e) = r_idetJ * ((J13 * J21)-(J11 * J23));
-                  invJ(0,2,q,e) = r_idetJ * ((J21 * J32)-(J22 * J31));
-                  invJ(1,2,q,e) = r_idetJ * ((J31 * J12)-(J32 * J11));
-                  invJ(2,2,q,e) = r_idetJ * ((J11 * J22)-(J12 * J21));
+                  invJ(q,0,0,e) = r_idetJ * ((J22 * J33)-(J23 * J32));
+                  invJ(q,1,0,e) = r_idetJ * ((J32 * J13)-(J33 * J12));
+                  invJ(q,2,0,e) = r_idetJ * ((J12 * J23)-(J13 * J22));
+                  invJ(q,0,1,e) = r_idetJ * ((J23 * J31)-(J21 * J33));
+                  invJ(q,1,1,e) = r_idetJ * ((J33 * J11)-(J31 * J13));
+                  invJ(q,2,1,e) = r_idetJ * ((J13 * J21)-(J11 * J23));
+                  invJ(q,0,2,e) = r_idetJ * ((J21 * J32)-(J22 * J31));
+                  invJ(q,1,2,e) = r_idetJ * ((J31 * J12)-(J32 * J11));
+                  invJ(q,2,2,e) = r_idetJ * ((J11 * J22)-(J12 * J21));
                   A(q,e) = W[q] * det;
                   O(q,e) = 1.0;
                }
@@ -1184,23 +1732,61 @@ static void Rho0DetJ0Vol(const int dim, const int NE,
    volume = vol * one;
 }
 
-template<int DIM, int Q1D> static inline
-void QKernel(const int NE, const int NQ,
-             const bool use_viscosity,
-             const bool use_vorticity,
-             const double h0,
-             const double h1order,
-             const double cfl,
-             const double infinity,
-             const ParGridFunction &gamma_gf,
-             const Array<double> &weights,
-             const Vector &Jacobians,
-             const Vector &rho0DetJ0w,
-             const Vector &e_quads,
-             const Vector &grad_v_ext,
-             const DenseTensor &Jac0inv,
-             Vector &dt_est,
-             DenseTensor &stressJinvT)
+// Stores Jac0inv once per zone when the initial Jacobians are constant in
+// every zone, i.e., for affine initial meshes. The check is local, so the MPI
+// tasks may end up with different layouts, which the kernels handle.
+static void CompactJac0inv(DenseTensor &Jac0inv)
+{
+   const int NQ = Jac0inv.SizeI(), NC = Jac0inv.SizeJ(), NE = Jac0inv.SizeK();
+   if (NQ == 1) { return; }
+   const double *J0 = HostRead(Jac0inv.GetMemory(), Jac0inv.TotalSize());
+   for (int e = 0; e < NE; e++)
+   {
+      for (int c = 0; c < NC; c++)
+      {
+         const double *Jc = J0 + NQ*(c + NC*e);
+         const double tol = 1e-12 * fmax(1.0, fabs(Jc[0]));
+         for (int q = 1; q < NQ; q++)
+         {
+            if (fabs(Jc[q] - Jc[0]) > tol) { return; }
+         }
+      }
+   }
+   Vector J0e(NC*NE);
+   for (int k = 0; k < NC*NE; k++) { J0e(k) = J0[NQ*k]; }
+   Jac0inv.Clear();
+   Jac0inv.SetSize(1, NC, NE);
+   double *J = HostWrite(Jac0inv.GetMemory(), Jac0inv.TotalSize());
+   for (int k = 0; k < NC*NE; k++) { J[k] = J0e(k); }
+}
+
+// Fused versions of QKernel and ForcePAOperator::Mult/MultTranspose. The
+// stress of each element is kept in shared memory, where it is contracted with
+// the velocity gradients (energy RHS) and with the H1 basis gradients
+// (velocity RHS). Since the L2 basis is a partition of unity, the velocity RHS
+// corresponds to the action of the force matrix on the unit energy vector.
+template<int DIM, int D1D, int Q1D, int L1D> static
+void QForceKernel2D(const int NE, const int NQ,
+                    const bool use_viscosity,
+                    const bool use_vorticity,
+                    const double h0,
+                    const double h1order,
+                    const double cfl,
+                    const double infinity,
+                    const ParGridFunction &gamma_gf,
+                    const Array<double> &weights,
+                    const Vector &Jacobians,
+                    const Vector &rho0DetJ0w,
+                    const Vector &e_quads,
+                    const Vector &grad_v_ext,
+                    const DenseTensor &Jac0inv,
+                    const MaterialEOS eos,
+                    const Array<double> &H1Bt_,
+                    const Array<double> &H1Gt_,
+                    const Array<double> &L2Bt_,
+                    Vector &dt_est,
+                    Vector &force,
+                    Vector &energy)
 {
    constexpr int DIM2 = DIM*DIM;
    const auto d_gamma = gamma_gf.Read();
@@ -1209,79 +1795,416 @@ void QKernel(const int NE, const int NQ,
    const auto d_rho0DetJ0w = rho0DetJ0w.Read();
    const auto d_e_quads = e_quads.Read();
    const auto d_grad_v_ext = grad_v_ext.Read();
+   const int NJ0 = Jac0inv.SizeI();
    const auto d_Jac0inv = Read(Jac0inv.GetMemory(), Jac0inv.TotalSize());
-   auto d_dt_est = dt_est.ReadWrite();
-   auto d_stressJinvT = Write(stressJinvT.GetMemory(), stressJinvT.TotalSize());
-   if (DIM == 2)
+   auto d_dt_est = dt_est.Write();
+   auto bt = Reshape(H1Bt_.Read(), D1D, Q1D);
+   auto gt = Reshape(H1Gt_.Read(), D1D, Q1D);
+   auto blt = Reshape(L2Bt_.Read(), L1D, Q1D);
+   const double eps1 = std::numeric_limits<double>::epsilon();
+   const double eps2 = eps1*eps1;
+   auto velocity = Reshape(force.Write(), D1D, D1D, DIM, NE);
+   auto d_energy = Reshape(energy.Write(), L1D, L1D, NE);
+
+   MFEM_FORALL_2D(e, NE, Q1D, Q1D, 1,
    {
-      MFEM_FORALL_2D(e, NE, Q1D, Q1D, 1,
+      double Jinv[DIM2];
+      double stress[DIM2];
+      double sgrad_v[DIM2];
+      double eig_val_data[3];
+      double eig_vec_data[9];
+      double compr_dir[DIM];
+      double Jpi[DIM2];
+      double ph_dir[DIM];
+      double stressJiT[DIM2];
+
+      MFEM_SHARED double Bt[D1D][Q1D];
+      MFEM_SHARED double Gt[D1D][Q1D];
+      MFEM_SHARED double BLt[L1D][Q1D];
+      MFEM_SHARED double sJ[DIM2][Q1D][Q1D];
+      MFEM_SHARED double QE[Q1D][Q1D];
+      MFEM_SHARED double LQ0[D1D][Q1D];
+      MFEM_SHARED double LQ1[D1D][Q1D];
+      MFEM_SHARED double QL[Q1D][L1D];
+      MFEM_SHARED double DT[Q1D*Q1D];
+
+      MFEM_FOREACH_THREAD(q,x,Q1D)
+      {
+         MFEM_FOREACH_THREAD(d,y,Q1D)
+         {
+            if (d < D1D) { Bt[d][q] = bt(d,q); }
+            if (d < D1D) { Gt[d][q] = gt(d,q); }
+            if (d < L1D) { BLt[d][q] = blt(d,q); }
+         }
+      }
+      MFEM_FOREACH_THREAD(qy,y,Q1D)
       {
-         double Jinv[DIM2];
-         double stress[DIM2];
-         double sgrad_v[DIM2];
-         double eig_val_data[3];
-         double eig_vec_data[9];
-         double compr_dir[DIM];
-         double Jpi[DIM2];
-         double ph_dir[DIM];
-         double stressJiT[DIM2];
          MFEM_FOREACH_THREAD(qx,x,Q1D)
          {
-            MFEM_FOREACH_THREAD(qy,y,Q1D)
+            const int q = qx + qy * Q1D;
+            DT[q] = infinity;
+            QUpdateBody<DIM>(NE, e, NQ, q,
+                             use_viscosity, use_vorticity, h0, h1order, cfl, infinity,
+                             Jinv, stress, sgrad_v, eig_val_data, eig_vec_data,
+                             compr_dir, Jpi, ph_dir, stressJiT,
+                             d_gamma, d_weights, d_Jacobians, d_rho0DetJ0w,
+                             d_e_quads, d_grad_v_ext, NJ0, d_Jac0inv,
+                             eos, DT[q], (double*) nullptr);
+            // grad(v) : stressJiT, the integrand of the energy RHS.
+            const double *dV = d_grad_v_ext + DIM2*(NQ*e + q);
+            double qe = 0.0;
+            for (int k = 0; k < DIM2; k++)
+            {
+               sJ[k][qy][qx] = stressJiT[k];
+               qe += dV[k] * stressJiT[k];
+            }
+            QE[qy][qx] = qe;
+         }
+      }
+      MFEM_SYNC_THREAD;
+      ElementDtEstimate(e, Q1D*Q1D, DT, d_dt_est);
+
+      for (int c = 0; c < DIM; ++c)
+      {
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(dx,x,D1D)
+            {
+               double u = 0.0;
+               double v = 0.0;
+               for (int qx = 0; qx < Q1D; ++qx)
+               {
+                  u += Gt[dx][qx] * sJ[c][qy][qx];
+                  v += Bt[dx][qx] * sJ[c + DIM][qy][qx];
+               }
+               LQ0[dx][qy] = u;
+               LQ1[dx][qy] = v;
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(dy,y,D1D)
+         {
+            MFEM_FOREACH_THREAD(dx,x,D1D)
             {
-               QUpdateBody<DIM>(NE, e, NQ, qx + qy * Q1D,
+               double u = 0.0;
+               double v = 0.0;
+               for (int qy = 0; qy < Q1D; ++qy)
+               {
+                  u += LQ0[dx][qy] * Bt[dy][qy];
+                  v += LQ1[dx][qy] * Gt[dy][qy];
+               }
+               const double f = u + v;
+               velocity(dx,dy,c,e) = (fabs(f) < eps2) ? 0.0 : f;
+            }
+         }
+         MFEM_SYNC_THREAD;
+      }
+
+      MFEM_FOREACH_THREAD(qy,y,Q1D)
+      {
+         MFEM_FOREACH_THREAD(lx,x,L1D)
+         {
+            double u = 0.0;
+            for (int qx = 0; qx < Q1D; ++qx)
+            {
+               u += QE[qy][qx] * BLt[lx][qx];
+            }
+            QL[qy][lx] = u;
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(ly,y,L1D)
+      {
+         MFEM_FOREACH_THREAD(lx,x,L1D)
+         {
+            double u = 0.0;
+            for (int qy = 0; qy < Q1D; ++qy)
+            {
+               u += QL[qy][lx] * BLt[ly][qy];
+            }
+            d_energy(lx,ly,e) = u;
+         }
+      }
+      MFEM_SYNC_THREAD;
+   });
+}
+
+template<int DIM, int D1D, int Q1D, int L1D> static
+void QForceKernel3D(const int NE, const int NQ,
+                    const bool use_viscosity,
+                    const bool use_vorticity,
+                    const double h0,
+                    const double h1order,
+                    const double cfl,
+                    const double infinity,
+                    const ParGridFunction &gamma_gf,
+                    const Array<double> &weights,
+                    const Vector &Jacobians,
+                    const Vector &rho0DetJ0w,
+                    const Vector &e_quads,
+                    const Vector &grad_v_ext,
+                    const DenseTensor &Jac0inv,
+                    const MaterialEOS eos,
+                    const Array<double> &H1Bt_,
+                    const Array<double> &H1Gt_,
+                    const Array<double> &L2Bt_,
+                    Vector &dt_est,
+                    Vector &force,
+                    Vector &energy)
+{
+   constexpr int DIM2 = DIM*DIM;
+   constexpr int QQQ = Q1D*Q1D*Q1D;
+   const auto d_gamma = gamma_gf.Read();
+   const auto d_weights = weights.Read();
+   const auto d_Jacobians = Jacobians.Read();
+   const auto d_rho0DetJ0w = rho0DetJ0w.Read();
+   const auto d_e_quads = e_quads.Read();
+   const auto d_grad_v_ext = grad_v_ext.Read();
+   const int NJ0 = Jac0inv.SizeI();
+   const auto d_Jac0inv = Read(Jac0inv.GetMemory(), Jac0inv.TotalSize());
+   auto d_dt_est = dt_est.Write();
+   auto bt = Reshape(H1Bt_.Read(), D1D, Q1D);
+   auto gt = Reshape(H1Gt_.Read(), D1D, Q1D);
+   auto blt = Reshape(L2Bt_.Read(), L1D, Q1D);
+   const double eps1 = std::numeric_limits<double>::epsilon();
+   const double eps2 = eps1*eps1;
+   auto velocity = Reshape(force.Write(), D1D, D1D, D1D, DIM, NE);
+   auto d_energy = Reshape(energy.Write(), L1D, L1D, L1D, NE);
+
+   MFEM_FORALL_3D(e, NE, Q1D, Q1D, Q1D,
+   {
+      double Jinv[DIM2];
+      double stress[DIM2];
+      double sgrad_v[DIM2];
+      double eig_val_data[3];
+      double eig_vec_data[9];
+      double compr_dir[DIM];
+      double Jpi[DIM2];
+      double ph_dir[DIM];
+      double stressJiT[DIM2];
+
+      MFEM_SHARED double Bt[D1D][Q1D];
+      MFEM_SHARED double Gt[D1D][Q1D];
+      MFEM_SHARED double BLt[L1D][Q1D];
+
+      MFEM_SHARED double sJ[DIM2][QQQ];
+      MFEM_SHARED double QE[Q1D][Q1D][Q1D];
+      MFEM_SHARED double DT[QQQ];
+
+      MFEM_SHARED double sm0[3][D1D*D1D*Q1D];
+      MFEM_SHARED double sm1[3][D1D*Q1D*Q1D];
+      double (*MMQ0)[D1D][Q1D] = (double (*)[D1D][Q1D]) (sm0+0);
+      double (*MMQ1)[D1D][Q1D] = (double (*)[D1D][Q1D]) (sm0+1);
+      double (*MMQ2)[D1D][Q1D] = (double (*)[D1D][Q1D]) (sm0+2);
+
+      double (*MQQ0)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+0);
+      double (*MQQ1)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+1);
+      double (*MQQ2)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sm1+2);
+
+      // The energy contractions reuse the velocity buffers (L1D < D1D).
+      double (*QQL)[Q1D][L1D] = (double (*)[Q1D][L1D]) (sm1+0);
+      double (*QLL)[L1D][L1D] = (double (*)[L1D][L1D]) (sm0+0);
+
+      if (MFEM_THREAD_ID(z) == 0)
+      {
+         MFEM_FOREACH_THREAD(q,x,Q1D)
+         {
+            MFEM_FOREACH_THREAD(d,y,Q1D)
+            {
+               if (d < D1D) { Bt[d][q] = bt(d,q); }
+               if (d < D1D) { Gt[d][q] = gt(d,q); }
+               if (d < L1D) { BLt[d][q] = blt(d,q); }
+            }
+         }
+      }
+      MFEM_FOREACH_THREAD(qz,z,Q1D)
+      {
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(qx,x,Q1D)
+            {
+               const int q = qx + Q1D * (qy + qz * Q1D);
+               DT[q] = infinity;
+               QUpdateBody<DIM>(NE, e, NQ, q,
                                 use_viscosity, use_vorticity, h0, h1order, cfl, infinity,
                                 Jinv, stress, sgrad_v, eig_val_data, eig_vec_data,
                                 compr_dir, Jpi, ph_dir, stressJiT,
                                 d_gamma, d_weights, d_Jacobians, d_rho0DetJ0w,
-                                d_e_quads, d_grad_v_ext, d_Jac0inv,
-                                d_dt_est, d_stressJinvT);
+                                d_e_quads, d_grad_v_ext, NJ0, d_Jac0inv,
+                                eos, DT[q], (double*) nullptr);
+               // grad(v) : stressJiT, the integrand of the energy RHS.
+               const double *dV = d_grad_v_ext + DIM2*(NQ*e + q);
+               double qe = 0.0;
+               for (int k = 0; k < DIM2; k++)
+               {
+                  sJ[k][q] = stressJiT[k];
+                  qe += dV[k] * stressJiT[k];
+               }
+               QE[qz][qy][qx] = qe;
             }
          }
-         MFEM_SYNC_THREAD;
-      });
-   }
-   if (DIM == 3)
-   {
-      MFEM_FORALL_3D(e, NE, Q1D, Q1D, Q1D,
+      }
+      MFEM_SYNC_THREAD;
+      ElementDtEstimate(e, QQQ, DT, d_dt_est);
+
+      for (int c = 0; c < DIM; ++c)
       {
-         double Jinv[DIM2];
-         double stress[DIM2];
-         double sgrad_v[DIM2];
-         double eig_val_data[3];
-         double eig_vec_data[9];
-         double compr_dir[DIM];
-         double Jpi[DIM2];
-         double ph_dir[DIM];
-         double stressJiT[DIM2];
-         MFEM_FOREACH_THREAD(qx,x,Q1D)
+         const double (*QQQ0)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sJ[c]);
+         const double (*QQQ1)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sJ[c + DIM]);
+         const double (*QQQ2)[Q1D][Q1D] = (double (*)[Q1D][Q1D]) (sJ[c + 2*DIM]);
+         MFEM_FOREACH_THREAD(qz,z,Q1D)
          {
             MFEM_FOREACH_THREAD(qy,y,Q1D)
             {
-               MFEM_FOREACH_THREAD(qz,z,Q1D)
+               MFEM_FOREACH_THREAD(hx,x,D1D)
                {
-                  QUpdateBody<DIM>(NE, e, NQ, qx + Q1D * (qy + qz * Q1D),
-                                   use_viscosity, use_vorticity, h0, h1order, cfl, infinity,
-                                   Jinv, stress, sgrad_v, eig_val_data, eig_vec_data,
-                                   compr_dir, Jpi, ph_dir, stressJiT,
-                                   d_gamma, d_weights, d_Jacobians, d_rho0DetJ0w,
-                                   d_e_quads, d_grad_v_ext, d_Jac0inv,
-                                   d_dt_est, d_stressJinvT);
+                  double u = 0.0;
+                  double v = 0.0;
+                  double w = 0.0;
+                  for (int qx = 0; qx < Q1D; ++qx)
+                  {
+                     u += Gt[hx][qx] * QQQ0[qz][qy][qx];
+                     v += Bt[hx][qx] * QQQ1[qz][qy][qx];
+                     w += Bt[hx][qx] * QQQ2[qz][qy][qx];
+                  }
+                  MQQ0[hx][qy][qz] = u;
+                  MQQ1[hx][qy][qz] = v;
+                  MQQ2[hx][qy][qz] = w;
                }
             }
          }
          MFEM_SYNC_THREAD;
-      });
-   }
+         MFEM_FOREACH_THREAD(qz,z,Q1D)
+         {
+            MFEM_FOREACH_THREAD(hy,y,D1D)
+            {
+               MFEM_FOREACH_THREAD(hx,x,D1D)
+               {
+                  double u = 0.0;
+                  double v = 0.0;
+                  double w = 0.0;
+                  for (int qy = 0; qy < Q1D; ++qy)
+                  {
+                     u += MQQ0[hx][qy][qz] * Bt[hy][qy];
+                     v += MQQ1[hx][qy][qz] * Gt[hy][qy];
+                     w += MQQ2[hx][qy][qz] * Bt[hy][qy];
+                  }
+                  MMQ0[hx][hy][qz] = u;
+                  MMQ1[hx][hy][qz] = v;
+                  MMQ2[hx][hy][qz] = w;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+         MFEM_FOREACH_THREAD(hz,z,D1D)
+         {
+            MFEM_FOREACH_THREAD(hy,y,D1D)
+            {
+               MFEM_FOREACH_THREAD(hx,x,D1D)
+               {
+                  double u = 0.0;
+                  double v = 0.0;
+                  double w = 0.0;
+                  for (int qz = 0; qz < Q1D; ++qz)
+                  {
+                     u += MMQ0[hx][hy][qz] * Bt[hz][qz];
+                     v += MMQ1[hx][hy][qz] * Bt[hz][qz];
+                     w += MMQ2[hx][hy][qz] * Gt[hz][qz];
+                  }
+                  const double f = u + v + w;
+                  velocity(hx,hy,hz,c,e) = (fabs(f) < eps2) ? 0.0 : f;
+               }
+            }
+         }
+         MFEM_SYNC_THREAD;
+      }
+
+      MFEM_FOREACH_THREAD(qz,z,Q1D)
+      {
+         MFEM_FOREACH_THREAD(qy,y,Q1D)
+         {
+            MFEM_FOREACH_THREAD(lx,x,L1D)
+            {
+               double u = 0.0;
+               for (int qx = 0; qx < Q1D; ++qx)
+               {
+                  u += QE[qz][qy][qx] * BLt[lx][qx];
+               }
+               QQL[qz][qy][lx] = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(qz,z,Q1D)
+      {
+         MFEM_FOREACH_THREAD(ly,y,L1D)
+         {
+            MFEM_FOREACH_THREAD(lx,x,L1D)
+            {
+               double u = 0.0;
+               for (int qy = 0; qy < Q1D; ++qy)
+               {
+                  u += QQL[qz][qy][lx] * BLt[ly][qy];
+               }
+               QLL[qz][ly][lx] = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+      MFEM_FOREACH_THREAD(lz,z,L1D)
+      {
+         MFEM_FOREACH_THREAD(ly,y,L1D)
+         {
+            MFEM_FOREACH_THREAD(lx,x,L1D)
+            {
+               double u = 0.0;
+               for (int qz = 0; qz < Q1D; ++qz)
+               {
+                  u += QLL[qz][ly][lx] * BLt[lz][qz];
+               }
+               d_energy(lx,ly,lz,e) = u;
+            }
+         }
+      }
+      MFEM_SYNC_THREAD;
+   });
 }
 
-void QUpdate::UpdateQuadratureData(const Vector &S, QuadratureData &qdata)
+typedef void (*fQForceKernel)(const int NE, const int NQ,
+                              const bool use_viscosity,
+                              const bool use_vorticity,
+                              const double h0, const double h1order,
+                              const double cfl, const double infinity,
+                              const ParGridFunction &gamma_gf,
+                              const Array<double> &weights,
+                              const Vector &Jacobians, const Vector &rho0DetJ0w,
+                              const Vector &e_quads, const Vector &grad_v_ext,
+                              const DenseTensor &Jac0inv,
+                              const MaterialEOS eos,
+                              const Array<double> &H1Bt,
+                              const Array<double> &H1Gt,
+                              const Array<double> &L2Bt,
+                              Vector &dt_est, Vector &force, Vector &energy);
+
+static fQForceKernel GetQForceKernel(const int id)
+{
+   // The 3D Q1D=8 version does not fit in the shared memory of the device.
+   static std::unordered_map<int, fQForceKernel> call =
+   {
+      {0x234,&QForceKernel2D<2,3,4,2>},
+      {0x246,&QForceKernel2D<2,4,6,3>},
+      {0x258,&QForceKernel2D<2,5,8,4>},
+      {0x334,&QForceKernel3D<3,3,4,2>},
+      {0x346,&QForceKernel3D<3,4,6,3>}
+   };
+   const auto it = call.find(id);
+   return (it == call.end()) ? nullptr : it->second;
+}
+
+void QUpdate::InterpolateState(const Vector &S)
 {
-   timer->sw_qdata.Start();
    Vector* S_p = const_cast<Vector*>(&S);
    const int H1_size = H1.GetVSize();
-   const double h1order = (double) H1.GetOrder(0);
-   const double infinity = std::numeric_limits<double>::infinity();
    ParGridFunction x, v, e;
    x.MakeRef(&H1,*S_p, 0);
    H1R->Mult(x, e_vec);
@@ -1293,44 +2216,384 @@ void QUpdate::UpdateQuadratureData(const Vector &S, QuadratureData &qdata)
    e.MakeRef(&L2, *S_p, 2*H1_size);
    q2->SetOutputLayout(QVectorLayout::byVDIM);
    q2->Values(e, q_e);
-   q_dt_est = qdata.dt_est;
+}
+
+int QUpdate::ForceKernelId() const
+{
+   const int D1D = H1.GetFE(0)->GetOrder() + 1;
+   const int L1D = L2.GetFE(0)->GetOrder() + 1;
+   if (L1D != D1D - 1) { return 0; }
+   return (dim << 8) | (D1D << 4) | Q1D;
+}
+
+bool QUpdate::HasForceKernel() const
+{
+   return GetQForceKernel(ForceKernelId()) != nullptr;
+}
+
+void QUpdate::UpdateQuadratureForces(const Vector &S, QuadratureData &qdata,
+                                     Vector &rhs, Vector &e_rhs)
+{
+   const fQForceKernel kernel = GetQForceKernel(ForceKernelId());
+   MFEM_VERIFY(kernel, "Unknown fused force kernel");
+   timer->sw_qdata.Start();
+   const double h1order = (double) H1.GetOrder(0);
+   const double infinity = std::numeric_limits<double>::infinity();
+   timer->regions.Start("InterpolateState");
+   InterpolateState(S);
+   timer->regions.Stop();
+   timer->regions.Start("QForceKernel");
+   q_dt_est.SetSize(NE);
+   force_e.SetSize(H1R->Height());
+   energy_e.SetSize(NE * L2.GetFE(0)->GetDof());
+   force_e.UseDevice(true);
+   energy_e.UseDevice(true);
+   kernel(NE, NQ, use_viscosity, use_vorticity, qdata.h0, h1order,
+          cfl, infinity, gamma_gf, ir.GetWeights(), q_dx,
+          qdata.rho0DetJ0w, q_e, q_dv, qdata.Jac0inv, eos,
+          H1D2Q->Bt, H1D2Q->Gt, L2D2Q->Bt,
+          q_dt_est, force_e, energy_e);
+   qdata.dt_est = fmin(qdata.dt_est, q_dt_est.Min());
+   timer->regions.Stop();
+   timer->sw_qdata.Stop();
+   timer->quad_tstep += NE;
+   timer->sw_force.Start();
+   timer->regions.Start("Force");
+   H1R->MultTranspose(force_e, rhs);
+   if (L2R) { L2R->MultTranspose(energy_e, e_rhs); }
+   else { e_rhs = energy_e; }
+   timer->regions.Stop();
+   timer->sw_force.Stop();
+}
+
+template<typename T>
+void QUpdate::QuadratureKernel(QuadratureData &qdata, Memory<T> &stressJinvT)
+{
+   const double h1order = (double) H1.GetOrder(0);
+   const double infinity = std::numeric_limits<double>::infinity();
    const int id = (dim << 4) | Q1D;
    typedef void (*fQKernel)(const int NE, const int NQ,
                             const bool use_viscosity,
                             const bool use_vorticity,
                             const double h0, const double h1order,
                             const double cfl, const double infinity,
-                            const ParGridFunction &gamma_gf,
+                            const Vector &gamma,
                             const Array<double> &weights,
                             const Vector &Jacobians, const Vector &rho0DetJ0w,
                             const Vector &e_quads, const Vector &grad_v_ext,
                             const DenseTensor &Jac0inv,
-                            Vector &dt_est, DenseTensor &stressJinvT);
+                            const MaterialEOS eos,
+                            Vector &dt_est, Memory<T> &stressJinvT);
    static std::unordered_map<int, fQKernel> qupdate =
    {
-      {0x24,&QKernel<2,4>}, {0x26,&QKernel<2,6>}, {0x28,&QKernel<2,8>},
-      {0x34,&QKernel<3,4>}, {0x36,&QKernel<3,6>}, {0x38,&QKernel<3,8>}
+      {0x24,&QKernel<2,4,T>}, {0x26,&QKernel<2,6,T>}, {0x28,&QKernel<2,8,T>},
+      {0x34,&QKernel<3,4,T>}, {0x36,&QKernel<3,6,T>}, {0x38,&QKernel<3,8,T>}
    };
-   if (!qupdate[id])
+   fQKernel kernel = qupdate[id];
+   if (!kernel)
    {
-      mfem::out << "Unknown kernel 0x" << std::hex << id << std::endl;
-      MFEM_ABORT("Unknown kernel");
+      MFEM_VERIFY(dim == 2 || dim == 3, "Unknown kernel");
+      kernel = (dim == 2) ? &QKernelGeneric<2,T> : &QKernelGeneric<3,T>;
    }
-   qupdate[id](NE, NQ, use_viscosity, use_vorticity, qdata.h0, h1order,
-               cfl, infinity, gamma_gf, ir.GetWeights(), q_dx,
-               qdata.rho0DetJ0w, q_e, q_dv,
-               qdata.Jac0inv, q_dt_est, qdata.stressJinvT);
-   qdata.dt_est = q_dt_est.Min();
+   // The tensor kernels reduce the estimates of each element, the generic
+   // ones give one estimate per point.
+   q_dt_est.SetSize(qupdate[id] ? NE : NE*NQ);
+   kernel(NE, NQ, use_viscosity, use_vorticity, qdata.h0, h1order,
+          cfl, infinity, gamma_gf, ir.GetWeights(), q_dx,
+          qdata.rho0DetJ0w, q_e, q_dv,
+          qdata.Jac0inv, eos, q_dt_est, stressJinvT);
+   qdata.dt_est = fmin(qdata.dt_est, q_dt_est.Min());
+}
+
+void QUpdate::UpdateQuadratureData(const Vector &S, QuadratureData &qdata)
+{
+   timer->sw_qdata.Start();
+   timer->regions.Start("InterpolateState");
+   InterpolateState(S);
+   timer->regions.Stop();
+   timer->regions.Start("QKernel");
+   if (qdata.stressJinvT_sp.Size() > 0)
+   {
+      QuadratureKernel(qdata, qdata.stressJinvT_sp.GetMemory());
+   }
+   else { QuadratureKernel(qdata, qdata.stressJinvT.GetMemory()); }
+   timer->regions.Stop();
    timer->sw_qdata.Stop();
    timer->quad_tstep += NE;
 }
 
+BlockCGSolver::BlockCGSolver(MPI_Comm comm, const int dim, const int size,
+                             const MassPAOperator &mass, const Operator &Pv,
+                             Solver &prec, const Array<int> *ess_tdofs) :
+   comm(comm), dim(dim), size(size), mass(mass), Pv(Pv), prec(prec),
+   ess_tdofs(ess_tdofs), rel_tol(1e-8), rhs_rel_tol(false),
+   max_iter(300), num_iter(0),
+   r(dim*size), z(dim*size), w(dim*size), d(dim*size), Ad(dim*size)
+{
+   MFEM_VERIFY(dim <= 3, "BlockCGSolver supports at most 3 components.");
+   MFEM_VERIFY(Pv.Width() == dim*size, "BlockCGSolver: wrong prolongation!");
+   r.UseDevice(true);
+   z.UseDevice(true);
+   w.UseDevice(true);
+   d.UseDevice(true);
+   Ad.UseDevice(true);
+}
+
+void BlockCGSolver::MultComponents(const Vector &x, Vector &y,
+                                   const bool skip[]) const
+{
+   // Same as MassPAOperator::Mult, with the essential dofs of each component.
+   mass.MultComponents(Pv, x, y, skip);
+   Vector yc;
+   for (int c = 0; c < dim; c++)
+   {
+      if (ess_tdofs[c].Size() == 0) { continue; }
+      yc.MakeRef(y, c*size, size);
+      yc.SetSubVector(ess_tdofs[c], 0.0);
+      yc.GetMemory().SyncAlias(y.GetMemory(), size);
+   }
+}
+
+void BlockCGSolver::Warning(const int c, const char *msg) const
+{
+   // As in CGSolver, the component stops with its current iterate.
+   int rank;
+   MPI_Comm_rank(comm, &rank);
+   if (rank == 0)
+   {
+      mfem::out << "BlockCGSolver: " << msg << " (component " << c << ")."
+                << std::endl;
+   }
+}
+
+void BlockCGSolver::Mult(const Vector &B, Vector &X)
+{
+   MFEM_VERIFY(B.Size() == dim*size && X.Size() == dim*size,
+               "BlockCGSolver: wrong multivector size!");
+   // The recurrences are done on aliases of the components, the operator
+   // actions on the base vectors.
+   Vector Bc[3], Xc[3], rc[3], zc[3], wc[3], dc[3], Adc[3];
+   double loc[9], glob[9], gamma[3], alpha[3], r0[3];
+   bool done[3];
+   int iter[3];
+
+   // r = B - M X, z = P r, w = M z.
+   MultComponents(X, Ad);
+   subtract(B, Ad, r);
+   for (int c = 0; c < dim; c++)
+   {
+      Bc[c].MakeRef(const_cast<Vector &>(B), c*size, size);
+      Xc[c].MakeRef(X, c*size, size);
+      rc[c].MakeRef(r, c*size, size);
+      zc[c].MakeRef(z, c*size, size);
+      wc[c].MakeRef(w, c*size, size);
+      dc[c].MakeRef(d, c*size, size);
+      Adc[c].MakeRef(Ad, c*size, size);
+      prec.Mult(rc[c], zc[c]);
+      zc[c].GetMemory().SyncAlias(z.GetMemory(), size);
+   }
+   MultComponents(z, w);
+
+   // gamma = (z, r), delta = (w, z) and, for the rhs relative tolerance,
+   // (P B, B), the initial value of gamma for a zero initial guess.
+   const int nred = rhs_rel_tol ? 3*dim : 2*dim;
+   for (int c = 0; c < dim; c++)
+   {
+      loc[c] = zc[c] * rc[c];
+      loc[dim + c] = wc[c] * zc[c];
+      if (rhs_rel_tol)
+      {
+         // d is only used as work space before the first step.
+         prec.Mult(Bc[c], dc[c]);
+         loc[2*dim + c] = dc[c] * Bc[c];
+      }
+   }
+   MPI_Allreduce(loc, glob, nred, MPI_DOUBLE, MPI_SUM, comm);
+
+   int active = 0;
+   for (int c = 0; c < dim; c++)
+   {
+      gamma[c] = glob[c];
+      const double delta = glob[dim + c];
+      done[c] = true;
+      iter[c] = 0;
+      if (gamma[c] < 0.0)
+      {
+         Warning(c, "The preconditioner is not positive definite");
+         continue;
+      }
+      r0[c] = (rhs_rel_tol ? glob[2*dim + c] : gamma[c]) * rel_tol * rel_tol;
+      if (gamma[c] <= r0[c]) { continue; }
+      if (delta <= 0.0)
+      {
+         Warning(c, "The operator is not positive definite");
+         continue;
+      }
+      // d = z, Ad = w.
+      alpha[c] = gamma[c] / delta;
+      dc[c] = zc[c];
+      Adc[c] = wc[c];
+      done[c] = false;
+      iter[c] = max_iter;
+      active++;
+   }
+
+   for (int i = 1; i <= max_iter && active > 0; i++)
+   {
+      // X += alpha d, r -= alpha Ad, z = P r, w = M z.
+      for (int c = 0; c < dim; c++)
+      {
+         if (done[c]) { continue; }
+         Xc[c].Add(alpha[c], dc[c]);
+         rc[c].Add(-alpha[c], Adc[c]);
+         prec.Mult(rc[c], zc[c]);
+         zc[c].GetMemory().SyncAlias(z.GetMemory(), size);
+      }
+      MultComponents(z, w, done);
+
+      for (int c = 0; c < dim; c++)
+      {
+         loc[c] = loc[dim + c] = 0.0;
+         if (done[c]) { continue; }
+         loc[c] = rc[c] * zc[c];
+         loc[dim + c] = wc[c] * zc[c];
+      }
+      MPI_Allreduce(loc, glob, 2*dim, MPI_DOUBLE, MPI_SUM, comm);
+
+      for (int c = 0; c < dim; c++)
+      {
+         if (done[c]) { continue; }
+         const double betanom = glob[c], delta = glob[dim + c];
+         if (betanom < 0.0)
+         {
+            Warning(c, "The preconditioner is not positive definite");
+         }
+         if (betanom <= r0[c])
+         {
+            done[c] = true;
+            iter[c] = i;
+            active--;
+            continue;
+         }
+         // d = z + beta d, Ad = w + beta Ad, and the new step length from
+         // (Ad, d) = delta - beta gamma / alpha.
+         const double beta = betanom / gamma[c];
+         const double den = delta - beta * betanom / alpha[c];
+         if (den <= 0.0)
+         {
+            Warning(c, "The operator is not positive definite");
+            done[c] = true;
+            iter[c] = i;
+            active--;
+            continue;
+         }
+         alpha[c] = betanom / den;
+         add(zc[c], beta, dc[c], dc[c]);
+         add(wc[c], beta, Adc[c], Adc[c]);
+         gamma[c] = betanom;
+      }
+   }
+
+   num_iter = 0;
+   for (int c = 0; c < dim; c++)
+   {
+      num_iter += iter[c];
+      Xc[c].GetMemory().SyncAlias(X.GetMemory(), size);
+   }
+}
+
+void PipelinedCGSolver::UpdateVectors()
+{
+   Vector *vecs[] = { &r, &u, &w, &m, &n, &z, &q, &s, &p };
+   for (Vector *v : vecs)
+   {
+      v->SetSize(height);
+      v->UseDevice(true);
+   }
+}
+
+void PipelinedCGSolver::Mult(const Vector &b, Vector &x) const
+{
+   // r = b - A x, u = M r, w = A u.
+   if (iterative_mode)
+   {
+      oper->Mult(x, r);
+      subtract(b, r, r);
+   }
+   else
+   {
+      x = 0.0;
+      r = b;
+   }
+   if (prec) { prec->Mult(r, u); }
+   else { u = r; }
+   oper->Mult(u, w);
+
+   double loc[2], glob[2], r0 = 0.0, gamma_old = 0.0, alpha_old = 0.0;
+   converged = false;
+   for (int i = 0; true; i++)
+   {
+      // gamma = (r, u) and delta = (w, u), reduced while m = M w and n = A m
+      // are computed.
+      loc[0] = r * u;
+      loc[1] = w * u;
+      MPI_Request req;
+      MPI_Iallreduce(loc, glob, 2, MPI_DOUBLE, MPI_SUM, comm, &req);
+      if (i < max_iter)
+      {
+         if (prec) { prec->Mult(w, m); }
+         else { m = w; }
+         oper->Mult(m, n);
+      }
+      MPI_Wait(&req, MPI_STATUS_IGNORE);
+      const double gamma = glob[0], delta = glob[1];
+
+      if (i == 0)
+      {
+         MFEM_VERIFY(gamma >= 0.0,
+                     "PipelinedCGSolver: preconditioner is not SPD!");
+         r0 = std::max(gamma * rel_tol * rel_tol, abs_tol * abs_tol);
+      }
+      final_iter = i;
+      final_norm = sqrt(gamma);
+      if (gamma <= r0) { converged = true; break; }
+      if (i == max_iter) { break; }
+
+      double alpha;
+      if (i == 0)
+      {
+         MFEM_VERIFY(delta > 0.0, "PipelinedCGSolver: operator is not SPD!");
+         alpha = gamma / delta;
+         z = n; q = m; s = w; p = u;
+      }
+      else
+      {
+         const double beta = gamma / gamma_old;
+         const double den = delta - beta * gamma / alpha_old;
+         MFEM_VERIFY(den > 0.0, "PipelinedCGSolver: operator is not SPD!");
+         alpha = gamma / den;
+         add(n, beta, z, z);
+         add(m, beta, q, q);
+         add(w, beta, s, s);
+         add(u, beta, p, p);
+      }
+      x.Add(alpha, p);
+      r.Add(-alpha, s);
+      u.Add(-alpha, q);
+      w.Add(-alpha, z);
+      gamma_old = gamma;
+      alpha_old = alpha;
+   }
+}
+
 void LagrangianHydroOperator::AssembleForceMatrix() const
 {
    if (forcemat_is_assembled || p_assembly) { return; }
    Force = 0.0;
    timer.sw_force.Start();
+   timer.regions.Start("Force");
    Force.Assemble();
+   timer.regions.Stop();
    timer.sw_force.Stop();
    forcemat_is_assembled = true;
 }
@@ -1342,6 +2605,78 @@ void HydroODESolver::Init(TimeDependentOperator &tdop)
    ODESolver::Init(tdop);
    hydro_oper = dynamic_cast<hydrodynamics::LagrangianHydroOperator *>(f);
    MFEM_VERIFY(hydro_oper, "HydroSolvers expect LagrangianHydroOperator.");
+   S0.Update(hydro_oper->GetBlockOffsets(), mem_type);
+}
+
+void HydroODESolver::BeginStep(const Vector &S, const double t)
+{
+   S0.Vector::operator=(S);
+   t0 = t;
+   rejected = false;
+}
+
+bool HydroODESolver::RejectStage(const double dt)
+{
+   // The estimate is a minimum over the stages, so the check at the end of
+   // the step would fail as well.
+   rejected = hydro_oper->GetCurrentTimeStepEstimate() < dt;
+   return rejected;
+}
+
+void HydroODESolver::Rollback(Vector &S, double &t) const
+{
+   S = S0;
+   t = t0;
+   hydro_oper->ResetQuadratureData();
+}
+
+void HydroRK4Solver::Init(TimeDependentOperator &tdop)
+{
+   HydroODESolver::Init(tdop);
+   const int n = f->Width();
+   k.SetSize(n, mem_type);
+   z.SetSize(n, mem_type);
+   k.UseDevice(true);
+   z.UseDevice(true);
+}
+
+void HydroRK4Solver::Step(Vector &S, double &t, double &dt)
+{
+   //   0  |
+   //  1/2 | 1/2
+   //  1/2 |  0   1/2
+   //   1  |  0    0    1
+   // -----+-------------------
+   //      | 1/6  1/3  1/3  1/6
+   // S0 is the initial state, S holds the stage states.
+   hydrodynamics::RegionTimer &rt = hydro_oper->GetRegionTimer();
+   BeginStep(S, t);
+   f->SetTime(t);
+   rt.Start("stage 1");
+   f->Mult(S0, k); // k1
+   rt.Stop();
+   add(S0, dt/2, k, S);
+   add(S0, dt/6, k, z);
+   if (RejectStage(dt)) { return; }
+   f->SetTime(t + dt/2);
+   rt.Start("stage 2");
+   f->Mult(S, k); // k2
+   rt.Stop();
+   add(S0, dt/2, k, S);
+   z.Add(dt/3, k);
+   if (RejectStage(dt)) { return; }
+   rt.Start("stage 3");
+   f->Mult(S, k); // k3
+   rt.Stop();
+   add(S0, dt, k, S);
+   z.Add(dt/3, k);
+   if (RejectStage(dt)) { return; }
+   f->SetTime(t + dt);
+   rt.Start("stage 4");
+   f->Mult(S, k); // k4
+   rt.Stop();
+   add(z, dt/6, k, S);
+   t += dt;
 }
 
 void RK2AvgSolver::Init(TimeDependentOperator &tdop)
@@ -1352,14 +2687,13 @@ void RK2AvgSolver::Init(TimeDependentOperator &tdop)
    V.UseDevice(true);
    dS_dt.Update(block_offsets, mem_type);
    dS_dt = 0.0;
-   S0.Update(block_offsets, mem_type);
 }
 
 void RK2AvgSolver::Step(Vector &S, double &t, double &dt)
 {
    // The monolithic BlockVector stores the unknown fields as follows:
    // (Position, Velocity, Specific Internal Energy).
-   S0.Vector::operator=(S);
+   BeginStep(S, t);
    Vector &v0 = S0.GetBlock(1);
    Vector &dx_dt = dS_dt.GetBlock(0);
    Vector &dv_dt = dS_dt.GetBlock(1);
@@ -1371,24 +2705,33 @@ void RK2AvgSolver::Step(Vector &S, double &t, double &dt)
    // - Compute de_dt and dx_dt using S and V.
 
    // -- 1.
-   // S is S0.
+   // S is S0. Its quadrature data is usually current from the time step
+   // estimate at the end of the previous step, and it is not recomputed; the
+   // two solves of each stage share one quadrature data update, and the mesh
+   // is redirected to S only in the first stage.
+   hydrodynamics::RegionTimer &rt = hydro_oper->GetRegionTimer();
+   rt.Start("stage 1");
    hydro_oper->UpdateMesh(S);
    hydro_oper->SolveVelocity(S, dS_dt);
    // V = v0 + 0.5 * dt * dv_dt;
    add(v0, 0.5 * dt, dv_dt, V);
    hydro_oper->SolveEnergy(S, V, dS_dt);
    dx_dt = V;
+   rt.Stop();
+   if (RejectStage(dt)) { return; }
 
    // -- 2.
    // S = S0 + 0.5 * dt * dS_dt;
    add(S0, 0.5 * dt, dS_dt, S);
    hydro_oper->ResetQuadratureData();
+   rt.Start("stage 2");
    hydro_oper->UpdateMesh(S);
    hydro_oper->SolveVelocity(S, dS_dt);
    // V = v0 + 0.5 * dt * dv_dt;
    add(v0, 0.5 * dt, dv_dt, V);
    hydro_oper->SolveEnergy(S, V, dS_dt);
    dx_dt = V;
+   rt.Stop();
 
    // -- 3.
    // S = S0 + dt * dS_dt.
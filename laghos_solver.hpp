@@ -19,6 +19,10 @@
 
 #include "mfem.hpp"
 #include "laghos_assembly.hpp"
+#include "laghos_eos.hpp"
+#include <map>
+#include <string>
+#include <vector>
 
 #ifdef MFEM_USE_MPI
 
@@ -36,12 +40,76 @@ void VisualizeField(socketstream &sock, const char *vishost, int visport,
                     int x = 0, int y = 0, int w = 400, int h = 400,
                     bool vec = false);
 
+// Hierarchical timing of named code regions. A region that is started while
+// another one is open becomes its child, and it is identified by its full
+// path, e.g., "step/stage 1/SolveVelocity/CG H1". Independently of the timing,
+// the regions are annotated for external profilers when Laghos is built with
+// -DLAGHOS_USE_NVTX, -DLAGHOS_USE_ROCTX or -DLAGHOS_USE_CALIPER.
+class RegionTimer
+{
+private:
+   struct Region
+   {
+      StopWatch sw;
+      long calls;
+      Region() : calls(0) { }
+   };
+   std::map<std::string, Region> regions;
+   // Full paths and names of the open regions.
+   std::vector<std::string> paths;
+   std::vector<const char *> names;
+   bool enabled;
+
+   // Returns the region paths of all tasks and the min/max/avg time and the
+   // max number of calls of each of them over the tasks.
+   void Reduce(MPI_Comm comm, std::vector<std::string> &all_paths,
+               Vector &t_min, Vector &t_max, Vector &t_avg,
+               Array<long> &calls) const;
+
+public:
+   RegionTimer() : enabled(false) { }
+
+   // The timing (not the annotation) is only done when enabled. The device is
+   // synchronized at the region bounds, so that the times are meaningful.
+   void Enable(const bool e) { enabled = e; }
+   bool Enabled() const { return enabled; }
+
+   void Start(const char *name);
+   void Stop();
+   // Local time of the region with the given full path (0 if not visited).
+   double RealTime(const std::string &path) const
+   {
+      const auto it = regions.find(path);
+      return (it == regions.end()) ? 0.0 : it->second.sw.RealTime();
+   }
+
+   // Collective over comm. Prints the per-task min/max/avg times and the
+   // imbalance (max/avg) of all regions on the root task.
+   void Print(MPI_Comm comm, std::ostream &os) const;
+   // Collective over comm. Saves the same summary in JSON format if fname
+   // ends with ".json", or in CSV format otherwise.
+   void Save(MPI_Comm comm, const char *fname) const;
+};
+
+// Times the enclosing scope as a region of the given RegionTimer.
+class TimedRegion
+{
+private:
+   RegionTimer &rt;
+public:
+   TimedRegion(RegionTimer &rt, const char *name) : rt(rt) { rt.Start(name); }
+   ~TimedRegion() { rt.Stop(); }
+};
+
 struct TimingData
 {
    // Total times for all major computations:
    // CG solves (H1 and L2) / force RHS assemblies / quadrature computations.
    StopWatch sw_cgH1, sw_cgL2, sw_force, sw_qdata;
 
+   // Detailed, hierarchical breakdown of the run time.
+   RegionTimer regions;
+
    // Store the number of dofs of the corresponding local CG
    const HYPRE_Int L2dof;
 
@@ -64,22 +132,37 @@ private:
    TimingData *timer;
    const IntegrationRule &ir;
    ParFiniteElementSpace &H1, &L2;
-   const Operator *H1R;
-   Vector q_dt_est, q_e, e_vec, q_dx, q_dv;
+   const Operator *H1R, *L2R;
+   // Time step estimates of the elements (of the points, generic kernels).
+   Vector q_dt_est;
+   Vector q_e, e_vec, q_dx, q_dv;
    const QuadratureInterpolator *q1,*q2;
    const ParGridFunction &gamma_gf;
+   // Equation of state, with its data in the memory space of the kernels.
+   const MaterialEOS eos;
+   // Used only by the fused force kernels.
+   const DofToQuad *H1D2Q, *L2D2Q;
+   Vector force_e, energy_e;
+
+   void InterpolateState(const Vector &S);
+   int ForceKernelId() const;
+   // Runs the QKernel that stores the stress in the given precision.
+   template<typename T>
+   void QuadratureKernel(QuadratureData &qdata, Memory<T> &stressJinvT);
 public:
    QUpdate(const int d, const int ne, const int q1d,
            const bool visc, const bool vort,
            const double cfl, TimingData *t,
            const ParGridFunction &gamma_gf,
            const IntegrationRule &ir,
-           ParFiniteElementSpace &h1, ParFiniteElementSpace &l2):
+           ParFiniteElementSpace &h1, ParFiniteElementSpace &l2,
+           const MaterialEOS &eos):
       dim(d), vdim(h1.GetVDim()),
       NQ(ir.GetNPoints()), NE(ne), Q1D(q1d),
       use_viscosity(visc), use_vorticity(vort), cfl(cfl),
       timer(t), ir(ir), H1(h1), L2(l2),
       H1R(H1.GetElementRestriction(ElementDofOrdering::LEXICOGRAPHIC)),
+      L2R(L2.GetElementRestriction(ElementDofOrdering::LEXICOGRAPHIC)),
       q_dt_est(NE*NQ),
       q_e(NE*NQ),
       e_vec(NQ*NE*vdim),
@@ -87,9 +170,87 @@ public:
       q_dv(NQ*NE*vdim*vdim),
       q1(H1.GetQuadratureInterpolator(ir)),
       q2(L2.GetQuadratureInterpolator(ir)),
-      gamma_gf(gamma_gf) { }
+      gamma_gf(gamma_gf),
+      eos(eos),
+      H1D2Q(&H1.GetFE(0)->GetDofToQuad(ir, DofToQuad::TENSOR)),
+      L2D2Q(&L2.GetFE(0)->GetDofToQuad(ir, DofToQuad::TENSOR))
+   { q_dt_est.UseDevice(true); }
 
    void UpdateQuadratureData(const Vector &S, QuadratureData &qdata);
+
+   // Same as UpdateQuadratureData followed by the actions of ForcePAOperator
+   // on one (rhs) and on the velocity (e_rhs), computed in one pass over the
+   // elements. qdata.stressJinvT is not updated.
+   void UpdateQuadratureForces(const Vector &S, QuadratureData &qdata,
+                               Vector &rhs, Vector &e_rhs);
+   bool HasForceKernel() const;
+};
+
+// Solves the dim decoupled component systems of the partially assembled
+// velocity mass matrix within a single Krylov loop. Each component keeps its
+// own essential dofs and CG coefficients, i.e., in exact arithmetic the
+// iterates are the same as the ones of dim separate CG solves. The components
+// use the Chronopoulos-Gear recurrence, so that all inner products of a CG
+// step are combined in one MPI reduction, and the mass matrix is applied to
+// all components at once with the vector prolongation Pv.
+class BlockCGSolver
+{
+private:
+   const MPI_Comm comm;
+   const int dim, size;
+   const MassPAOperator &mass;
+   const Operator &Pv;
+   Solver &prec;
+   const Array<int> *ess_tdofs;
+   double rel_tol;
+   bool rhs_rel_tol;
+   int max_iter, num_iter;
+   mutable Vector r, z, w, d, Ad;
+
+   void MultComponents(const Vector &x, Vector &y,
+                       const bool skip[] = nullptr) const;
+   void Warning(const int c, const char *msg) const;
+
+public:
+   BlockCGSolver(MPI_Comm comm, const int dim, const int size,
+                 const MassPAOperator &mass, const Operator &Pv,
+                 Solver &prec, const Array<int> *ess_tdofs);
+
+   void SetRelTol(double rtol) { rel_tol = rtol; }
+   // Measures the relative tolerance against the (preconditioned) norm of
+   // the rhs instead of the initial residual, so that a good initial guess
+   // saves iterations.
+   void SetRhsRelTol(bool on) { rhs_rel_tol = on; }
+   void SetMaxIter(int max_it) { max_iter = max_it; }
+
+   // B and X hold the dim components of the right-hand side and of the
+   // solution, each of the given size; X is also used as initial guess.
+   void Mult(const Vector &B, Vector &X);
+
+   // Total number of CG iterations, summed over all components.
+   int GetNumIterations() const { return num_iter; }
+};
+
+// Preconditioned pipelined CG (Ghysels and Vanroose). Each iteration has a
+// single non-blocking reduction, which is overlapped with the preconditioner
+// and the operator actions.
+class PipelinedCGSolver : public IterativeSolver
+{
+protected:
+   mutable Vector r, u, w, m, n, z, q, s, p;
+
+   void UpdateVectors();
+
+public:
+   PipelinedCGSolver(MPI_Comm comm) : IterativeSolver(comm) { }
+
+   virtual void SetOperator(const Operator &op)
+   {
+      IterativeSolver::SetOperator(op);
+      UpdateVectors();
+   }
+
+   virtual void Mult(const Vector &b, Vector &x) const;
 };
 
 // Given a solutions state (x, v, e), this class performs all necessary
@@ -113,7 +274,13 @@ protected:
    const Array<int> &ess_tdofs;
    const int dim, NE, l2dofs_cnt, h1dofs_cnt, source_type;
    const double cfl;
-   const bool use_viscosity, use_vorticity, p_assembly;
+   const bool use_viscosity, use_vorticity, p_assembly, block_cg;
+   // Computes the force RHS together with the quadrature data, see Mult().
+   bool fused_force;
+   // Overlaps the exchange of the force RHS with the interior zones.
+   bool force_overlap;
+   // Energy solve with the local inverses Me_inv (always in full assembly).
+   const bool e_local_inv;
    const double cg_rel_tol;
    const int cg_max_iter;
    const double ftz_tol;
@@ -122,6 +289,13 @@ protected:
    // are constant in time, due to the pointwise mass conservation property.
    mutable ParBilinearForm Mv;
    SparseMatrix Mv_spmat_copy;
+   // Full assembly: Mv with eliminated essential dofs, and its smoother.
+   mutable OperatorHandle Mv_A;
+   HypreSmoother Mv_prec;
+   // Use the previous velocity solution as initial guess for CG. The CG
+   // tolerance is then set relative to the rhs, see WarmStartAbsTol.
+   const bool cg_warm_start;
+   mutable Vector dv_prev, warm_z;
    DenseTensor Me, Me_inv;
    // Integration rule for all assemblies.
    const IntegrationRule &ir;
@@ -129,7 +303,13 @@ protected:
    // These values are recomputed at each time step.
    const int Q1D;
    mutable QuadratureData qdata;
-   mutable bool qdata_is_current, forcemat_is_assembled;
+   mutable bool qdata_is_current, forcemat_is_assembled, forces_are_current;
+   // Global minimum of qdata.dt_est, reduced without blocking from
+   // SolveEnergy(). dt_est_reduced tells that dt_est_glob (after the request
+   // completes) corresponds to the current qdata.dt_est.
+   mutable bool dt_est_reduced;
+   mutable double dt_est_loc, dt_est_glob;
+   mutable MPI_Request dt_est_req;
    // Force matrix that combines the kinematic and thermodynamic spaces. It is
    // assembled in each time step and then it is used to compute the final
    // right-hand sides for momentum and specific internal energy.
@@ -140,27 +320,72 @@ protected:
    // velocity (coupled H1 assembly) and energy (local L2 assemblies).
    MassPAOperator *VMassPA, *EMassPA;
    OperatorJacobiSmoother *VMassPA_Jprec;
+   // H1c prolongation with persistent halo exchange requests.
+   PersistentProlongationOperator *HaloP;
+   // Halo exchange of all velocity components at once, used by BlockCG.
+   PersistentProlongationOperator *HaloPv;
+   // Batched application of Me_inv for the energy solve (full assembly, or
+   // partial assembly with local inverses).
+   LocalInverseOperator *EMassInv;
    // Linear solver for energy.
    CGSolver CG_VMass, CG_EMass;
+   // Velocity mass solver, CG_VMass or the pipelined PCG_VMass.
+   PipelinedCGSolver PCG_VMass;
+   IterativeSolver *VMassCG;
+   // Simultaneous solve of all velocity components (partial assembly).
+   BlockCGSolver *BlockCG_VMass;
+   mutable Vector BX, BB;
    mutable TimingData timer;
    mutable QUpdate *qupdate;
-   mutable Vector X, B, one, rhs, e_rhs;
+   mutable Vector X, B, one, rhs, e_rhs, rhs_tdofs;
    mutable ParGridFunction rhs_c_gf, dvc_gf;
    mutable Array<int> c_tdofs[3];
+   // Number of zones per batch of the 1D/FA quadrature update, the reference
+   // shape functions at the quadrature points, and the batch work arrays.
+   int fa_batch;
+   DenseTensor fa_dshape;
+   DenseMatrix fa_shape;
+   mutable Vector fa_J, fa_dV, fa_detJ, fa_gamma, fa_rho, fa_e, fa_p, fa_cs;
+   // Work arrays of the partial assembly density projection (and of
+   // ComputeWeightedDetJ), allocated at their first use.
+   mutable Vector rho_x, rho_dx, rho_wdetJ, rho_M, rho_e;
+   // Rayleigh-Taylor acceleration source and its contribution to the velocity
+   // rhs, Mv times the source, which is constant in time. The rhs is computed
+   // once in the constructor (true dofs by components in PA, local dofs in FA);
+   // the rhs is mutable only because the solves alias its components.
+   ParGridFunction accel_src_gf;
+   mutable Vector accel_src_rhs;
+   // Taylor-Green energy source. It depends on the current mesh and is
+   // reassembled in every energy solve, in the same LinearForm.
+   Coefficient *e_source_coeff;
+   mutable LinearForm *e_source;
+
+   // Tabulated EOS data (nullptr for the ideal gas EOS), see laghos_eos.hpp.
+   const EOSTable *eos_table;
 
+   // Batched evaluation of the MaterialEOS on the host, used by the 1D/FA
+   // quadrature data update.
    virtual void ComputeMaterialProperties(int nvalues, const double gamma[],
                                           const double rho[], const double e[],
                                           double p[], double cs[]) const
    {
+      const MaterialEOS eos = GetMaterialEOS(eos_table, false);
       for (int v = 0; v < nvalues; v++)
       {
-         p[v]  = (gamma[v] - 1.0) * rho[v] * e[v];
-         cs[v] = sqrt(gamma[v] * (gamma[v]-1.0) * e[v]);
+         eos.Eval(gamma[v], rho[v], e[v], p[v], cs[v]);
       }
    }
 
    void UpdateQuadratureData(const Vector &S) const;
+   void StartTimeStepEstimate() const;
+   template<int DIM> void UpdateQuadratureDataFA(const Vector &S) const;
    void AssembleForceMatrix() const;
+   void InitQuadratureData(ParGridFunction &rho0_gf);
+   void ComputeWeightedDetJ(Vector &wdetJ) const;
+   void ComputeDensityPA(ParGridFunction &rho) const;
+   void AssembleEnergyMassInverses();
+   void AssembleAccelerationSource();
+   double WarmStartAbsTol(Solver &prec, const Vector &B) const;
 
 public:
    LagrangianHydroOperator(const int size,
@@ -174,7 +399,13 @@ public:
                            const double cfl,
                            const bool visc, const bool vort, const bool pa,
                            const double cgt, const int cgiter, double ftz_tol,
-                           const int order_q);
+                           const int order_q, const bool block_cg,
+                           const bool fused_force, const bool e_local_inv,
+                           const bool force_overlap,
+                           const bool persistent_halo,
+                           const int cg_solver, const bool cg_warm_start,
+                           const bool mixed_precision, const bool restart,
+                           const EOSTable *eos_table);
    ~LagrangianHydroOperator();
 
    // Solve for dx_dt, dv_dt and de_dt.
@@ -189,11 +420,34 @@ public:
 
    // Calls UpdateQuadratureData to compute the new qdata.dt_estimate.
    double GetTimeStepEstimate(const Vector &S) const;
+   // Global minimum of the estimates computed since the last reset, without
+   // updating the quadrature data.
+   double GetCurrentTimeStepEstimate() const;
    void ResetTimeStepEstimate() const;
-   void ResetQuadratureData() const { qdata_is_current = false; }
+   // Number of zones in each batch of the 1D/FA quadrature data update.
+   void SetQuadratureBatchSize(const int nzones)
+   {
+      MFEM_VERIFY(nzones > 0, "The batch size must be positive!");
+      fa_batch = nzones;
+   }
+
+   void ResetQuadratureData() const
+   { qdata_is_current = false; forces_are_current = false; }
+   // The time-zero part of the quadrature data (Jac0inv, rho0DetJ0w, h0) is
+   // not computed by a restarted operator, and is restored from a checkpoint
+   // through this reference, followed by TimeZeroDataRestored(), which also
+   // forms the local energy mass inverses.
+   QuadratureData &GetQuadratureData() const { return qdata; }
+   void TimeZeroDataRestored();
+
+   // Max relative (Frobenius) difference, over all zones, between the local
+   // energy mass inverses and the DenseMatrixInverse of the same matrices.
+   // Zero when the local inverses are not used.
+   double EnergyMassInverseError() const;
 
    // The density values, which are stored only at some quadrature points,
-   // are projected as a ParGridFunction.
+   // are projected as a ParGridFunction. This is not needed by the time
+   // stepping, so it should be called only when the result is used.
    void ComputeDensity(ParGridFunction &rho) const;
    double InternalEnergy(const ParGridFunction &e) const;
    double KineticEnergy(const ParGridFunction &v) const;
@@ -202,6 +456,9 @@ public:
    const Array<int> &GetBlockOffsets() const { return block_offsets; }
 
    void PrintTimingData(bool IamRoot, int steps, const bool fom) const;
+   // Saves the region timings of PrintTimingData, see RegionTimer::Save.
+   void SaveTimingData(const char *fname) const;
+   RegionTimer &GetRegionTimer() const { return timer.regions; }
 };
 
 // TaylorCoefficient used in the 2D Taylor-Green problem.
@@ -236,18 +493,46 @@ class HydroODESolver : public ODESolver
 {
 protected:
    hydrodynamics::LagrangianHydroOperator *hydro_oper;
+   // State and time at the start of the last step, used by Rollback().
+   BlockVector S0;
+   double t0;
+   bool rejected;
+
+   void BeginStep(const Vector &S, const double t);
+   // Checks the time step estimate of the stages computed so far. When it is
+   // below dt, the step is marked as rejected and the remaining stages are
+   // skipped.
+   bool RejectStage(const double dt);
+
 public:
-   HydroODESolver() : hydro_oper(NULL) { }
+   HydroODESolver() : hydro_oper(NULL), t0(0.0), rejected(false) { }
    virtual void Init(TimeDependentOperator&);
    virtual void Step(Vector&, double&, double&)
    { MFEM_ABORT("Time stepping is undefined."); }
+
+   // True when the last step was stopped after a stage, in which case S does
+   // not hold a new state and the step must be rolled back.
+   bool StepRejected() const { return rejected; }
+   // Restores S and t to their values at the start of the last step.
+   void Rollback(Vector &S, double &t) const;
+};
+
+// Same as mfem::RK4Solver, with early rejection of the step.
+class HydroRK4Solver : public HydroODESolver
+{
+protected:
+   Vector k, z;
+public:
+   HydroRK4Solver() { }
+   virtual void Init(TimeDependentOperator &_f);
+   virtual void Step(Vector &S, double &t, double &dt);
 };
 
 class RK2AvgSolver : public HydroODESolver
 {
 protected:
    Vector V;
-   BlockVector dS_dt, S0;
+   BlockVector dS_dt;
 public:
    RK2AvgSolver() { }
    virtual void Init(TimeDependentOperator &_f);
@@ -48,6 +48,9 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include "laghos_solver.hpp"
+#ifdef MFEM_USE_OPENMP
+#include <omp.h>
+#endif
 
 using std::cout;
 using std::endl;
@@ -166,6 +169,12 @@ int main(int argc, char *argv[])
    Device backend;
    backend.Configure(device, dev);
    backend.Print();
+#ifdef MFEM_USE_OPENMP
+   if (Device::Allows(Backend::OMP_MASK))
+   {
+      cout << "OpenMP threads: " << omp_get_max_threads() << endl;
+   }
+#endif
 
    // On all processors, use the default builtin 1D/2D/3D mesh or read the
    // serial one given on the command line.
@@ -31,13 +31,16 @@ namespace hydrodynamics
 struct QuadratureData
 {
    // Reference to physical Jacobian for the initial mesh.
-   // These are computed only at time zero and stored here.
+   // These are computed only at time zero and stored here, as NQ x dim*dim x
+   // NE with the component index i + dim*j of Jac0inv(i,j).
    DenseTensor Jac0inv;
 
    // Quadrature data used for full/partial assembly of the force operator.
    // At each quadrature point, it combines the stress, inverse Jacobian,
    // determinant of the Jacobian and the integration weight.
-   // It must be recomputed in every time step.
+   // It must be recomputed in every time step. The layout is
+   // NQ x dim*dim x NE, where the component index is gd + dim*vd for the
+   // (vd, gd) entry, as in the parallel version, see laghos_pa_kernels.hpp.
    DenseTensor stressJinvT;
 
    // Quadrature data used for full/partial assembly of the mass matrices.
@@ -56,8 +59,8 @@ struct QuadratureData
    double dt_est;
 
    QuadratureData(int dim, int NE, int quads_per_el)
-      : Jac0inv(dim, dim, NE * quads_per_el),
-        stressJinvT(NE * quads_per_el, dim, dim),
+      : Jac0inv(quads_per_el, dim * dim, NE),
+        stressJinvT(quads_per_el, dim * dim, NE),
         rho0DetJ0w(NE * quads_per_el) { }
 };
 
@@ -101,7 +104,8 @@ private:
    const IntegrationRule &ir1D;
    const int D1D, Q1D, L1D, H1sz, L2sz;
    const DofToQuad *L2D2Q, *H1D2Q;
-   mutable Vector X, Y;
+   // Q is the quadrature point buffer of the generic (any order) kernels.
+   mutable Vector X, Y, Q;
 public:
    ForcePAOperator(const QuadratureData&,
                    FiniteElementSpace&,
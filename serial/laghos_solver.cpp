@@ -16,6 +16,7 @@
 
 #include "general/forall.hpp"
 #include "laghos_solver.hpp"
+#include "../laghos_pa_kernels.hpp"
 #include "linalg/kernels.hpp"
 #include <unordered_map>
 
@@ -87,7 +88,7 @@ static void Rho0DetJ0Vol(const int dim, const int NE,
    Memory<double> &Jinv_m = qdata.Jac0inv.GetMemory();
    const MemoryClass mc = Device::GetMemoryClass();
    const int Ji_total_size = qdata.Jac0inv.TotalSize();
-   auto invJ = Reshape(Jinv_m.Write(mc, Ji_total_size), dim, dim, NQ, NE);
+   auto invJ = Reshape(Jinv_m.Write(mc, Ji_total_size), NQ, dim, dim, NE);
    Vector vol(NE*NQ), one(NE*NQ);
    auto A = Reshape(vol.Write(), NQ, NE);
    auto O = Reshape(one.Write(), NQ, NE);
@@ -108,10 +109,10 @@ static void Rho0DetJ0Vol(const int dim, const int NE,
                const double det = detJ(q,e);
                V(q,e) =  W[q] * R(q,e) * det;
                const double r_idetJ = 1.0 / det;
-               invJ(0,0,q,e) =  J22 * r_idetJ;
-               invJ(1,0,q,e) = -J12 * r_idetJ;
-               invJ(0,1,q,e) = -J21 * r_idetJ;
-               invJ(1,1,q,e) =  J11 * r_idetJ;
+               invJ(q,0,0,e) =  J22 * r_idetJ;
+               invJ(q,1,0,e) = -J12 * r_idetJ;
+               invJ(q,0,1,e) = -J21 * r_idetJ;
+               invJ(q,1,1,e) =  J11 * r_idetJ;
                A(q,e) = W[q] * det;
                O(q,e) = 1.0;
             }
@@ -135,15 +136,15 @@ static void Rho0DetJ0Vol(const int dim, const int NE,
                   const double det = detJ(q,e);
                   V(q,e) = W[q] * R(q,e) * det;
                   const double r_idetJ = 1.0 / det;
-                  invJ(0,0,q,e) = r_idetJ * ((J22 * J33)-(J23 * J32));
-                  invJ(1,0,q,e) = r_idetJ * ((J32 * J13)-(J33 * J12));
-                  invJ(2,0,q,e) = r_idetJ * ((J12 * J23)-(J13 * J22));
-                  invJ(0,1,q,e) = r_idetJ * ((J23 * J31)-(J21 * J33));
-                  invJ(1,1,q,e) = r_idetJ * ((J33 * J11)-(J31 * J13));
-                  invJ(2,1,q,e) = r_idetJ * ((J13 * J21)-(J11 * J23));
-                  invJ(0,2,q,e) = r_idetJ * ((J21 * J32)-(J22 * J31));
-                  invJ(1,2,q,e) = r_idetJ * ((J31 * J12)-(J32 * J11));
-                  invJ(2,2,q,e) = r_idetJ * ((J11 * J22)-(J12 * J21));
+                  invJ(q,0,0,e) = r_idetJ * ((J22 * J33)-(J23 * J32));
+                  invJ(q,1,0,e) = r_idetJ * ((J32 * J13)-(J33 * J12));
+                  invJ(q,2,0,e) = r_idetJ * ((J12 * J23)-(J13 * J22));
+                  invJ(q,0,1,e) = r_idetJ * ((J23 * J31)-(J21 * J33));
+                  invJ(q,1,1,e) = r_idetJ * ((J33 * J11)-(J31 * J13));
+                  invJ(q,2,1,e) = r_idetJ * ((J13 * J21)-(J11 * J23));
+                  invJ(q,0,2,e) = r_idetJ * ((J21 * J32)-(J22 * J31));
+                  invJ(q,1,2,e) = r_idetJ * ((J31 * J12)-(J32 * J11));
+                  invJ(q,2,2,e) = r_idetJ * ((J11 * J22)-(J12 * J21));
                   A(q,e) = W[q] * det;
                   O(q,e) = 1.0;
                }
@@ -278,6 +279,7 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
    {
       const int NQ = ir.GetNPoints();
       Vector rho_vals(NQ);
+      DenseMatrix Jac0inv_q(dim);
       for (int e = 0; e < NE; e++)
       {
          rho0_gf.GetValues(e, ir, rho_vals);
@@ -287,7 +289,11 @@ LagrangianHydroOperator::LagrangianHydroOperator(const int size,
             const IntegrationPoint &ip = ir.IntPoint(q);
             Tr.SetIntPoint(&ip);
             DenseMatrixInverse Jinv(Tr.Jacobian());
-            Jinv.GetInverseMatrix(qdata.Jac0inv(e*NQ + q));
+            Jinv.GetInverseMatrix(Jac0inv_q);
+            for (int k = 0; k < dim*dim; k++)
+            {
+               qdata.Jac0inv(q, k, e) = Jac0inv_q.GetData()[k];
+            }
             const double rho0DetJ0 = Tr.Weight() * rho_vals(q);
             qdata.rho0DetJ0w(e*NQ + q) = rho0DetJ0 * ir.IntPoint(q).weight;
          }
@@ -584,7 +590,9 @@ void LagrangianHydroOperator::PrintTimingData(int steps, const bool fom) const
    data[1] = timer.quad_tstep;
    data[2] = NE;
 
-   const int H1size = H1.GetVSize(), L2size = L2.GetVSize();
+   // Same counts as in the parallel version, where these are the global true
+   // sizes, so that the FOMs of both versions can be compared.
+   const int H1size = H1TVSize, L2size = L2TVSize;
 
    using namespace std;
    // FOM = (FOM1 * T1 + FOM2 * T2 + FOM3 * T3) / (T1 + T2 + T3)
@@ -648,15 +656,6 @@ void LagrangianHydroOperator::PrintTimingData(int steps, const bool fom) const
 
 }
 
-// Smooth transition between 0 and 1 for x in [-eps, eps].
-MFEM_HOST_DEVICE inline double smooth_step_01(double x, double eps)
-{
-   const double y = (x + eps) / (2.0 * eps);
-   if (y < 0.0) { return 0.0; }
-   if (y > 1.0) { return 1.0; }
-   return (3.0 - 2.0 * y) * y * y;
-}
-
 void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
 {
    if (qdata_is_current) { return; }
@@ -676,6 +675,7 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
    e.MakeRef(&L2, *sptr, 2*H1.GetVSize());
    Vector e_vals, e_loc(l2dofs_cnt), vector_vals(h1dofs_cnt * dim);
    DenseMatrix Jpi(dim), sgrad_v(dim), Jinv(dim), stress(dim), stressJiT(dim),
+               Jac0inv_q(dim),
                vecvalMat(vector_vals.GetData(), h1dofs_cnt, dim);
    DenseTensor grad_v_ref(dim, dim, nqp);
    Array<int> L2dofs, H1dofs;
@@ -757,7 +757,11 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
                eig_vec_data[0] = 1.;
                Vector compr_dir(eig_vec_data, dim);
                // Computes the initial->physical transformation Jacobian.
-               mfem::Mult(Jpr, qdata.Jac0inv(z_id*nqp + q), Jpi);
+               for (int k = 0; k < dim*dim; k++)
+               {
+                  Jac0inv_q.GetData()[k] = qdata.Jac0inv(q, k, z_id);
+               }
+               mfem::Mult(Jpr, Jac0inv_q, Jpi);
                Vector ph_dir(dim); Jpi.Mult(compr_dir, ph_dir);
                // Change of the initial mesh size in the compression direction.
                const double h = qdata.h0 * ph_dir.Norml2() /
@@ -801,8 +805,7 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
             {
                for (int gd = 0; gd < dim; gd++)
                {
-                  qdata.stressJinvT(vd)(z_id*nqp + q, gd) =
-                     stressJiT(vd, gd);
+                  qdata.stressJinvT(q, gd + dim*vd, z_id) = stressJiT(vd, gd);
                }
             }
          }
@@ -819,213 +822,6 @@ void LagrangianHydroOperator::UpdateQuadratureData(const Vector &S) const
    timer.quad_tstep += NE;
 }
 
-template<int DIM> MFEM_HOST_DEVICE static inline
-void QUpdateBody(const int NE, const int e,
-                 const int NQ, const int q,
-                 const bool use_viscosity,
-                 const double h0,
-                 const double h1order,
-                 const double cfl,
-                 const double infinity,
-                 double* __restrict__ Jinv,
-                 double* __restrict__ stress,
-                 double* __restrict__ sgrad_v,
-                 double* __restrict__ eig_val_data,
-                 double* __restrict__ eig_vec_data,
-                 double* __restrict__ compr_dir,
-                 double* __restrict__ Jpi,
-                 double* __restrict__ ph_dir,
-                 double* __restrict__ stressJiT,
-                 const double* __restrict__ d_gamma,
-                 const double* __restrict__ d_weights,
-                 const double* __restrict__ d_Jacobians,
-                 const double* __restrict__ d_rho0DetJ0w,
-                 const double* __restrict__ d_e_quads,
-                 const double* __restrict__ d_grad_v_ext,
-                 const double* __restrict__ d_Jac0inv,
-                 double *d_dt_est,
-                 double *d_stressJinvT)
-{
-   constexpr int DIM2 = DIM*DIM;
-   double min_detJ = infinity;
-
-   const int eq = e * NQ + q;
-   const double gamma = d_gamma[e];
-   const double weight =  d_weights[q];
-   const double inv_weight = 1. / weight;
-   const double *J = d_Jacobians + DIM2*(NQ*e + q);
-   const double detJ = kernels::Det<DIM>(J);
-   min_detJ = fmin(min_detJ, detJ);
-   kernels::CalcInverse<DIM>(J, Jinv);
-   const double R = inv_weight * d_rho0DetJ0w[eq] / detJ;
-   const double E = fmax(0.0, d_e_quads[eq]);
-   const double P = (gamma - 1.0) * R * E;
-   const double S = sqrt(gamma * (gamma - 1.0) * E);
-   for (int k = 0; k < DIM2; k++) { stress[k] = 0.0; }
-   for (int d = 0; d < DIM; d++) { stress[d*DIM+d] = -P; }
-   double visc_coeff = 0.0;
-   if (use_viscosity)
-   {
-      // Compression-based length scale at the point. The first
-      // eigenvector of the symmetric velocity gradient gives the
-      // direction of maximal compression. This is used to define the
-      // relative change of the initial length scale.
-      const double *dV = d_grad_v_ext + DIM2*(NQ*e + q);
-      kernels::Mult(DIM, DIM, DIM, dV, Jinv, sgrad_v);
-      kernels::Symmetrize(DIM, sgrad_v);
-      if (DIM == 1)
-      {
-         eig_val_data[0] = sgrad_v[0];
-         eig_vec_data[0] = 1.;
-      }
-      else
-      {
-         kernels::CalcEigenvalues<DIM>(sgrad_v, eig_val_data, eig_vec_data);
-      }
-      for (int k=0; k<DIM; k++) { compr_dir[k] = eig_vec_data[k]; }
-      // Computes the initial->physical transformation Jacobian.
-      kernels::Mult(DIM, DIM, DIM, J, d_Jac0inv + eq*DIM*DIM, Jpi);
-      kernels::Mult(DIM, DIM, Jpi, compr_dir, ph_dir);
-      // Change of the initial mesh size in the compression direction.
-      const double ph_dir_nl2 = kernels::Norml2(DIM, ph_dir);
-      const double compr_dir_nl2 = kernels::Norml2(DIM, compr_dir);
-      const double H = h0 * ph_dir_nl2 / compr_dir_nl2;
-      // Measure of maximal compression.
-      const double mu = eig_val_data[0];
-      visc_coeff = 2.0 * R * H * H * fabs(mu);
-      // The following represents a "smooth" version of the statement
-      // "if (mu < 0) visc_coeff += 0.5 rho h sound_speed".  Note that
-      // eps must be scaled appropriately if a different unit system is
-      // being used.
-      const double eps = 1e-12;
-      visc_coeff += 0.5 * R * H  * S * (1.0 - smooth_step_01(mu-2.0*eps, eps));
-      kernels::Add(DIM, DIM, visc_coeff, stress, sgrad_v, stress);
-   }
-   // Time step estimate at the point. Here the more relevant length
-   // scale is related to the actual mesh deformation; we use the min
-   // singular value of the ref->physical Jacobian. In addition, the
-   // time step estimate should be aware of the presence of shocks.
-   const double sv = kernels::CalcSingularvalue<DIM>(J, DIM - 1);
-   const double h_min = sv / h1order;
-   const double ih_min = 1. / h_min;
-   const double irho_ih_min_sq = ih_min * ih_min / R ;
-   const double idt = S * ih_min + 2.5 * visc_coeff * irho_ih_min_sq;
-   if (min_detJ < 0.0)
-   {
-      // This will force repetition of the step with smaller dt.
-      d_dt_est[eq] = 0.0;
-   }
-   else
-   {
-      if (idt > 0.0)
-      {
-         const double cfl_inv_dt = cfl / idt;
-         d_dt_est[eq] = fmin(d_dt_est[eq], cfl_inv_dt);
-      }
-   }
-   // Quadrature data for partial assembly of the force operator.
-   kernels::MultABt(DIM, DIM, DIM, stress, Jinv, stressJiT);
-   for (int k = 0; k < DIM2; k++) { stressJiT[k] *= weight * detJ; }
-   for (int vd = 0 ; vd < DIM; vd++)
-   {
-      for (int gd = 0; gd < DIM; gd++)
-      {
-         const int offset = eq + NQ*NE*(gd + vd*DIM);
-         d_stressJinvT[offset] = stressJiT[vd + gd*DIM];
-      }
-   }
-}
-
-template<int DIM, int Q1D> static inline
-void QKernel(const int NE, const int NQ,
-             const bool use_viscosity,
-             const double h0,
-             const double h1order,
-             const double cfl,
-             const double infinity,
-             const GridFunction &gamma_gf,
-             const Array<double> &weights,
-             const Vector &Jacobians,
-             const Vector &rho0DetJ0w,
-             const Vector &e_quads,
-             const Vector &grad_v_ext,
-             const DenseTensor &Jac0inv,
-             Vector &dt_est,
-             DenseTensor &stressJinvT)
-{
-   constexpr int DIM2 = DIM*DIM;
-   auto d_gamma = gamma_gf.Read();
-   auto d_weights = weights.Read();
-   auto d_Jacobians = Jacobians.Read();
-   auto d_rho0DetJ0w = rho0DetJ0w.Read();
-   auto d_e_quads = e_quads.Read();
-   auto d_grad_v_ext = grad_v_ext.Read();
-   auto d_Jac0inv = Read(Jac0inv.GetMemory(), Jac0inv.TotalSize());
-   auto d_dt_est = dt_est.ReadWrite();
-   auto d_stressJinvT = Write(stressJinvT.GetMemory(), stressJinvT.TotalSize());
-   if (DIM == 2)
-   {
-      MFEM_FORALL_2D(e, NE, Q1D, Q1D, 1,
-      {
-         double Jinv[DIM2];
-         double stress[DIM2];
-         double sgrad_v[DIM2];
-         double eig_val_data[3];
-         double eig_vec_data[9];
-         double compr_dir[DIM];
-         double Jpi[DIM2];
-         double ph_dir[DIM];
-         double stressJiT[DIM2];
-         MFEM_FOREACH_THREAD(qx,x,Q1D)
-         {
-            MFEM_FOREACH_THREAD(qy,y,Q1D)
-            {
-               QUpdateBody<DIM>(NE, e, NQ, qx + qy * Q1D,
-               use_viscosity, h0, h1order, cfl, infinity,
-               Jinv, stress, sgrad_v, eig_val_data, eig_vec_data,
-               compr_dir, Jpi, ph_dir, stressJiT,
-               d_gamma, d_weights, d_Jacobians, d_rho0DetJ0w,
-               d_e_quads, d_grad_v_ext, d_Jac0inv,
-               d_dt_est, d_stressJinvT);
-            }
-         }
-         MFEM_SYNC_THREAD;
-      });
-   }
-   if (DIM == 3)
-   {
-      MFEM_FORALL_3D(e, NE, Q1D, Q1D, Q1D,
-      {
-         double Jinv[DIM2];
-         double stress[DIM2];
-         double sgrad_v[DIM2];
-         double eig_val_data[3];
-         double eig_vec_data[9];
-         double compr_dir[DIM];
-         double Jpi[DIM2];
-         double ph_dir[DIM];
-         double stressJiT[DIM2];
-         MFEM_FOREACH_THREAD(qx,x,Q1D)
-         {
-            MFEM_FOREACH_THREAD(qy,y,Q1D)
-            {
-               MFEM_FOREACH_THREAD(qz,z,Q1D)
-               {
-                  QUpdateBody<DIM>(NE, e, NQ, qx + Q1D * (qy + qz * Q1D),
-                  use_viscosity, h0, h1order, cfl, infinity,
-                  Jinv, stress, sgrad_v, eig_val_data, eig_vec_data,
-                  compr_dir, Jpi, ph_dir, stressJiT,
-                  d_gamma, d_weights, d_Jacobians, d_rho0DetJ0w,
-                  d_e_quads, d_grad_v_ext, d_Jac0inv,
-                  d_dt_est, d_stressJinvT);
-               }
-            }
-         }
-         MFEM_SYNC_THREAD;
-      });
-   }
-}
-
 void QUpdate::UpdateQuadratureData(const Vector &S, QuadratureData &qdata)
 {
    timer->sw_qdata.Start();
@@ -1044,33 +840,39 @@ void QUpdate::UpdateQuadratureData(const Vector &S, QuadratureData &qdata)
    e.MakeRef(&L2, *S_p, 2*H1_size);
    q2->SetOutputLayout(QVectorLayout::byVDIM);
    q2->Values(e, q_e);
-   q_dt_est = qdata.dt_est;
    const int id = (dim << 4) | Q1D;
    typedef void (*fQKernel)(const int NE, const int NQ,
                             const bool use_viscosity,
+                            const bool use_vorticity,
                             const double h0, const double h1order,
                             const double cfl, const double infinity,
-                            const GridFunction &gamma_gf,
+                            const Vector &gamma,
                             const Array<double> &weights,
                             const Vector &Jacobians, const Vector &rho0DetJ0w,
                             const Vector &e_quads, const Vector &grad_v_ext,
                             const DenseTensor &Jac0inv,
-                            Vector &dt_est, DenseTensor &stressJinvT);
+                            const MaterialEOS eos,
+                            Vector &dt_est, Memory<double> &stressJinvT);
    static std::unordered_map<int, fQKernel> qupdate =
    {
-      {0x24,&QKernel<2,4>}, {0x26,&QKernel<2,6>}, {0x28,&QKernel<2,8>},
-      {0x34,&QKernel<3,4>}, {0x36,&QKernel<3,6>}, {0x38,&QKernel<3,8>}
+      {0x24,&QKernel<2,4,double>}, {0x26,&QKernel<2,6,double>},
+      {0x28,&QKernel<2,8,double>}, {0x34,&QKernel<3,4,double>},
+      {0x36,&QKernel<3,6,double>}, {0x38,&QKernel<3,8,double>}
    };
-   if (!qupdate[id])
+   fQKernel kernel = qupdate[id];
+   if (!kernel)
    {
-      mfem::out << "Unknown kernel 0x" << std::hex << id << std::endl;
-      MFEM_ABORT("Unknown kernel");
+      MFEM_VERIFY(dim == 2 || dim == 3, "Unknown kernel");
+      kernel = (dim == 2) ? &QKernelGeneric<2,double> :
+               &QKernelGeneric<3,double>;
    }
-   qupdate[id](NE, NQ, use_viscosity, qdata.h0, h1order, cfl, infinity,
-               gamma_gf, ir.GetWeights(), q_dx,
-               qdata.rho0DetJ0w, q_e, q_dv,
-               qdata.Jac0inv, q_dt_est, qdata.stressJinvT);
-   qdata.dt_est = q_dt_est.Min();
+   // The tensor kernels reduce the estimates of each element, the generic
+   // ones give one estimate per point.
+   q_dt_est.SetSize(qupdate[id] ? NE : NE*NQ);
+   kernel(NE, NQ, use_viscosity, false, qdata.h0, h1order, cfl, infinity,
+          gamma_gf, ir.GetWeights(), q_dx, qdata.rho0DetJ0w, q_e, q_dv,
+          qdata.Jac0inv, eos, q_dt_est, qdata.stressJinvT.GetMemory());
+   qdata.dt_est = fmin(qdata.dt_est, q_dt_est.Min());
    timer->sw_qdata.Stop();
    timer->quad_tstep += NE;
 }
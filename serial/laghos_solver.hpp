@@ -19,6 +19,7 @@
 
 #include "mfem.hpp"
 #include "laghos_assembly.hpp"
+#include "../laghos_eos.hpp"
 
 namespace mfem
 {
@@ -53,6 +54,9 @@ struct TimingData
       L2dof(l2d), H1iter(0), L2iter(0), quad_tstep(0) { }
 };
 
+// Computes the quadrature data with the partial assembly kernels that are
+// shared with the parallel version, see laghos_pa_kernels.hpp. The serial
+// version only uses the ideal gas EOS.
 class QUpdate
 {
 private:
@@ -66,6 +70,7 @@ private:
    Vector q_dt_est, q_e, e_vec, q_dx, q_dv;
    const QuadratureInterpolator *q1,*q2;
    const GridFunction &gamma_gf;
+   const MaterialEOS eos;
 public:
    QUpdate(const int d, const int ne, const int q1d, const bool visc,
            const double cfl, TimingData *t,
@@ -84,7 +89,8 @@ public:
       q_dv(NQ*NE*vdim*vdim),
       q1(H1.GetQuadratureInterpolator(ir)),
       q2(L2.GetQuadratureInterpolator(ir)),
-      gamma_gf(gamma_gf) { }
+      gamma_gf(gamma_gf),
+      eos(GetMaterialEOS(nullptr, true)) { }
 
    void UpdateQuadratureData(const Vector &S, QuadratureData &qdata);
 };